@@ -0,0 +1,351 @@
+// basin.h - attractor basins of a deterministic tape map
+//
+// Every evaluator maps a tape to exactly one next tape, so the tapes reachable
+// from a set of start tapes form a functional graph: each node has one
+// outgoing edge and every component ends in a cycle. basin_build evaluates
+// every node once. Start tapes are nodes [0, start_count), tapes they lead to
+// are appended behind them and evaluated in turn until no new tape shows up.
+// Tapes are evaluated in parallel batches, the results are deduplicated in one
+// hash table by the calling thread.
+//
+// basin_solve finds, for every node, how many steps it takes to reach its
+// cycle, which cycle that is and how long it is, with pointer jumping:
+// - J = f^(2^k) is doubled until 2^k covers every node, so J(x) lies on a
+//   cycle for every x and every cycle node is some J(x). Along the way m(x)
+//   becomes the smallest node of the first 2^k steps, for a cycle node that is
+//   the smallest node of its cycle and serves as the cycle id.
+// - Tails are ranked like a linked list: p(x) starts at next(x), or at x on a
+//   cycle, d(x) at 1, or 0 on a cycle, and every round does
+//   d(x) += d(p(x)), p(x) = p(p(x)).
+// Each round reads the previous round's arrays and writes fresh ones, so the
+// nodes of a round are split between the threads without locks.
+//
+// basin_write saves the graph as a Basin_Header followed by next, tail, cycle
+// and cycle_length (node_count uint32 each) and the tapes of the nodes that
+// are not start tapes. The start tapes are left out, the driver enumerates them.
+//
+// Include after nob.h. Define BASIN_IMPLEMENTATION in exactly one file.
+
+#ifndef BASIN_H_
+#define BASIN_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BASIN_MAGIC 0x4D424642u // "BFBM"
+#define BASIN_VERSION 1
+#define BASIN_BATCH (1 << 14)   // tapes evaluated between two rounds of deduplication
+#define BASIN_CHUNK 256         // nodes claimed at once by a worker
+
+// Evaluates src into dst, both tape_size cells
+typedef void (*Basin_Eval)(const uint8_t *src, uint8_t *dst);
+
+typedef struct {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t tape_size;
+    uint64_t alphabet;
+    uint64_t start_count;
+    uint64_t node_count;
+    uint64_t cycle_count;
+    uint64_t start_length;  // start tapes are every tape of this many leading cells
+} Basin_Header;
+
+typedef struct {
+    size_t tape_size;
+    size_t threads;
+    Basin_Eval eval;
+    void (*thread_end)(void);   // optional, called by every worker before it exits
+
+    uint8_t *tapes;             // node_count*tape_size
+    size_t start_count;
+    size_t node_count;
+    size_t node_capacity;
+    uint32_t *slots;            // node + 1 per slot, 0 when empty
+    size_t slot_capacity;       // power of two
+
+    uint32_t *next;
+    uint32_t *tail;             // steps to the first node on a cycle
+    uint32_t *cycle;            // smallest node of the cycle that is reached
+    uint32_t *cycle_length;
+    size_t cycle_count;
+} Basin;
+
+// Adds start_count tapes as the first nodes and evaluates until the graph is closed
+bool basin_build(Basin *b, const uint8_t *starts, size_t start_count);
+void basin_solve(Basin *b);
+bool basin_write(const Basin *b, const char *path, size_t alphabet, size_t start_length);
+void basin_free(Basin *b);
+
+#endif // BASIN_H_
+
+#ifdef BASIN_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    Basin *b;
+    void (*step)(Basin *b, size_t i, void *arg);
+    void *arg;
+    size_t count;
+    _Atomic size_t next;
+} Basin__Job;
+
+static void *basin__worker(void *arg)
+{
+    Basin__Job *job = arg;
+    for (;;) {
+        size_t i = atomic_fetch_add_explicit(&job->next, BASIN_CHUNK, memory_order_relaxed);
+        if (i >= job->count) break;
+        size_t end = i + BASIN_CHUNK < job->count ? i + BASIN_CHUNK : job->count;
+        for (; i < end; ++i) job->step(job->b, i, job->arg);
+    }
+    if (job->b->thread_end != NULL) job->b->thread_end();
+    return NULL;
+}
+
+// Runs step for every i in [0, count) on b->threads threads, the caller included
+static void basin__parallel(Basin *b, size_t count, void (*step)(Basin *, size_t, void *), void *arg)
+{
+    Basin__Job job = {.b = b, .step = step, .arg = arg, .count = count};
+    size_t threads = b->threads > 0 ? b->threads : 1;
+    pthread_t *workers = malloc(threads*sizeof(pthread_t));
+    size_t started = 0;
+    while (workers != NULL && started + 1 < threads &&
+           pthread_create(&workers[started], NULL, basin__worker, &job) == 0) {
+        started++;
+    }
+    basin__worker(&job);
+    for (size_t i = 0; i < started; ++i) pthread_join(workers[i], NULL);
+    free(workers);
+}
+
+static uint64_t basin__hash(const uint8_t *tape, size_t tape_size)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < tape_size; ++i) h = (h ^ tape[i])*0x100000001B3ull;
+    return h ^ (h >> 29);
+}
+
+static bool basin__grow_slots(Basin *b)
+{
+    size_t capacity = b->slot_capacity > 0 ? b->slot_capacity*2 : 1 << 16;
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        nob_log(NOB_ERROR, "basin: could not allocate %zu hash slots", capacity);
+        return false;
+    }
+    for (size_t n = 0; n < b->node_count; ++n) {
+        size_t h = basin__hash(&b->tapes[n*b->tape_size], b->tape_size) & (capacity - 1);
+        while (slots[h] != 0) h = (h + 1) & (capacity - 1);
+        slots[h] = (uint32_t)n + 1;
+    }
+    free(b->slots);
+    b->slots = slots;
+    b->slot_capacity = capacity;
+    return true;
+}
+
+// Node of tape, appended as a new node if it isn't in the graph yet. UINT32_MAX when out of memory.
+static uint32_t basin__intern(Basin *b, const uint8_t *tape)
+{
+    if (2*(b->node_count + 1) > b->slot_capacity && !basin__grow_slots(b)) return UINT32_MAX;
+    size_t h = basin__hash(tape, b->tape_size) & (b->slot_capacity - 1);
+    for (; b->slots[h] != 0; h = (h + 1) & (b->slot_capacity - 1)) {
+        uint32_t n = b->slots[h] - 1;
+        if (memcmp(&b->tapes[(size_t)n*b->tape_size], tape, b->tape_size) == 0) return n;
+    }
+    if (b->node_count + 1 >= UINT32_MAX) {
+        nob_log(NOB_ERROR, "basin: more than %u nodes", UINT32_MAX - 1);
+        return UINT32_MAX;
+    }
+    if (b->node_count == b->node_capacity) {
+        size_t capacity = b->node_capacity > 0 ? b->node_capacity*2 : 1 << 16;
+        uint8_t *tapes = realloc(b->tapes, capacity*b->tape_size);
+        uint32_t *next = realloc(b->next, capacity*sizeof(uint32_t));
+        if (tapes != NULL) b->tapes = tapes;
+        if (next != NULL) b->next = next;
+        if (tapes == NULL || next == NULL) {
+            nob_log(NOB_ERROR, "basin: could not grow the graph to %zu nodes", capacity);
+            return UINT32_MAX;
+        }
+        b->node_capacity = capacity;
+    }
+    uint32_t n = (uint32_t)b->node_count++;
+    memcpy(&b->tapes[(size_t)n*b->tape_size], tape, b->tape_size);
+    b->slots[h] = n + 1;
+    return n;
+}
+
+typedef struct {
+    size_t first;
+    uint8_t *results;
+} Basin__Batch;
+
+static void basin__eval_step(Basin *b, size_t i, void *arg)
+{
+    Basin__Batch *batch = arg;
+    b->eval(&b->tapes[(batch->first + i)*b->tape_size], &batch->results[i*b->tape_size]);
+}
+
+bool basin_build(Basin *b, const uint8_t *starts, size_t start_count)
+{
+    for (size_t i = 0; i < start_count; ++i) {
+        if (basin__intern(b, &starts[i*b->tape_size]) == UINT32_MAX) return false;
+    }
+    b->start_count = b->node_count;
+    if (b->start_count != start_count) {
+        nob_log(NOB_ERROR, "basin: %zu of the start tapes are duplicates", start_count - b->start_count);
+        return false;
+    }
+    Basin__Batch batch = {.results = malloc(BASIN_BATCH*b->tape_size)};
+    if (batch.results == NULL) return false;
+    bool ok = true;
+    for (size_t done = 0; done < b->node_count && ok;) {
+        size_t count = b->node_count - done < BASIN_BATCH ? b->node_count - done : BASIN_BATCH;
+        batch.first = done;
+        basin__parallel(b, count, basin__eval_step, &batch);
+        for (size_t i = 0; i < count && ok; ++i) {
+            uint32_t n = basin__intern(b, &batch.results[i*b->tape_size]);
+            ok = n != UINT32_MAX;
+            b->next[done + i] = n;
+        }
+        done += count;
+    }
+    free(batch.results);
+    return ok;
+}
+
+typedef struct {
+    uint32_t *jump, *jump2;     // f^(2^k) before and after the round
+    uint32_t *min, *min2;       // smallest node within 2^k steps
+    uint32_t *to, *to2;         // tail ranking pointers
+    uint32_t *dist, *dist2;
+} Basin__Jump;
+
+static void basin__double_step(Basin *b, size_t x, void *arg)
+{
+    (void)b;
+    Basin__Jump *j = arg;
+    uint32_t y = j->jump[x];
+    j->jump2[x] = j->jump[y];
+    j->min2[x] = j->min[x] < j->min[y] ? j->min[x] : j->min[y];
+}
+
+static void basin__rank_step(Basin *b, size_t x, void *arg)
+{
+    (void)b;
+    Basin__Jump *j = arg;
+    uint32_t y = j->to[x];
+    j->dist2[x] = j->dist[x] + j->dist[y];
+    j->to2[x] = j->to[y];
+}
+
+#define basin__swap(a, b) do { uint32_t *t = (a); (a) = (b); (b) = t; } while (0)
+
+void basin_solve(Basin *b)
+{
+    size_t n = b->node_count;
+    size_t rounds = 1;
+    while (((size_t)1 << rounds) < n) rounds++;
+    Basin__Jump j = {0};
+    uint32_t **arrays[] = {&j.jump, &j.jump2, &j.min, &j.min2, &j.to, &j.to2, &j.dist, &j.dist2};
+    for (size_t i = 0; i < sizeof(arrays)/sizeof(arrays[0]); ++i) {
+        *arrays[i] = malloc(n*sizeof(uint32_t));
+        NOB_ASSERT(*arrays[i] != NULL && "Buy more RAM lol");
+    }
+
+    memcpy(j.jump, b->next, n*sizeof(uint32_t));
+    for (size_t x = 0; x < n; ++x) j.min[x] = (uint32_t)x;
+    for (size_t r = 0; r < rounds; ++r) {
+        basin__parallel(b, n, basin__double_step, &j);
+        basin__swap(j.jump, j.jump2);
+        basin__swap(j.min, j.min2);
+    }
+
+    // on_cycle borrows to2: every cycle node is the image of some node under f^(2^rounds)
+    uint32_t *on_cycle = j.to2;
+    memset(on_cycle, 0, n*sizeof(uint32_t));
+    for (size_t x = 0; x < n; ++x) on_cycle[j.jump[x]] = 1;
+    for (size_t x = 0; x < n; ++x) {
+        j.to[x] = on_cycle[x] ? (uint32_t)x : b->next[x];
+        j.dist[x] = on_cycle[x] ? 0 : 1;
+    }
+    for (size_t r = 0; r < rounds; ++r) {
+        basin__parallel(b, n, basin__rank_step, &j);
+        basin__swap(j.to, j.to2);
+        basin__swap(j.dist, j.dist2);
+    }
+
+    // j.to is the cycle node a tail enters, j.min of it the cycle id
+    b->tail = j.dist;
+    b->cycle = j.dist2;
+    b->cycle_length = j.jump2;
+    memset(b->cycle_length, 0, n*sizeof(uint32_t));
+    b->cycle_count = 0;
+    for (size_t x = 0; x < n; ++x) {
+        b->cycle[x] = j.min[j.to[x]];
+        if (b->tail[x] == 0) {
+            if (b->cycle_length[b->cycle[x]]++ == 0) b->cycle_count++;
+        }
+    }
+    for (size_t x = 0; x < n; ++x) {
+        if (b->cycle[x] != x) b->cycle_length[x] = b->cycle_length[b->cycle[x]];
+    }
+    free(j.jump);
+    free(j.min);
+    free(j.min2);
+    free(j.to);
+    free(j.to2);
+}
+
+bool basin_write(const Basin *b, const char *path, size_t alphabet, size_t start_length)
+{
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s: %s", tmp_path, strerror(errno));
+        return false;
+    }
+    Basin_Header header = {
+        .magic = BASIN_MAGIC,
+        .version = BASIN_VERSION,
+        .tape_size = b->tape_size,
+        .alphabet = alphabet,
+        .start_count = b->start_count,
+        .node_count = b->node_count,
+        .cycle_count = b->cycle_count,
+        .start_length = start_length,
+    };
+    size_t n = b->node_count;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(b->next, sizeof(uint32_t), n, f) == n &&
+              fwrite(b->tail, sizeof(uint32_t), n, f) == n &&
+              fwrite(b->cycle, sizeof(uint32_t), n, f) == n &&
+              fwrite(b->cycle_length, sizeof(uint32_t), n, f) == n &&
+              fwrite(&b->tapes[b->start_count*b->tape_size], b->tape_size, n - b->start_count, f) == n - b->start_count;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        nob_log(NOB_ERROR, "Could not write %s: %s", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void basin_free(Basin *b)
+{
+    free(b->tapes);
+    free(b->slots);
+    free(b->next);
+    free(b->tail);
+    free(b->cycle);
+    free(b->cycle_length);
+    memset(b, 0, sizeof(*b));
+}
+
+#endif // BASIN_IMPLEMENTATION
@@ -0,0 +1,426 @@
+// bench.h - micro-benchmarks for the evaluate_bfN kernels
+//
+// A driver builds a few fixed-seed corpora of initial tapes, hands every
+// kernel a callback that evaluates one tape and returns the number of
+// interpreter steps it took, and bench_run times full passes over the corpus
+// until a minimum duration is reached. Kernels that skip repeated laps or hit
+// a memo stand for more steps than they run, so the callback also reports the
+// steps it executed and the per step times are taken over those. Results are
+// logged and written as JSON so builds can be compared.
+//
+// For end-to-end runs a driver times each stage of its own pipeline with
+// bench_ticks, fills a Bench_Pipeline and gets experiments/sec per stage and
+// the peak RSS of the process. Where perf events are allowed it also counts
+// hardware cache misses per trajectory step.
+//
+// Include after nob.h. Define BENCH_IMPLEMENTATION in exactly one file.
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_MIN_SECONDS 0.5
+#define BENCH_CORPUS_SIZE 1024
+#define BENCH_SEED 0xB7F5EEDull
+#define BENCH_MAX_STAGES 8
+
+typedef struct {
+    const char *name;
+    size_t tape_size;
+    uint8_t *items;     // count tapes of tape_size bytes
+    size_t count;
+    size_t capacity;
+} Bench_Corpus;
+
+typedef struct {
+    const char *kernel;
+    const char *corpus;
+    size_t tapes;
+    uint64_t evaluations;
+    uint64_t steps;         // interpreter steps the evaluations stand for
+    uint64_t executed;      // of those actually run, the rest was skipped or memoized
+    double seconds;
+    uint64_t cycles;    // TSC cycles, 0 where there is no TSC
+} Bench_Result;
+
+typedef struct {
+    const char *driver;
+    double min_seconds;
+    Bench_Result *items;
+    size_t count;
+    size_t capacity;
+} Bench;
+
+typedef struct {
+    const char *name;
+    uint64_t ticks;     // summed over all threads
+} Bench_Stage;
+
+typedef struct {
+    const char *driver;
+    size_t experiments;
+    size_t threads;
+    uint64_t seed;
+    double seconds;             // wall clock
+    double ticks_per_second;
+    Bench_Stage stages[BENCH_MAX_STAGES];
+    size_t stage_count;
+    size_t peak_rss_kb;
+    uint64_t steps;             // evaluations along all trajectories
+    uint64_t cache_misses;      // BENCH_NO_COUNTER without perf events
+} Bench_Pipeline;
+
+#define BENCH_NO_COUNTER UINT64_MAX
+
+// Evaluates one tape, returns the number of instructions it stands for and
+// sets *executed to the ones it ran
+typedef size_t (*Bench_Eval)(void *ctx, const uint8_t *tape, size_t *executed);
+
+void bench_corpus_random(Bench_Corpus *c, size_t count, size_t tape_size, size_t alphabet_count, uint64_t seed);
+// Random tapes with nested jump pairs, so most of the time goes to loops and bracket scans
+void bench_corpus_loops(Bench_Corpus *c, size_t count, size_t tape_size, size_t alphabet_count,
+                        uint8_t jump_back, uint8_t jump_forward, uint64_t seed);
+// Random tapes without jump instructions, so every cell runs exactly once
+void bench_corpus_straight(Bench_Corpus *c, size_t count, size_t tape_size, size_t alphabet_count,
+                           uint8_t jump_back, uint8_t jump_forward, uint64_t seed);
+// Every tape of every trajectory in dir, up to max_count, spelled with alphabet
+bool bench_corpus_from_dir(Bench_Corpus *c, const char *dir, size_t max_count, size_t tape_size,
+                           const char **alphabet, size_t alphabet_count);
+void bench_corpus_free(Bench_Corpus *c);
+
+void bench_run(Bench *b, const char *kernel, const Bench_Corpus *c, Bench_Eval eval, void *ctx);
+bool bench_write_json(const Bench *b, const char *path);
+
+// TSC where there is one, nanoseconds otherwise. Calibrate against bench_seconds.
+uint64_t bench_ticks(void);
+double bench_seconds(void);
+size_t bench_peak_rss_kb(void);
+// Counts last level cache misses of the calling thread and every thread it
+// starts afterwards, returns -1 where perf events are not available
+int bench_cache_misses_start(void);
+// Stops and closes the counter, BENCH_NO_COUNTER for -1
+uint64_t bench_cache_misses_stop(int fd);
+void bench_pipeline_log(const Bench_Pipeline *p);
+bool bench_pipeline_write_json(const Bench_Pipeline *p, const char *path);
+
+#endif // BENCH_H_
+
+#ifdef BENCH_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench__cycles() __rdtsc()
+#else
+#define bench__cycles() 0
+#endif
+
+uint64_t bench_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static uint64_t bench__rng_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double bench__now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static uint8_t *bench__corpus_push(Bench_Corpus *c)
+{
+    if (c->count >= c->capacity) {
+        c->capacity = c->capacity == 0 ? 256 : c->capacity*2;
+        c->items = realloc(c->items, c->capacity*c->tape_size);
+        NOB_ASSERT(c->items != NULL && "Buy more RAM lol");
+    }
+    return &c->items[c->tape_size*c->count++];
+}
+
+void bench_corpus_random(Bench_Corpus *c, size_t count, size_t tape_size, size_t alphabet_count, uint64_t seed)
+{
+    c->name = "random";
+    c->tape_size = tape_size;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *tape = bench__corpus_push(c);
+        for (size_t j = 0; j < tape_size; ++j) tape[j] = bench__rng_next(&seed) % alphabet_count;
+    }
+}
+
+void bench_corpus_loops(Bench_Corpus *c, size_t count, size_t tape_size, size_t alphabet_count,
+                        uint8_t jump_back, uint8_t jump_forward, uint64_t seed)
+{
+    c->name = "loops";
+    c->tape_size = tape_size;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *tape = bench__corpus_push(c);
+        for (size_t j = 0; j < tape_size; ++j) tape[j] = bench__rng_next(&seed) % alphabet_count;
+        // one jump pair per 16 cells, each nested inside the previous one
+        size_t pairs = tape_size/16;
+        size_t lo = 0, hi = tape_size - 1;
+        for (size_t p = 0; p < pairs && hi > lo + 2; ++p) {
+            lo += 1 + bench__rng_next(&seed) % 4;
+            hi -= 1 + bench__rng_next(&seed) % 4;
+            if (hi <= lo) break;
+            tape[lo] = jump_forward;
+            tape[hi] = jump_back;
+        }
+    }
+}
+
+void bench_corpus_straight(Bench_Corpus *c, size_t count, size_t tape_size, size_t alphabet_count,
+                           uint8_t jump_back, uint8_t jump_forward, uint64_t seed)
+{
+    c->name = "straight";
+    c->tape_size = tape_size;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *tape = bench__corpus_push(c);
+        for (size_t j = 0; j < tape_size; ++j) {
+            do {
+                tape[j] = bench__rng_next(&seed) % alphabet_count;
+            } while (tape[j] == jump_back || tape[j] == jump_forward);
+        }
+    }
+}
+
+bool bench_corpus_from_dir(Bench_Corpus *c, const char *dir, size_t max_count, size_t tape_size,
+                           const char **alphabet, size_t alphabet_count)
+{
+    c->name = dir;
+    c->tape_size = tape_size;
+    if (nob_file_exists(dir) != 1) {
+        nob_log(NOB_WARNING, "No saved programs in %s, skipping that corpus", dir);
+        return false;
+    }
+    Nob_File_Paths children = {0};
+    if (!nob_read_entire_dir(dir, &children)) return false;
+
+    uint8_t lookup[256];
+    memset(lookup, 0xFF, sizeof(lookup));
+    for (size_t k = 0; k < alphabet_count; ++k) lookup[(uint8_t)alphabet[k][0]] = (uint8_t)k;
+
+    Nob_String_Builder sb = {0};
+    for (size_t i = 0; i < children.count && c->count < max_count; ++i) {
+        if (!nob_sv_end_with(nob_sv_from_cstr(children.items[i]), ".txt")) continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, children.items[i]);
+        sb.count = 0;
+        if (!nob_read_entire_file(path, &sb)) continue;
+        Nob_String_View content = nob_sv_from_parts(sb.items, sb.count);
+        while (content.count > 0 && c->count < max_count) {
+            Nob_String_View line = nob_sv_trim(nob_sv_chop_by_delim(&content, '\n'));
+            if (line.count != tape_size) continue;
+            uint8_t *tape = bench__corpus_push(c);
+            bool ok = true;
+            for (size_t j = 0; j < tape_size && ok; ++j) {
+                tape[j] = lookup[(uint8_t)line.data[j]];
+                ok = tape[j] != 0xFF;
+            }
+            if (!ok) c->count--;
+        }
+    }
+    nob_da_free(sb);
+    nob_da_free(children);
+    if (c->count == 0) {
+        nob_log(NOB_WARNING, "No %zu wide programs found in %s", tape_size, dir);
+        return false;
+    }
+    return true;
+}
+
+void bench_corpus_free(Bench_Corpus *c)
+{
+    free(c->items);
+    memset(c, 0, sizeof(*c));
+}
+
+void bench_run(Bench *b, const char *kernel, const Bench_Corpus *c, Bench_Eval eval, void *ctx)
+{
+    if (c->count == 0) return;
+    double min_seconds = b->min_seconds > 0 ? b->min_seconds : BENCH_MIN_SECONDS;
+    Bench_Result r = {.kernel = kernel, .corpus = c->name, .tapes = c->count};
+
+    // one untimed pass to warm caches and the allocator
+    size_t executed = 0;
+    for (size_t i = 0; i < c->count; ++i) eval(ctx, &c->items[i*c->tape_size], &executed);
+
+    double start = bench__now();
+    uint64_t cycles = bench__cycles();
+    do {
+        for (size_t i = 0; i < c->count; ++i) {
+            r.steps += eval(ctx, &c->items[i*c->tape_size], &executed);
+            r.executed += executed;
+        }
+        r.evaluations += c->count;
+        r.seconds = bench__now() - start;
+    } while (r.seconds < min_seconds);
+    r.cycles = bench__cycles() - cycles;
+
+    nob_log(NOB_INFO, "%-4s %-16s %8.2f ns/step %12.0f steps/s %10.0f evals/s %6.2f cycles/step %5.1f%% executed",
+            kernel, c->name,
+            r.executed ? r.seconds*1e9/r.executed : 0.0,
+            r.executed/r.seconds,
+            r.evaluations/r.seconds,
+            r.executed ? (double)r.cycles/r.executed : 0.0,
+            r.steps ? 100.0*r.executed/r.steps : 0.0);
+    nob_da_append(b, r);
+}
+
+bool bench_write_json(const Bench *b, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s", path);
+        return false;
+    }
+    fprintf(f, "{\"driver\":\"%s\",\"results\":[\n", b->driver);
+    for (size_t i = 0; i < b->count; ++i) {
+        const Bench_Result *r = &b->items[i];
+        fprintf(f, "  {\"kernel\":\"%s\",\"corpus\":\"%s\",\"tapes\":%zu,\"evaluations\":%zu,\"steps\":%zu,"
+                   "\"executed\":%zu,\"seconds\":%.6f,\"ns_per_step\":%.4f,\"steps_per_sec\":%.1f,\"evals_per_sec\":%.1f,"
+                   "\"cycles_per_instruction\":%.4f}%s\n",
+                r->kernel, r->corpus, r->tapes, (size_t)r->evaluations, (size_t)r->steps, (size_t)r->executed,
+                r->seconds,
+                r->executed ? r->seconds*1e9/r->executed : 0.0,
+                r->executed/r->seconds,
+                r->evaluations/r->seconds,
+                r->executed ? (double)r->cycles/r->executed : 0.0,
+                i + 1 < b->count ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+    nob_log(NOB_INFO, "wrote benchmark results to %s", path);
+    return true;
+}
+
+double bench_seconds(void)
+{
+    return bench__now();
+}
+
+size_t bench_peak_rss_kb(void)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    return (size_t)ru.ru_maxrss;    // kilobytes on Linux
+}
+
+int bench_cache_misses_start(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr = {0};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;           // threads add their counts when they exit
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        nob_log(NOB_WARNING, "bench: no cache miss counter: %s", strerror(errno));
+        return -1;
+    }
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+uint64_t bench_cache_misses_stop(int fd)
+{
+#ifdef __linux__
+    if (fd < 0) return BENCH_NO_COUNTER;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t count = BENCH_NO_COUNTER;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) count = BENCH_NO_COUNTER;
+    close(fd);
+    return count;
+#else
+    (void)fd;
+    return BENCH_NO_COUNTER;
+#endif
+}
+
+static double bench__stage_seconds(const Bench_Pipeline *p, size_t i)
+{
+    return p->ticks_per_second > 0 ? p->stages[i].ticks/p->ticks_per_second : 0.0;
+}
+
+void bench_pipeline_log(const Bench_Pipeline *p)
+{
+    double busy = 0;
+    for (size_t i = 0; i < p->stage_count; ++i) busy += bench__stage_seconds(p, i);
+    nob_log(NOB_INFO, "%zu experiments in %.3fs on %zu threads: %.1f exp/s, peak RSS %zu KiB",
+            p->experiments, p->seconds, p->threads, p->experiments/p->seconds, p->peak_rss_kb);
+    if (p->cache_misses != BENCH_NO_COUNTER && p->steps > 0) {
+        nob_log(NOB_INFO, "  %zu steps, %.2f cache misses per step", (size_t)p->steps, (double)p->cache_misses/p->steps);
+    }
+    for (size_t i = 0; i < p->stage_count; ++i) {
+        double seconds = bench__stage_seconds(p, i);
+        nob_log(NOB_INFO, "  %-10s %9.3fs thread time %5.1f%% %14.1f exp/s", p->stages[i].name, seconds,
+                busy > 0 ? 100.0*seconds/busy : 0.0, seconds > 0 ? p->experiments/seconds : 0.0);
+    }
+}
+
+bool bench_pipeline_write_json(const Bench_Pipeline *p, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s", path);
+        return false;
+    }
+    double busy = 0;
+    for (size_t i = 0; i < p->stage_count; ++i) busy += bench__stage_seconds(p, i);
+    fprintf(f, "{\"driver\":\"%s\",\"experiments\":%zu,\"threads\":%zu,\"seed\":%zu,\"seconds\":%.6f,"
+               "\"experiments_per_sec\":%.3f,\"peak_rss_kb\":%zu,\"steps\":%zu,",
+            p->driver, p->experiments, p->threads, (size_t)p->seed, p->seconds,
+            p->experiments/p->seconds, p->peak_rss_kb, (size_t)p->steps);
+    if (p->cache_misses != BENCH_NO_COUNTER) {
+        fprintf(f, "\"cache_misses\":%zu,\"cache_misses_per_step\":%.4f,", (size_t)p->cache_misses,
+                p->steps > 0 ? (double)p->cache_misses/p->steps : 0.0);
+    }
+    fprintf(f, "\"stages\":[\n");
+    for (size_t i = 0; i < p->stage_count; ++i) {
+        double seconds = bench__stage_seconds(p, i);
+        fprintf(f, "  {\"name\":\"%s\",\"seconds\":%.6f,\"share\":%.4f,\"experiments_per_sec\":%.3f}%s\n",
+                p->stages[i].name, seconds, busy > 0 ? seconds/busy : 0.0,
+                seconds > 0 ? p->experiments/seconds : 0.0,
+                i + 1 < p->stage_count ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+    nob_log(NOB_INFO, "wrote pipeline benchmark to %s", path);
+    return true;
+}
+
+#endif // BENCH_IMPLEMENTATION
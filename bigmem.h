@@ -0,0 +1,253 @@
+// bigmem.h - large per-thread blocks on huge pages, on the thread's NUMA node
+//
+// Blocks of at least BIGMEM_MIN bytes are mapped with mmap instead of taken
+// from malloc. By default the kernel is asked to back them with transparent
+// huge pages (MADV_HUGEPAGE), with BIGMEM_PAGES_HUGETLB they come from the
+// reserved hugetlbfs pool and fall back to transparent ones when it is empty.
+// Only blocks that got reserved pages are rounded up to a whole huge page,
+// they are remembered so bigmem_free unmaps the size that was mapped.
+// Either way a trajectory or table of a few MB is a handful of TLB entries
+// instead of a thousand.
+//
+// A thread that calls bigmem_bind_thread is pinned to the CPUs of one node
+// and every block it maps afterwards is bound to that node's memory before
+// anything touches it, so it never lands on the other socket because some
+// other thread happened to touch it first. Smaller blocks come from malloc,
+// which already keeps them in the thread's own arena.
+//
+// Linux only, elsewhere everything comes from malloc and binding does nothing.
+// Include after nob.h. Define BIGMEM_IMPLEMENTATION in exactly one file.
+
+#ifndef BIGMEM_H_
+#define BIGMEM_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BIGMEM_MIN (256*1024)
+#define BIGMEM_HUGE_PAGE (2*1024*1024)
+#define BIGMEM_ALIGN 64
+
+typedef enum {
+    BIGMEM_PAGES_THP,       // transparent huge pages where the kernel has them
+    BIGMEM_PAGES_HUGETLB,   // reserved huge pages, see /proc/sys/vm/nr_hugepages
+    BIGMEM_PAGES_SMALL,     // plain pages, for comparison
+} Bigmem_Pages;
+
+// Set before the first allocation
+extern Bigmem_Pages bigmem_pages;
+extern _Atomic size_t bigmem_maps, bigmem_hugetlb_maps, bigmem_bound_maps;
+
+// Zeroed, BIGMEM_ALIGN aligned. NULL when out of memory.
+void *bigmem_alloc(size_t bytes);
+// bytes as passed to bigmem_alloc
+void bigmem_free(void *p, size_t bytes);
+// Nodes the machine could have, 1 when it can't tell
+size_t bigmem_node_count(void);
+// Pins the calling thread to node and binds the blocks it maps from now on there
+bool bigmem_bind_thread(size_t node);
+
+#endif // BIGMEM_H_
+
+#ifdef BIGMEM_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BIGMEM__MAX_NODES 64
+#define BIGMEM__MAX_CPUS 1024
+
+Bigmem_Pages bigmem_pages = BIGMEM_PAGES_THP;
+_Atomic size_t bigmem_maps, bigmem_hugetlb_maps, bigmem_bound_maps;
+static _Thread_local long bigmem__node = -1;
+
+#ifdef __linux__
+
+// Size of a mapping that didn't come from the reserved pool
+static size_t bigmem__round(size_t bytes)
+{
+    size_t page = bytes >= BIGMEM_HUGE_PAGE ? BIGMEM_HUGE_PAGE : 4096;
+    return (bytes + page - 1)/page*page;
+}
+
+// Blocks on reserved huge pages with the size they were mapped with
+typedef struct {
+    void *p;
+    size_t size;
+} Bigmem__Map;
+
+static pthread_mutex_t bigmem__lock = PTHREAD_MUTEX_INITIALIZER;
+static Bigmem__Map *bigmem__huge;
+static size_t bigmem__huge_count, bigmem__huge_capacity;
+
+static bool bigmem__remember(void *p, size_t size)
+{
+    bool ok = true;
+    pthread_mutex_lock(&bigmem__lock);
+    if (bigmem__huge_count == bigmem__huge_capacity) {
+        size_t capacity = bigmem__huge_capacity > 0 ? bigmem__huge_capacity*2 : 16;
+        Bigmem__Map *maps = realloc(bigmem__huge, capacity*sizeof(Bigmem__Map));
+        if (maps != NULL) {
+            bigmem__huge = maps;
+            bigmem__huge_capacity = capacity;
+        }
+        ok = maps != NULL;
+    }
+    if (ok) bigmem__huge[bigmem__huge_count++] = (Bigmem__Map){p, size};
+    pthread_mutex_unlock(&bigmem__lock);
+    return ok;
+}
+
+// Size p was mapped with if it is on reserved huge pages, 0 otherwise
+static size_t bigmem__forget(void *p)
+{
+    size_t size = 0;
+    pthread_mutex_lock(&bigmem__lock);
+    for (size_t i = 0; i < bigmem__huge_count; ++i) {
+        if (bigmem__huge[i].p != p) continue;
+        size = bigmem__huge[i].size;
+        bigmem__huge[i] = bigmem__huge[--bigmem__huge_count];
+        break;
+    }
+    pthread_mutex_unlock(&bigmem__lock);
+    return size;
+}
+
+void *bigmem_alloc(size_t bytes)
+{
+    if (bytes < BIGMEM_MIN) {
+        size_t size = (bytes + BIGMEM_ALIGN - 1)/BIGMEM_ALIGN*BIGMEM_ALIGN;
+        void *p = aligned_alloc(BIGMEM_ALIGN, size > 0 ? size : BIGMEM_ALIGN);
+        if (p != NULL) memset(p, 0, size);
+        return p;
+    }
+    size_t size = bigmem__round(bytes);
+    void *p = MAP_FAILED;
+    if (bigmem_pages == BIGMEM_PAGES_HUGETLB) {
+        size_t huge = (bytes + BIGMEM_HUGE_PAGE - 1)/BIGMEM_HUGE_PAGE*BIGMEM_HUGE_PAGE;
+        p = mmap(NULL, huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED && !bigmem__remember(p, huge)) {
+            munmap(p, huge);
+            p = MAP_FAILED;
+        }
+        if (p != MAP_FAILED) {
+            size = huge;
+            atomic_fetch_add_explicit(&bigmem_hugetlb_maps, 1, memory_order_relaxed);
+        }
+    }
+    if (p == MAP_FAILED) p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    if (bigmem_pages != BIGMEM_PAGES_SMALL) madvise(p, size, MADV_HUGEPAGE);
+    if (bigmem__node >= 0) {
+        unsigned long mask = 1ul << bigmem__node;
+        // nothing touched the pages yet, so they are all placed by the policy
+        if (syscall(SYS_mbind, p, size, MPOL_BIND, &mask, BIGMEM__MAX_NODES + 1, 0) == 0) {
+            atomic_fetch_add_explicit(&bigmem_bound_maps, 1, memory_order_relaxed);
+        }
+    }
+    atomic_fetch_add_explicit(&bigmem_maps, 1, memory_order_relaxed);
+    return p;
+}
+
+void bigmem_free(void *p, size_t bytes)
+{
+    if (p == NULL) return;
+    if (bytes < BIGMEM_MIN) {
+        free(p);
+        return;
+    }
+    size_t size = bigmem_pages == BIGMEM_PAGES_HUGETLB ? bigmem__forget(p) : 0;
+    munmap(p, size > 0 ? size : bigmem__round(bytes));
+}
+
+// Last number of a sysfs list like "0-3,8-11" plus one, 0 when unreadable
+static size_t bigmem__read_list(const char *path, unsigned long *bits, size_t bit_count)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return 0;
+    size_t end = 0;
+    unsigned long lo, hi;
+    for (;;) {
+        if (fscanf(f, "%lu", &lo) != 1) break;
+        hi = lo;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%lu", &hi) != 1) break;
+            c = fgetc(f);
+        }
+        for (unsigned long i = lo; i <= hi && i < bit_count; ++i) {
+            if (bits != NULL) bits[i/(8*sizeof(long))] |= 1ul << (i%(8*sizeof(long)));
+        }
+        if (hi + 1 > end) end = hi + 1;
+        if (c != ',') break;
+    }
+    fclose(f);
+    return end;
+}
+
+size_t bigmem_node_count(void)
+{
+    size_t n = bigmem__read_list("/sys/devices/system/node/possible", NULL, 0);
+    if (n == 0) return 1;
+    return n < BIGMEM__MAX_NODES ? n : BIGMEM__MAX_NODES;
+}
+
+bool bigmem_bind_thread(size_t node)
+{
+    if (node >= BIGMEM__MAX_NODES) return false;
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist", node);
+    unsigned long cpus[BIGMEM__MAX_CPUS/(8*sizeof(long))] = {0};
+    if (bigmem__read_list(path, cpus, BIGMEM__MAX_CPUS) == 0) {
+        nob_log(NOB_WARNING, "bigmem: no CPUs listed for node %zu", node);
+        return false;
+    }
+    // pid 0 is the calling thread
+    if (syscall(SYS_sched_setaffinity, 0, sizeof(cpus), cpus) != 0) {
+        nob_log(NOB_WARNING, "bigmem: could not pin thread to node %zu", node);
+        return false;
+    }
+    bigmem__node = (long)node;
+    return true;
+}
+
+#else
+
+void *bigmem_alloc(size_t bytes)
+{
+    size_t size = (bytes + BIGMEM_ALIGN - 1)/BIGMEM_ALIGN*BIGMEM_ALIGN;
+    void *p = aligned_alloc(BIGMEM_ALIGN, size > 0 ? size : BIGMEM_ALIGN);
+    if (p != NULL) memset(p, 0, size);
+    return p;
+}
+
+void bigmem_free(void *p, size_t bytes)
+{
+    (void)bytes;
+    free(p);
+}
+
+size_t bigmem_node_count(void)
+{
+    return 1;
+}
+
+bool bigmem_bind_thread(size_t node)
+{
+    (void)node;
+    (void)bigmem__node;
+    return false;
+}
+
+#endif // __linux__
+
+#endif // BIGMEM_IMPLEMENTATION
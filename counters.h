@@ -0,0 +1,237 @@
+// counters.h - compile-time toggled instrumentation for the hot paths
+//
+// Build with -DCOUNTERS (./nob -counters ...) to turn it on. Without it every
+// macro below expands to nothing and the instrumented code is unchanged.
+//
+// Each thread bumps its own block of counters, blocks are linked into a global
+// list on first use and never freed, so totals survive the workers exiting.
+// Values are written with relaxed atomics by their single owner, the reporter
+// sums them with counters_report while the workers keep running.
+//
+// Timers count TSC ticks and are converted to seconds when reported.
+//
+// With COUNTERS on, NOB_REALLOC is redirected so every nob_da_append that grows
+// an array is counted. Include after nob.h. Define COUNTERS_IMPLEMENTATION in
+// exactly one file.
+
+#ifndef COUNTERS_H_
+#define COUNTERS_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+    COUNTER_SUM,
+    COUNTER_MAX,
+    COUNTER_TICKS,
+} Counter_Kind;
+
+#define COUNTERS_LIST \
+    X(C_EVALUATIONS,        "evaluations",          COUNTER_SUM)   \
+    X(C_STEPS,              "steps",                COUNTER_SUM)   \
+    X(C_BRACKET_SCANS,      "bracket_scans",        COUNTER_SUM)   \
+    X(C_BRACKET_DISTANCE,   "bracket_distance",     COUNTER_SUM)   \
+    X(C_REPEATS,            "repeats",              COUNTER_SUM)   \
+    X(C_REPEAT_SKIPPED,     "repeat_skipped_steps", COUNTER_SUM)   \
+    X(C_STRAIGHT_STEPS,     "straight_steps",       COUNTER_SUM)   \
+    X(C_MEMO_HITS,          "memo_hits",            COUNTER_SUM)   \
+    X(C_HASH_LOOKUPS,       "hash_lookups",         COUNTER_SUM)   \
+    X(C_HASH_PROBES,        "hash_probes",          COUNTER_SUM)   \
+    X(C_HASH_PROBE_MAX,     "hash_probe_max",       COUNTER_MAX)   \
+    X(C_HASH_FILL_MAX,      "hash_fill_max",        COUNTER_MAX)   \
+    X(C_HASH_SLOTS,         "hash_slots",           COUNTER_MAX)   \
+    X(C_HASH_GROWS,         "hash_grows",           COUNTER_SUM)   \
+    X(C_HASH_RESETS,        "hash_resets",          COUNTER_SUM)   \
+    X(C_HASH_RESET_BYTES,   "hash_reset_bytes",     COUNTER_SUM)   \
+    X(C_HIST_ADDS,          "hist_adds",            COUNTER_SUM)   \
+    X(C_HIST_EXEMPLARS,     "hist_exemplars",       COUNTER_SUM)   \
+    X(C_HIST2D_ADDS,        "hist2d_adds",          COUNTER_SUM)   \
+    X(C_DA_REALLOCS,        "da_reallocs",          COUNTER_SUM)   \
+    X(C_DA_REALLOC_BYTES,   "da_realloc_bytes",     COUNTER_SUM)   \
+    X(C_FILES_WRITTEN,      "files_written",        COUNTER_SUM)   \
+    X(C_BYTES_WRITTEN,      "bytes_written",        COUNTER_SUM)   \
+    X(T_EVALUATE,           "evaluate_seconds",     COUNTER_TICKS) \
+    X(T_HASH,               "hash_seconds",         COUNTER_TICKS) \
+    X(T_RESET,              "reset_seconds",        COUNTER_TICKS) \
+    X(T_WRITE,              "write_seconds",        COUNTER_TICKS)
+
+typedef enum {
+#define X(id, name, kind) id,
+    COUNTERS_LIST
+#undef X
+    COUNTERS_COUNT
+} Counter;
+
+#ifdef COUNTERS
+
+typedef struct Counters {
+    _Atomic uint64_t values[COUNTERS_COUNT];
+    struct Counters *next;
+} Counters;
+
+extern _Thread_local Counters *counters__local;
+Counters *counters__register(void);
+uint64_t counters__ticks(void);
+void *counters_realloc(void *ptr, size_t size);
+
+#define counters__get() (counters__local ? counters__local : counters__register())
+#define COUNTER_ADD(c, n) \
+    do { \
+        _Atomic uint64_t *counter__v = &counters__get()->values[(c)]; \
+        atomic_store_explicit(counter__v, atomic_load_explicit(counter__v, memory_order_relaxed) + (n), memory_order_relaxed); \
+    } while (0)
+#define COUNTER_MAX(c, n) \
+    do { \
+        _Atomic uint64_t *counter__v = &counters__get()->values[(c)]; \
+        uint64_t counter__n = (n); \
+        if (counter__n > atomic_load_explicit(counter__v, memory_order_relaxed)) \
+            atomic_store_explicit(counter__v, counter__n, memory_order_relaxed); \
+    } while (0)
+#define TIMER_BEGIN(t) uint64_t timer__##t = counters__ticks()
+#define TIMER_END(t) COUNTER_ADD((t), counters__ticks() - timer__##t)
+
+#undef NOB_REALLOC
+#define NOB_REALLOC counters_realloc
+
+#else
+
+// sizeof keeps variables that only feed a counter "used" without evaluating them
+#define COUNTER_ADD(c, n) ((void)sizeof(n))
+#define COUNTER_MAX(c, n) ((void)sizeof(n))
+#define TIMER_BEGIN(t) ((void)0)
+#define TIMER_END(t) ((void)0)
+
+#endif // COUNTERS
+
+// Sums all threads, logs the totals and appends them to stats as ,"counters":{...}.
+// stats may be NULL. Does nothing without COUNTERS.
+void counters_report(FILE *stats);
+
+#endif // COUNTERS_H_
+
+// hist.h includes this header too, only expand the implementation once
+#if defined(COUNTERS_IMPLEMENTATION) && !defined(COUNTERS_IMPLEMENTATION_)
+#define COUNTERS_IMPLEMENTATION_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef COUNTERS
+
+static const char *counters__names[COUNTERS_COUNT] = {
+#define X(id, name, kind) [id] = name,
+    COUNTERS_LIST
+#undef X
+};
+
+static const Counter_Kind counters__kinds[COUNTERS_COUNT] = {
+#define X(id, name, kind) [id] = kind,
+    COUNTERS_LIST
+#undef X
+};
+
+_Thread_local Counters *counters__local = NULL;
+static Counters *counters__all = NULL;
+static pthread_mutex_t counters__lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t counters__start_ticks = 0;
+static double counters__start_time = 0;
+
+static double counters__now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+uint64_t counters__ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+#endif
+}
+
+Counters *counters__register(void)
+{
+    Counters *c = calloc(1, sizeof(Counters));
+    NOB_ASSERT(c != NULL && "Buy more RAM lol");
+    pthread_mutex_lock(&counters__lock);
+    if (counters__all == NULL) {
+        counters__start_ticks = counters__ticks();
+        counters__start_time = counters__now();
+    }
+    c->next = counters__all;
+    counters__all = c;
+    pthread_mutex_unlock(&counters__lock);
+    counters__local = c;
+    return c;
+}
+
+void *counters_realloc(void *ptr, size_t size)
+{
+    COUNTER_ADD(C_DA_REALLOCS, 1);
+    COUNTER_ADD(C_DA_REALLOC_BYTES, size);
+    return realloc(ptr, size);
+}
+
+void counters_report(FILE *stats)
+{
+    uint64_t totals[COUNTERS_COUNT] = {0};
+    pthread_mutex_lock(&counters__lock);
+    for (Counters *c = counters__all; c != NULL; c = c->next) {
+        for (size_t i = 0; i < COUNTERS_COUNT; ++i) {
+            uint64_t v = atomic_load_explicit(&c->values[i], memory_order_relaxed);
+            if (counters__kinds[i] == COUNTER_MAX) {
+                if (v > totals[i]) totals[i] = v;
+            } else {
+                totals[i] += v;
+            }
+        }
+    }
+    double elapsed = counters__now() - counters__start_time;
+    double ticks_per_second = elapsed > 0 ? (counters__ticks() - counters__start_ticks)/elapsed : 0;
+    pthread_mutex_unlock(&counters__lock);
+
+    nob_log(NOB_INFO, "counters:");
+    if (stats) fprintf(stats, ",\"counters\":{");
+    for (size_t i = 0; i < COUNTERS_COUNT; ++i) {
+        if (counters__kinds[i] == COUNTER_TICKS) {
+            double seconds = ticks_per_second > 0 ? totals[i]/ticks_per_second : 0;
+            printf("%s: %.3f\n", counters__names[i], seconds);
+            if (stats) fprintf(stats, "%s\"%s\":%.6f", i ? "," : "", counters__names[i], seconds);
+        } else {
+            printf("%s: %zu\n", counters__names[i], (size_t)totals[i]);
+            if (stats) fprintf(stats, "%s\"%s\":%zu", i ? "," : "", counters__names[i], (size_t)totals[i]);
+        }
+    }
+    if (totals[C_HASH_SLOTS] > 0) {
+        printf("hash_load_max: %.6f\n", (double)totals[C_HASH_FILL_MAX]/totals[C_HASH_SLOTS]);
+    }
+    if (totals[C_HASH_LOOKUPS] > 0) {
+        printf("hash_probes_per_lookup: %.3f\n", (double)totals[C_HASH_PROBES]/totals[C_HASH_LOOKUPS]);
+    }
+    if (totals[C_BRACKET_SCANS] > 0) {
+        printf("bracket_distance_per_scan: %.3f\n", (double)totals[C_BRACKET_DISTANCE]/totals[C_BRACKET_SCANS]);
+    }
+    if (stats) fprintf(stats, "}");
+}
+
+#else
+
+void counters_report(FILE *stats)
+{
+    (void)stats;
+}
+
+#endif // COUNTERS
+
+#endif // COUNTERS_IMPLEMENTATION
@@ -0,0 +1,337 @@
+// cycles.h - registry of the distinct cycles experiments end in
+//
+// A cycle is found at whichever of its tapes the trajectory entered it, so
+// cycle_canonical picks one member to stand for all of them: the tape with the
+// smallest hash, ties broken by the tape bytes. Two experiments landed in the
+// same cycle exactly when their canonical tapes are equal.
+//
+// Every thread adds into its own shard, an open addressing table nobody else
+// writes, so a checkpoint can save a shard at the same experiment boundary as
+// the histograms. Every entry counts its hits and keeps the initial tape of the
+// lowest numbered experiment that reached it. Shards are merged by summing the
+// hits and keeping the lowest experiment, so the census doesn't depend on
+// thread scheduling or on how the run was split into shards.
+//
+// The running count of distinct cycles comes from a set of canonical hashes
+// split into CYCLES_STRIPES stripes, each behind its own mutex. It is only
+// touched when a shard sees a cycle for the first time.
+//
+// Include after nob.h. Define CYCLES_IMPLEMENTATION in exactly one file.
+
+#ifndef CYCLES_H_
+#define CYCLES_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CYCLES_STRIPES 64
+
+typedef struct {
+    uint64_t hash;              // of the canonical tape
+    uint64_t length;
+    uint64_t hits;
+    uint64_t first_experiment;
+    uint8_t tapes[];            // canonical tape, then the initial tape of first_experiment
+} Cycle_Entry;
+
+typedef struct {
+    uint8_t *entries;           // count entries of Cycle_Registry.entry_size bytes
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;            // entry + 1, 0 when empty
+    size_t slot_capacity;       // power of two
+} Cycle_Shard;
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t *hashes;           // canonical hashes seen by any shard, 0 when empty
+    size_t count;
+    size_t capacity;            // power of two
+} Cycle_Stripe;
+
+typedef struct {
+    size_t tape_size;
+    size_t entry_size;
+    size_t shard_count;
+    Cycle_Shard *shards;
+    Cycle_Stripe stripes[CYCLES_STRIPES];
+    _Atomic size_t distinct;
+} Cycle_Registry;
+
+bool cycles_init(Cycle_Registry *r, size_t shard_count, size_t tape_size);
+void cycles_free(Cycle_Registry *r);
+uint64_t cycles_hash(const uint8_t *tape, size_t tape_size);
+// Index of the canonical tape among length tapes that are stride bytes apart
+size_t cycle_canonical(const uint8_t *tapes, size_t stride, size_t length, size_t tape_size, uint64_t *hash);
+// Counts a hit on the cycle with this canonical tape, returns true the first time any shard sees it
+bool cycles_add(Cycle_Registry *r, size_t shard, const uint8_t *canonical, uint64_t hash, size_t length,
+                const uint8_t *init, uint64_t experiment);
+// CSV of all cycles of all shards, most hit first: hash,length,hits,first_experiment,cycle,first_init.
+// Call after the workers are done.
+bool cycles_write(Cycle_Registry *r, const char *path, const char **alphabet, size_t alphabet_count);
+// Checkpoints: appends the entries of one shard to sb, or reads them back into
+// an empty shard. Only call while no other thread adds to it.
+void cycles_shard_save(const Cycle_Registry *r, size_t shard, Nob_String_Builder *sb);
+bool cycles_shard_load(Cycle_Registry *r, size_t shard, Nob_String_View *sv);
+
+#endif // CYCLES_H_
+
+#ifdef CYCLES_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define cycles__entry(r, s, i) ((Cycle_Entry *)&(s)->entries[(size_t)(i)*(r)->entry_size])
+
+bool cycles_init(Cycle_Registry *r, size_t shard_count, size_t tape_size)
+{
+    memset(r, 0, sizeof(*r));
+    r->tape_size = tape_size;
+    r->entry_size = sizeof(Cycle_Entry) + 2*tape_size;
+    r->shard_count = shard_count > 0 ? shard_count : 1;
+    r->shards = calloc(r->shard_count, sizeof(Cycle_Shard));
+    if (r->shards == NULL) {
+        nob_log(NOB_ERROR, "Failed to allocate cycle registry!");
+        return false;
+    }
+    for (size_t i = 0; i < CYCLES_STRIPES; ++i) pthread_mutex_init(&r->stripes[i].lock, NULL);
+    return true;
+}
+
+static void cycles__shard_free(Cycle_Shard *s)
+{
+    free(s->entries);
+    free(s->slots);
+    memset(s, 0, sizeof(*s));
+}
+
+void cycles_free(Cycle_Registry *r)
+{
+    if (r->shards == NULL) return;
+    for (size_t i = 0; i < r->shard_count; ++i) cycles__shard_free(&r->shards[i]);
+    free(r->shards);
+    for (size_t i = 0; i < CYCLES_STRIPES; ++i) {
+        pthread_mutex_destroy(&r->stripes[i].lock);
+        free(r->stripes[i].hashes);
+    }
+    memset(r, 0, sizeof(*r));
+}
+
+uint64_t cycles_hash(const uint8_t *tape, size_t tape_size)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < tape_size; ++i) h = (h ^ tape[i])*0x100000001B3ull;
+    return h ^ (h >> 32);
+}
+
+size_t cycle_canonical(const uint8_t *tapes, size_t stride, size_t length, size_t tape_size, uint64_t *hash)
+{
+    size_t best = 0;
+    uint64_t best_hash = cycles_hash(tapes, tape_size);
+    for (size_t i = 1; i < length; ++i) {
+        uint64_t h = cycles_hash(&tapes[i*stride], tape_size);
+        if (h < best_hash || (h == best_hash && memcmp(&tapes[i*stride], &tapes[best*stride], tape_size) < 0)) {
+            best = i;
+            best_hash = h;
+        }
+    }
+    *hash = best_hash;
+    return best;
+}
+
+static bool cycles__grow(Cycle_Registry *r, Cycle_Shard *s)
+{
+    size_t capacity = s->slot_capacity > 0 ? s->slot_capacity*2 : 64;
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL) return false;
+    for (size_t i = 0; i < s->count; ++i) {
+        size_t h = cycles__entry(r, s, i)->hash & (capacity - 1);
+        while (slots[h] != 0) h = (h + 1) & (capacity - 1);
+        slots[h] = (uint32_t)i + 1;
+    }
+    free(s->slots);
+    s->slots = slots;
+    s->slot_capacity = capacity;
+    return true;
+}
+
+// Entry of the canonical tape in s, a new one with no hits when s hasn't seen it
+static Cycle_Entry *cycles__find(Cycle_Registry *r, Cycle_Shard *s, const uint8_t *canonical, uint64_t hash,
+                                 size_t length, bool *added)
+{
+    *added = false;
+    if (2*(s->count + 1) > s->slot_capacity && !cycles__grow(r, s)) return NULL;
+    size_t h = hash & (s->slot_capacity - 1);
+    for (; s->slots[h] != 0; h = (h + 1) & (s->slot_capacity - 1)) {
+        Cycle_Entry *e = cycles__entry(r, s, s->slots[h] - 1);
+        if (e->hash == hash && memcmp(e->tapes, canonical, r->tape_size) == 0) return e;
+    }
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity > 0 ? s->capacity*2 : 16;
+        uint8_t *entries = realloc(s->entries, capacity*r->entry_size);
+        if (entries == NULL) return NULL;
+        s->entries = entries;
+        s->capacity = capacity;
+    }
+    Cycle_Entry *e = cycles__entry(r, s, s->count);
+    s->slots[h] = (uint32_t)++s->count;
+    *e = (Cycle_Entry){.hash = hash, .length = length, .first_experiment = UINT64_MAX};
+    memcpy(e->tapes, canonical, r->tape_size);
+    *added = true;
+    return e;
+}
+
+// Folds hits that started at experiment with this initial tape into e
+static void cycles__hit(Cycle_Registry *r, Cycle_Entry *e, uint64_t hits, const uint8_t *init, uint64_t experiment)
+{
+    e->hits += hits;
+    if (experiment < e->first_experiment) {
+        e->first_experiment = experiment;
+        memcpy(&e->tapes[r->tape_size], init, r->tape_size);
+    }
+}
+
+// Adds hash to the set behind the distinct count, true when it is new
+static bool cycles__mark(Cycle_Registry *r, uint64_t hash)
+{
+    // low bits pick the slot, so the stripe comes from the high ones
+    Cycle_Stripe *s = &r->stripes[(hash >> 58) % CYCLES_STRIPES];
+    uint64_t key = hash != 0 ? hash : 1;
+    bool added = false;
+    pthread_mutex_lock(&s->lock);
+    if (2*(s->count + 1) > s->capacity) {
+        size_t capacity = s->capacity > 0 ? s->capacity*2 : 64;
+        uint64_t *hashes = calloc(capacity, sizeof(uint64_t));
+        if (hashes == NULL) {
+            pthread_mutex_unlock(&s->lock);
+            return false;
+        }
+        for (size_t i = 0; i < s->capacity; ++i) {
+            if (s->hashes[i] == 0) continue;
+            size_t h = s->hashes[i] & (capacity - 1);
+            while (hashes[h] != 0) h = (h + 1) & (capacity - 1);
+            hashes[h] = s->hashes[i];
+        }
+        free(s->hashes);
+        s->hashes = hashes;
+        s->capacity = capacity;
+    }
+    size_t h = key & (s->capacity - 1);
+    while (s->hashes[h] != 0 && s->hashes[h] != key) h = (h + 1) & (s->capacity - 1);
+    if (s->hashes[h] == 0) {
+        s->hashes[h] = key;
+        s->count++;
+        atomic_fetch_add_explicit(&r->distinct, 1, memory_order_relaxed);
+        added = true;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return added;
+}
+
+bool cycles_add(Cycle_Registry *r, size_t shard, const uint8_t *canonical, uint64_t hash, size_t length,
+                const uint8_t *init, uint64_t experiment)
+{
+    bool added;
+    Cycle_Entry *e = cycles__find(r, &r->shards[shard], canonical, hash, length, &added);
+    if (e == NULL) {
+        nob_log(NOB_ERROR, "cycles: out of memory, cycle not counted");
+        return false;
+    }
+    cycles__hit(r, e, 1, init, experiment);
+    return added && cycles__mark(r, hash);
+}
+
+static int cycles__compare_hits(const void *a, const void *b)
+{
+    const Cycle_Entry *ea = *(Cycle_Entry *const *)a, *eb = *(Cycle_Entry *const *)b;
+    if (ea->hits != eb->hits) return ea->hits < eb->hits ? 1 : -1;
+    if (ea->hash != eb->hash) return ea->hash < eb->hash ? -1 : 1;
+    return 0;
+}
+
+bool cycles_write(Cycle_Registry *r, const char *path, const char **alphabet, size_t alphabet_count)
+{
+    bool result = true;
+    Cycle_Shard merged = {0};
+    Cycle_Entry **sorted = NULL;
+    FILE *f = NULL;
+    for (size_t i = 0; i < r->shard_count; ++i) {
+        Cycle_Shard *s = &r->shards[i];
+        for (size_t j = 0; j < s->count; ++j) {
+            Cycle_Entry *src = cycles__entry(r, s, j);
+            bool added;
+            Cycle_Entry *dst = cycles__find(r, &merged, src->tapes, src->hash, src->length, &added);
+            if (dst == NULL) {
+                nob_log(NOB_ERROR, "cycles: out of memory while merging shards");
+                nob_return_defer(false);
+            }
+            cycles__hit(r, dst, src->hits, &src->tapes[r->tape_size], src->first_experiment);
+        }
+    }
+    sorted = malloc((merged.count > 0 ? merged.count : 1)*sizeof(Cycle_Entry *));
+    if (sorted == NULL) nob_return_defer(false);
+    for (size_t i = 0; i < merged.count; ++i) sorted[i] = cycles__entry(r, &merged, i);
+    qsort(sorted, merged.count, sizeof(sorted[0]), cycles__compare_hits);
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s: %s", path, strerror(errno));
+        nob_return_defer(false);
+    }
+    fprintf(f, "hash,length,hits,first_experiment,cycle,first_init\n");
+    for (size_t i = 0; i < merged.count; ++i) {
+        Cycle_Entry *e = sorted[i];
+        fprintf(f, "%016llx,%llu,%llu,%llu,", (unsigned long long)e->hash, (unsigned long long)e->length,
+                (unsigned long long)e->hits, (unsigned long long)e->first_experiment);
+        for (size_t t = 0; t < 2; ++t) {
+            for (size_t j = 0; j < r->tape_size; ++j) fputs(alphabet[e->tapes[t*r->tape_size + j] % alphabet_count], f);
+            fputc(t == 0 ? ',' : '\n', f);
+        }
+    }
+
+defer:
+    if (f != NULL && fclose(f) != 0) {
+        nob_log(NOB_ERROR, "Could not write %s", path);
+        result = false;
+    }
+    free(sorted);
+    cycles__shard_free(&merged);
+    return result;
+}
+
+void cycles_shard_save(const Cycle_Registry *r, size_t shard, Nob_String_Builder *sb)
+{
+    const Cycle_Shard *s = &r->shards[shard];
+    uint64_t n = s->count;
+    nob_sb_append_buf(sb, &n, sizeof(n));
+    nob_sb_append_buf(sb, s->entries, s->count*r->entry_size);
+}
+
+bool cycles_shard_load(Cycle_Registry *r, size_t shard, Nob_String_View *sv)
+{
+    uint64_t n = 0;
+    if (sv->count < sizeof(n)) return false;
+    memcpy(&n, sv->data, sizeof(n));
+    if ((sv->count - sizeof(n))/r->entry_size < n) return false;
+    const uint8_t *data = (const uint8_t *)sv->data + sizeof(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        Cycle_Entry saved;
+        const uint8_t *src = &data[i*r->entry_size];
+        memcpy(&saved, src, sizeof(saved));
+        const uint8_t *tapes = src + sizeof(Cycle_Entry);
+        bool added;
+        Cycle_Entry *e = cycles__find(r, &r->shards[shard], tapes, saved.hash, saved.length, &added);
+        if (e == NULL) return false;
+        cycles__hit(r, e, saved.hits, &tapes[r->tape_size], saved.first_experiment);
+        if (added) cycles__mark(r, saved.hash);
+    }
+    sv->data += sizeof(n) + n*r->entry_size;
+    sv->count -= sizeof(n) + n*r->entry_size;
+    return true;
+}
+
+#endif // CYCLES_IMPLEMENTATION
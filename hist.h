@@ -0,0 +1,623 @@
+// hist.h - histograms of cycle and sequence lengths shared by the drivers
+//
+// Counts live in a fixed, dense array of log-linear buckets: every value below
+// 2^HIST_EXACT_BITS has its own bucket, above that each power of two is split
+// into 2^HIST_SUB_BITS buckets. That is ~5k buckets for the whole 64 bit range
+// instead of one slot per possible length.
+//
+// Every thread adds into its own shard, so hist_add takes no locks. Counts are
+// written with relaxed atomics, so a reporter thread can call hist_snapshot
+// while the workers keep running.
+//
+// Instead of storing every program above the cutoff, each shard keeps a
+// bottom-k sample of at most `exemplars` initial tapes per bucket: the tapes
+// with the smallest priority. The caller derives the priority from the seed and
+// the experiment, so the merged sample is the same whichever shard ran what.
+//
+// Include after nob.h. Define HIST_IMPLEMENTATION in exactly one file.
+
+#ifndef HIST_H_
+#define HIST_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "counters.h"
+
+#define HIST_EXACT_BITS 11
+#define HIST_SUB_BITS 6
+#define HIST_BUCKETS ((1 << HIST_EXACT_BITS) + (64 - HIST_EXACT_BITS)*(1 << HIST_SUB_BITS))
+
+typedef struct {
+    uint64_t seen;      // candidates offered to this reservoir
+    uint32_t top;       // slot of the largest kept priority once the reservoir is full
+    uint64_t prios[];   // Hist.exemplars priorities, then as many tapes of Hist.tape_size bytes
+} Hist_Reservoir;
+
+typedef struct {
+    _Atomic uint64_t counts[HIST_BUCKETS];
+    Hist_Reservoir *reservoirs[HIST_BUCKETS];  // allocated on first exemplar
+} Hist_Shard;
+
+typedef struct {
+    const char *name;       // used in dumped file names, e.g. "cycle" or "seq"
+    size_t tape_size;
+    size_t cutoff;          // values below the cutoff keep no exemplars
+    size_t exemplars;       // reservoir size per bucket and shard
+    size_t shard_count;
+    Hist_Shard *shards;
+} Hist;
+
+bool hist_init(Hist *h, const char *name, size_t shard_count, size_t tape_size, size_t cutoff, size_t exemplars);
+void hist_free(Hist *h);
+
+size_t hist_bucket(uint64_t value);
+uint64_t hist_bucket_value(size_t bucket);  // smallest value that lands in bucket
+
+// prio orders the exemplars, the smallest ones are kept. It has to be a
+// random looking function of the experiment, not of the thread that ran it.
+void hist_add(Hist *h, size_t shard, uint64_t value, const uint8_t *tape, uint64_t prio);
+// Sums the shards into counts[HIST_BUCKETS], safe while other threads add
+void hist_snapshot(const Hist *h, uint64_t *counts);
+uint64_t hist_total(const Hist *h);
+void hist_print(const Hist *h);
+// Writes one file per bucket at or above the cutoff with at least min_count hits,
+// tapes are spelled with `alphabet`. Call after the workers are done.
+bool hist_dump_exemplars(Hist *h, const char *dir, size_t min_count, const char **alphabet, size_t alphabet_count);
+// Checkpoints: appends one shard (sparse counts and reservoirs) to sb, or
+// reads it back into an empty shard. Only call while no other thread adds to it.
+void hist_shard_save(const Hist *h, size_t shard, Nob_String_Builder *sb);
+bool hist_shard_load(Hist *h, size_t shard, Nob_String_View *sv);
+
+// Joint histogram of (ex_number, cycle_number), i.e. how long the tail into a
+// cycle was together with the cycle length (tail = ex_number + 1 - cycle_number).
+// Cells are sparse: each shard is an open addressing table that only holds the
+// pairs that were seen. Every cell keeps a bottom-k sample of initial tapes
+// (the k tapes with the smallest priority, as in hist_add), which stays a
+// uniform sample when shards are merged.
+typedef struct {
+    uint32_t ex_number;
+    uint32_t cycle_number;
+    uint64_t count;         // 0 marks an empty slot
+    size_t pool;            // offset of the cell's exemplars in the shard pool
+    size_t kept;
+} Hist2D_Cell;
+
+typedef struct {
+    Hist2D_Cell *cells;
+    size_t capacity;        // power of two
+    size_t count;
+    uint8_t *pool;          // per cell: exemplars priorities (u64) then exemplars tapes
+    size_t pool_count;
+    size_t pool_capacity;
+} Hist2D_Shard;
+
+typedef struct {
+    size_t tape_size;
+    size_t exemplars;
+    size_t shard_count;
+    Hist2D_Shard *shards;
+} Hist2D;
+
+#define HIST2D_MAGIC 0x32484642u // "BFH2"
+
+bool hist2d_init(Hist2D *h, size_t shard_count, size_t tape_size, size_t exemplars);
+void hist2d_free(Hist2D *h);
+void hist2d_add(Hist2D *h, size_t shard, size_t ex_number, size_t cycle_number, const uint8_t *tape, uint64_t prio);
+// Merges the shards and writes the cells with their exemplars to bin_path and a
+// `ex_number,cycle_number,tail,count` line per cell to csv_path. Call after the workers are done.
+bool hist2d_dump(Hist2D *h, const char *bin_path, const char *csv_path);
+void hist2d_shard_save(const Hist2D *h, size_t shard, Nob_String_Builder *sb);
+bool hist2d_shard_load(Hist2D *h, size_t shard, Nob_String_View *sv);
+
+#endif // HIST_H_
+
+#ifdef HIST_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define hist__tapes(h, r) ((uint8_t*)&(r)->prios[(h)->exemplars])
+
+bool hist_init(Hist *h, const char *name, size_t shard_count, size_t tape_size, size_t cutoff, size_t exemplars)
+{
+    memset(h, 0, sizeof(*h));
+    h->name = name;
+    h->tape_size = tape_size;
+    h->cutoff = cutoff;
+    h->exemplars = exemplars;
+    h->shard_count = shard_count > 0 ? shard_count : 1;
+    h->shards = calloc(h->shard_count, sizeof(Hist_Shard));
+    if (h->shards == NULL) {
+        nob_log(NOB_ERROR, "Failed to allocate histogram %s!", name);
+        return false;
+    }
+    return true;
+}
+
+void hist_free(Hist *h)
+{
+    if (h->shards == NULL) return;
+    for (size_t s = 0; s < h->shard_count; ++s) {
+        for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+            free(h->shards[s].reservoirs[b]);
+        }
+    }
+    free(h->shards);
+    h->shards = NULL;
+}
+
+size_t hist_bucket(uint64_t value)
+{
+    if (value < (1ull << HIST_EXACT_BITS)) return value;
+    size_t e = 63 - __builtin_clzll(value);
+    size_t sub = (value >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+    return (1 << HIST_EXACT_BITS) + (e - HIST_EXACT_BITS)*(1 << HIST_SUB_BITS) + sub;
+}
+
+uint64_t hist_bucket_value(size_t bucket)
+{
+    if (bucket < (1 << HIST_EXACT_BITS)) return bucket;
+    size_t e = HIST_EXACT_BITS + (bucket - (1 << HIST_EXACT_BITS)) / (1 << HIST_SUB_BITS);
+    size_t sub = (bucket - (1 << HIST_EXACT_BITS)) % (1 << HIST_SUB_BITS);
+    return ((uint64_t)(1 << HIST_SUB_BITS) + sub) << (e - HIST_SUB_BITS);
+}
+
+static Hist_Reservoir *hist__reservoir(const Hist *h)
+{
+    return calloc(1, sizeof(Hist_Reservoir) + h->exemplars*(sizeof(uint64_t) + h->tape_size));
+}
+
+void hist_add(Hist *h, size_t shard, uint64_t value, const uint8_t *tape, uint64_t prio)
+{
+    Hist_Shard *s = &h->shards[shard];
+    size_t b = hist_bucket(value);
+    // Only this shard's thread writes, a load and store is enough and avoids a locked add
+    atomic_store_explicit(&s->counts[b], atomic_load_explicit(&s->counts[b], memory_order_relaxed) + 1, memory_order_relaxed);
+    COUNTER_ADD(C_HIST_ADDS, 1);
+
+    if (tape == NULL || value < h->cutoff || h->exemplars == 0) return;
+    Hist_Reservoir *r = s->reservoirs[b];
+    if (r == NULL) {
+        r = hist__reservoir(h);
+        if (r == NULL) return;
+        s->reservoirs[b] = r;
+    }
+    size_t slot = r->seen++;
+    if (slot >= h->exemplars) {
+        if (prio >= r->prios[r->top]) return;
+        slot = r->top;
+    }
+    r->prios[slot] = prio;
+    memcpy(&hist__tapes(h, r)[slot*h->tape_size], tape, h->tape_size);
+    COUNTER_ADD(C_HIST_EXEMPLARS, 1);
+    if (r->seen >= h->exemplars) {
+        // only rescanned when a tape got in, which gets rarer the longer the run
+        r->top = 0;
+        for (uint32_t i = 1; i < h->exemplars; ++i) {
+            if (r->prios[i] > r->prios[r->top]) r->top = i;
+        }
+    }
+}
+
+void hist_snapshot(const Hist *h, uint64_t *counts)
+{
+    memset(counts, 0, sizeof(uint64_t)*HIST_BUCKETS);
+    for (size_t s = 0; s < h->shard_count; ++s) {
+        for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+            counts[b] += atomic_load_explicit(&h->shards[s].counts[b], memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t hist_total(const Hist *h)
+{
+    uint64_t total = 0;
+    for (size_t s = 0; s < h->shard_count; ++s) {
+        for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+            total += atomic_load_explicit(&h->shards[s].counts[b], memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+void hist_print(const Hist *h)
+{
+    uint64_t counts[HIST_BUCKETS];
+    hist_snapshot(h, counts);
+    for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+        if (counts[b] > 0) printf("%zu: %zu\n", (size_t)hist_bucket_value(b), (size_t)counts[b]);
+    }
+}
+
+typedef struct {
+    uint64_t prio;
+    const uint8_t *tape;
+} Hist__Pick;
+
+static int hist__compare_pick(const void *a, const void *b)
+{
+    const Hist__Pick *ap = a;
+    const Hist__Pick *bp = b;
+    return (ap->prio > bp->prio) - (ap->prio < bp->prio);
+}
+
+bool hist_dump_exemplars(Hist *h, const char *dir, size_t min_count, const char **alphabet, size_t alphabet_count)
+{
+    if (!nob_mkdir_if_not_exists(dir)) {
+        nob_log(NOB_ERROR, "Could not create directory %s", dir);
+        return false;
+    }
+    Hist__Pick *picks = malloc(sizeof(Hist__Pick)*h->shard_count*(h->exemplars + 1));
+    if (picks == NULL) return false;
+    uint64_t counts[HIST_BUCKETS];
+    hist_snapshot(h, counts);
+
+    for (size_t b = hist_bucket(h->cutoff); b < HIST_BUCKETS; ++b) {
+        if (counts[b] == 0 || counts[b] < min_count) continue;
+
+        // The smallest priorities of all shards are the smallest of the union,
+        // a uniform sample of the bucket however the experiments were split
+        size_t n = 0;
+        for (size_t s = 0; s < h->shard_count; ++s) {
+            Hist_Reservoir *r = h->shards[s].reservoirs[b];
+            if (r == NULL) continue;
+            size_t kept = r->seen < h->exemplars ? r->seen : h->exemplars;
+            for (size_t i = 0; i < kept; ++i) {
+                picks[n].prio = r->prios[i];
+                picks[n].tape = &hist__tapes(h, r)[i*h->tape_size];
+                n++;
+            }
+        }
+        if (n == 0) continue;
+        qsort(picks, n, sizeof(picks[0]), hist__compare_pick);
+        if (n > h->exemplars) n = h->exemplars;
+
+        char file_path[256];
+        snprintf(file_path, sizeof(file_path), "%s/%s-%zu-%zu.txt",
+                dir, h->name, (size_t)hist_bucket_value(b), (size_t)counts[b]);
+        FILE *file = fopen(file_path, "w");
+        if (file == NULL) {
+            nob_log(NOB_ERROR, "Could not create unique file name or open file %s", file_path);
+            free(picks);
+            return false;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < h->tape_size; ++j) {
+                fprintf(file, "%s", alphabet[picks[i].tape[j] % alphabet_count]);
+            }
+            fprintf(file, "\n");
+        }
+        COUNTER_ADD(C_FILES_WRITTEN, 1);
+        COUNTER_ADD(C_BYTES_WRITTEN, ftell(file));
+        fclose(file);
+    }
+    free(picks);
+    return true;
+}
+
+#define hist__save(sb, value) nob_sb_append_buf((sb), &(value), sizeof(value))
+
+static bool hist__load(Nob_String_View *sv, void *dst, size_t size)
+{
+    if (sv->count < size) return false;
+    memcpy(dst, sv->data, size);
+    sv->data += size;
+    sv->count -= size;
+    return true;
+}
+
+void hist_shard_save(const Hist *h, size_t shard, Nob_String_Builder *sb)
+{
+    const Hist_Shard *s = &h->shards[shard];
+    uint32_t n = 0, m = 0;
+    for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+        if (atomic_load_explicit(&s->counts[b], memory_order_relaxed) != 0) n++;
+        if (s->reservoirs[b] != NULL) m++;
+    }
+    hist__save(sb, n);
+    for (uint32_t b = 0; b < HIST_BUCKETS; ++b) {
+        uint64_t count = atomic_load_explicit(&s->counts[b], memory_order_relaxed);
+        if (count == 0) continue;
+        hist__save(sb, b);
+        hist__save(sb, count);
+    }
+    hist__save(sb, m);
+    for (uint32_t b = 0; b < HIST_BUCKETS; ++b) {
+        const Hist_Reservoir *r = s->reservoirs[b];
+        if (r == NULL) continue;
+        size_t kept = r->seen < h->exemplars ? r->seen : h->exemplars;
+        hist__save(sb, b);
+        hist__save(sb, r->seen);
+        nob_sb_append_buf(sb, r->prios, kept*sizeof(uint64_t));
+        nob_sb_append_buf(sb, hist__tapes(h, r), kept*h->tape_size);
+    }
+}
+
+bool hist_shard_load(Hist *h, size_t shard, Nob_String_View *sv)
+{
+    Hist_Shard *s = &h->shards[shard];
+    uint32_t n = 0, m = 0, b = 0;
+    if (!hist__load(sv, &n, sizeof(n))) return false;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint64_t count = 0;
+        if (!hist__load(sv, &b, sizeof(b)) || !hist__load(sv, &count, sizeof(count)) || b >= HIST_BUCKETS) return false;
+        atomic_store_explicit(&s->counts[b], count, memory_order_relaxed);
+    }
+    if (!hist__load(sv, &m, sizeof(m))) return false;
+    for (uint32_t i = 0; i < m; ++i) {
+        uint64_t seen = 0;
+        if (!hist__load(sv, &b, sizeof(b)) || !hist__load(sv, &seen, sizeof(seen)) || b >= HIST_BUCKETS) return false;
+        Hist_Reservoir *r = hist__reservoir(h);
+        if (r == NULL) return false;
+        free(s->reservoirs[b]);
+        s->reservoirs[b] = r;
+        r->seen = seen;
+        size_t kept = seen < h->exemplars ? seen : h->exemplars;
+        if (!hist__load(sv, r->prios, kept*sizeof(uint64_t))) return false;
+        if (!hist__load(sv, hist__tapes(h, r), kept*h->tape_size)) return false;
+        for (uint32_t k = 1; k < kept; ++k) {
+            if (r->prios[k] > r->prios[r->top]) r->top = k;
+        }
+    }
+    return true;
+}
+
+#define HIST2D__ENTRY(h) ((h)->exemplars*(sizeof(uint64_t) + (h)->tape_size))
+
+bool hist2d_init(Hist2D *h, size_t shard_count, size_t tape_size, size_t exemplars)
+{
+    memset(h, 0, sizeof(*h));
+    h->tape_size = tape_size;
+    h->exemplars = exemplars;
+    h->shard_count = shard_count > 0 ? shard_count : 1;
+    h->shards = calloc(h->shard_count, sizeof(Hist2D_Shard));
+    if (h->shards == NULL) {
+        nob_log(NOB_ERROR, "Failed to allocate joint histogram!");
+        return false;
+    }
+    return true;
+}
+
+static void hist2d__shard_free(Hist2D_Shard *s)
+{
+    free(s->cells);
+    free(s->pool);
+    memset(s, 0, sizeof(*s));
+}
+
+void hist2d_free(Hist2D *h)
+{
+    if (h->shards == NULL) return;
+    for (size_t s = 0; s < h->shard_count; ++s) hist2d__shard_free(&h->shards[s]);
+    free(h->shards);
+    h->shards = NULL;
+}
+
+static size_t hist2d__slot(const Hist2D_Shard *s, uint32_t ex_number, uint32_t cycle_number)
+{
+    uint64_t key = ((uint64_t)ex_number << 32) | cycle_number;
+    key *= 0x9E3779B97F4A7C15ull;
+    size_t i = (key >> 32) & (s->capacity - 1);
+    while (s->cells[i].count != 0 &&
+           (s->cells[i].ex_number != ex_number || s->cells[i].cycle_number != cycle_number)) {
+        i = (i + 1) & (s->capacity - 1);
+    }
+    return i;
+}
+
+static bool hist2d__grow(Hist2D_Shard *s)
+{
+    size_t capacity = s->capacity == 0 ? 1024 : s->capacity*2;
+    Hist2D_Cell *old = s->cells;
+    size_t old_capacity = s->capacity;
+    s->cells = calloc(capacity, sizeof(Hist2D_Cell));
+    if (s->cells == NULL) {
+        s->cells = old;
+        nob_log(NOB_ERROR, "Failed to grow joint histogram!");
+        return false;
+    }
+    s->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old[i].count == 0) continue;
+        s->cells[hist2d__slot(s, old[i].ex_number, old[i].cycle_number)] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static Hist2D_Cell *hist2d__cell(Hist2D *h, Hist2D_Shard *s, uint32_t ex_number, uint32_t cycle_number)
+{
+    if ((s->count + 1)*2 > s->capacity && !hist2d__grow(s)) return NULL;
+    Hist2D_Cell *c = &s->cells[hist2d__slot(s, ex_number, cycle_number)];
+    if (c->count != 0) return c;
+
+    size_t entry = HIST2D__ENTRY(h);
+    if (s->pool_count + entry > s->pool_capacity) {
+        size_t capacity = s->pool_capacity == 0 ? 64*entry : s->pool_capacity*2;
+        uint8_t *pool = realloc(s->pool, capacity);
+        if (pool == NULL) return NULL;
+        s->pool = pool;
+        s->pool_capacity = capacity;
+    }
+    c->ex_number = ex_number;
+    c->cycle_number = cycle_number;
+    c->pool = s->pool_count;
+    c->kept = 0;
+    s->pool_count += entry;
+    s->count++;
+    return c;
+}
+
+// Keeps the k lowest priorities seen so far
+static void hist2d__offer(Hist2D *h, Hist2D_Shard *s, Hist2D_Cell *c, uint64_t prio, const uint8_t *tape)
+{
+    if (h->exemplars == 0) return;
+    uint64_t *prios = (uint64_t*)&s->pool[c->pool];
+    uint8_t *tapes = &s->pool[c->pool + h->exemplars*sizeof(uint64_t)];
+    size_t slot = c->kept;
+    if (c->kept < h->exemplars) {
+        c->kept++;
+    } else {
+        slot = 0;
+        for (size_t i = 1; i < c->kept; ++i) {
+            if (prios[i] > prios[slot]) slot = i;
+        }
+        if (prio >= prios[slot]) return;
+    }
+    prios[slot] = prio;
+    memcpy(&tapes[slot*h->tape_size], tape, h->tape_size);
+}
+
+void hist2d_add(Hist2D *h, size_t shard, size_t ex_number, size_t cycle_number, const uint8_t *tape, uint64_t prio)
+{
+    Hist2D_Shard *s = &h->shards[shard];
+    Hist2D_Cell *c = hist2d__cell(h, s, ex_number > UINT32_MAX ? UINT32_MAX : ex_number,
+                                  cycle_number > UINT32_MAX ? UINT32_MAX : cycle_number);
+    if (c == NULL) return;
+    c->count++;
+    COUNTER_ADD(C_HIST2D_ADDS, 1);
+    if (tape != NULL) hist2d__offer(h, s, c, prio, tape);
+}
+
+static int hist2d__compare_cell(const void *a, const void *b)
+{
+    const Hist2D_Cell *ap = a;
+    const Hist2D_Cell *bp = b;
+    if (ap->cycle_number != bp->cycle_number) return ap->cycle_number < bp->cycle_number ? -1 : 1;
+    if (ap->ex_number != bp->ex_number) return ap->ex_number < bp->ex_number ? -1 : 1;
+    return 0;
+}
+
+bool hist2d_dump(Hist2D *h, const char *bin_path, const char *csv_path)
+{
+    bool result = true;
+    FILE *bin = NULL;
+    FILE *csv = NULL;
+    Hist2D_Cell *cells = NULL;
+    Hist2D_Shard merged = {0};
+
+    for (size_t s = 0; s < h->shard_count; ++s) {
+        Hist2D_Shard *shard = &h->shards[s];
+        for (size_t i = 0; i < shard->capacity; ++i) {
+            Hist2D_Cell *src = &shard->cells[i];
+            if (src->count == 0) continue;
+            Hist2D_Cell *dst = hist2d__cell(h, &merged, src->ex_number, src->cycle_number);
+            if (dst == NULL) nob_return_defer(false);
+            dst->count += src->count;
+            uint64_t *prios = (uint64_t*)&shard->pool[src->pool];
+            uint8_t *tapes = &shard->pool[src->pool + h->exemplars*sizeof(uint64_t)];
+            for (size_t k = 0; k < src->kept; ++k) {
+                hist2d__offer(h, &merged, dst, prios[k], &tapes[k*h->tape_size]);
+            }
+        }
+    }
+
+    // slots fill in the order the shards were merged, write them by priority instead
+    for (size_t i = 0; i < merged.capacity; ++i) {
+        Hist2D_Cell *c = &merged.cells[i];
+        if (c->count == 0) continue;
+        uint64_t *prios = (uint64_t*)&merged.pool[c->pool];
+        uint8_t *tapes = &merged.pool[c->pool + h->exemplars*sizeof(uint64_t)];
+        for (size_t k = 1; k < c->kept; ++k) {
+            for (size_t j = k; j > 0 && prios[j - 1] > prios[j]; --j) {
+                uint64_t prio = prios[j];
+                prios[j] = prios[j - 1];
+                prios[j - 1] = prio;
+                uint8_t tape[h->tape_size];
+                memcpy(tape, &tapes[j*h->tape_size], h->tape_size);
+                memcpy(&tapes[j*h->tape_size], &tapes[(j - 1)*h->tape_size], h->tape_size);
+                memcpy(&tapes[(j - 1)*h->tape_size], tape, h->tape_size);
+            }
+        }
+    }
+
+    cells = malloc(sizeof(Hist2D_Cell)*(merged.count + 1));
+    if (cells == NULL) nob_return_defer(false);
+    size_t n = 0;
+    for (size_t i = 0; i < merged.capacity; ++i) {
+        if (merged.cells[i].count != 0) cells[n++] = merged.cells[i];
+    }
+    qsort(cells, n, sizeof(cells[0]), hist2d__compare_cell);
+
+    bin = fopen(bin_path, "wb");
+    csv = fopen(csv_path, "w");
+    if (bin == NULL || csv == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s or %s", bin_path, csv_path);
+        nob_return_defer(false);
+    }
+    // Header: magic, tape size, exemplars per cell, cell count. Then per cell:
+    // ex_number u32, cycle_number u32, count u64, kept u32 and kept tapes.
+    uint32_t header[4] = {HIST2D_MAGIC, (uint32_t)h->tape_size, (uint32_t)h->exemplars, (uint32_t)n};
+    fwrite(header, sizeof(header), 1, bin);
+    fprintf(csv, "ex_number,cycle_number,tail,count\n");
+    for (size_t i = 0; i < n; ++i) {
+        Hist2D_Cell *c = &cells[i];
+        uint32_t kept = (uint32_t)c->kept;
+        fwrite(&c->ex_number, sizeof(uint32_t), 1, bin);
+        fwrite(&c->cycle_number, sizeof(uint32_t), 1, bin);
+        fwrite(&c->count, sizeof(uint64_t), 1, bin);
+        fwrite(&kept, sizeof(uint32_t), 1, bin);
+        fwrite(&merged.pool[c->pool + h->exemplars*sizeof(uint64_t)], h->tape_size, kept, bin);
+        if (c->cycle_number > 0) {
+            fprintf(csv, "%u,%u,%u,%zu\n", c->ex_number, c->cycle_number, c->ex_number + 1 - c->cycle_number, (size_t)c->count);
+        } else {
+            fprintf(csv, "%u,0,,%zu\n", c->ex_number, (size_t)c->count);
+        }
+    }
+    if (ferror(bin) || ferror(csv)) {
+        nob_log(NOB_ERROR, "Could not write joint histogram");
+        nob_return_defer(false);
+    }
+    COUNTER_ADD(C_FILES_WRITTEN, 2);
+    COUNTER_ADD(C_BYTES_WRITTEN, ftell(bin) + ftell(csv));
+
+defer:
+    if (bin) fclose(bin);
+    if (csv) fclose(csv);
+    free(cells);
+    hist2d__shard_free(&merged);
+    return result;
+}
+
+void hist2d_shard_save(const Hist2D *h, size_t shard, Nob_String_Builder *sb)
+{
+    const Hist2D_Shard *s = &h->shards[shard];
+    uint64_t n = s->count;
+    hist__save(sb, n);
+    for (size_t i = 0; i < s->capacity; ++i) {
+        const Hist2D_Cell *c = &s->cells[i];
+        if (c->count == 0) continue;
+        uint32_t kept = (uint32_t)c->kept;
+        hist__save(sb, c->ex_number);
+        hist__save(sb, c->cycle_number);
+        hist__save(sb, c->count);
+        hist__save(sb, kept);
+        nob_sb_append_buf(sb, &s->pool[c->pool], kept*sizeof(uint64_t));
+        nob_sb_append_buf(sb, &s->pool[c->pool + h->exemplars*sizeof(uint64_t)], kept*h->tape_size);
+    }
+}
+
+bool hist2d_shard_load(Hist2D *h, size_t shard, Nob_String_View *sv)
+{
+    Hist2D_Shard *s = &h->shards[shard];
+    uint64_t n = 0;
+    if (!hist__load(sv, &n, sizeof(n))) return false;
+    for (uint64_t i = 0; i < n; ++i) {
+        uint32_t ex_number = 0, cycle_number = 0, kept = 0;
+        uint64_t count = 0;
+        if (!hist__load(sv, &ex_number, sizeof(ex_number)) || !hist__load(sv, &cycle_number, sizeof(cycle_number)) ||
+            !hist__load(sv, &count, sizeof(count)) || !hist__load(sv, &kept, sizeof(kept)) || kept > h->exemplars) return false;
+        Hist2D_Cell *c = hist2d__cell(h, s, ex_number, cycle_number);
+        if (c == NULL) return false;
+        c->count = count;
+        c->kept = kept;
+        if (!hist__load(sv, &s->pool[c->pool], kept*sizeof(uint64_t))) return false;
+        if (!hist__load(sv, &s->pool[c->pool + h->exemplars*sizeof(uint64_t)], kept*h->tape_size)) return false;
+    }
+    return true;
+}
+
+#endif // HIST_IMPLEMENTATION
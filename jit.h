@@ -0,0 +1,313 @@
+// jit.h - x86-64 native code for hot bf6 tapes
+//
+// evaluate_bf6 never writes the tape it executes, so a tape always runs the
+// same instruction stream and can be compiled once. Every instruction becomes
+// a labelled block: a step limit check, the operation and either a fall
+// through to the next instruction or a conditional jump to the bracket the
+// interpreter's scan would land on. The scans depend only on the tape, so
+// they are resolved at compile time. Heads wrap with a mask, tape_size must be
+// a power of two.
+//
+// Compiled code is cached per thread by tape hash. A tape is interpreted until
+// it has been seen `hot` times, only then is it compiled, so tapes that come by
+// once never pay for compilation. When the code buffer or the table fills up
+// the whole cache is flushed.
+//
+// The code buffer is never writable and executable at once: the pages a
+// compile emits into are made writable for it and executable again after.
+//
+// bf7 fetches instructions from the tape it writes, so it is not compiled.
+//
+// Opcodes are numbered like the BF7 enum of main.c: o < > { } l r s p w m.
+// Include after nob.h. Define JIT_IMPLEMENTATION in exactly one file.
+
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JIT_SLOTS 4096
+#define JIT_CODE_SIZE (8 << 20)
+#define JIT_HOT 2
+
+typedef struct {
+    uint64_t hash;      // 0 marks an empty slot
+    uint32_t hits;
+    uint32_t code;      // offset of the compiled function + 1, 0 while cold
+} Jit_Entry;
+
+typedef struct {
+    size_t tape_size;
+    size_t max_steps;
+    size_t hot;             // evaluations before a tape is compiled
+
+    uint8_t *code;          // JIT_CODE_SIZE bytes, see jit__protect
+    size_t code_used;
+    Jit_Entry *entries;     // JIT_SLOTS
+    uint8_t *tapes;         // JIT_SLOTS*tape_size, the key of every entry
+    size_t used;
+    uint8_t tables[32];     // cell + 1 and cell - 1 modulo the alphabet
+
+    uint64_t lookups;
+    uint64_t runs;          // lookups that ran compiled code
+    uint64_t compiles;
+    uint64_t flushes;
+} Jit;
+
+// Fails where there is no x86-64 or no executable memory, callers keep interpreting
+bool jit_init(Jit *j, size_t tape_size, size_t max_steps, size_t alphabet);
+void jit_free(Jit *j);
+void jit_flush(Jit *j);
+// Runs src through compiled code into a zeroed dst and returns true, or
+// returns false while src is cold and the caller has to interpret it
+bool jit_run_bf6(Jit *j, const uint8_t *src, uint8_t *dst, size_t *steps);
+
+#endif // JIT_H_
+
+#ifdef JIT_IMPLEMENTATION
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+enum {
+    JIT__O, JIT__MRL, JIT__MRR, JIT__MWL, JIT__MWR, JIT__MIL, JIT__MIR, JIT__S, JIT__WP, JIT__WE, JIT__WM,
+    JIT__COUNT
+};
+
+// longest instruction block plus prologue and epilogue
+#define JIT__MAX_CODE(n) ((n)*32 + 64)
+
+typedef size_t (*Jit__Fn)(const uint8_t *src, uint8_t *dst, const uint8_t *tables);
+
+bool jit_init(Jit *j, size_t tape_size, size_t max_steps, size_t alphabet)
+{
+#if defined(__x86_64__)
+    memset(j, 0, sizeof(*j));
+    if (tape_size == 0 || (tape_size & (tape_size - 1)) != 0 || tape_size > 128 || alphabet > 16) {
+        nob_log(NOB_ERROR, "jit: tapes must be a power of two up to 128 cells with at most 16 opcodes");
+        return false;
+    }
+    j->tape_size = tape_size;
+    j->max_steps = max_steps;
+    j->hot = JIT_HOT;
+    j->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (j->code == MAP_FAILED) {
+        nob_log(NOB_ERROR, "jit: could not map the code buffer");
+        j->code = NULL;
+        return false;
+    }
+    j->entries = calloc(JIT_SLOTS, sizeof(Jit_Entry));
+    j->tapes = malloc(JIT_SLOTS*tape_size);
+    if (j->entries == NULL || j->tapes == NULL) {
+        jit_free(j);
+        return false;
+    }
+    for (size_t v = 0; v < 16; ++v) {
+        j->tables[v] = v < alphabet ? (v + 1)%alphabet : 0;
+        j->tables[16 + v] = v < alphabet ? (v + alphabet - 1)%alphabet : 0;
+    }
+    return true;
+#else
+    (void)j; (void)tape_size; (void)max_steps; (void)alphabet;
+    nob_log(NOB_ERROR, "jit: only x86-64 is supported");
+    return false;
+#endif
+}
+
+void jit_free(Jit *j)
+{
+    if (j->code != NULL) munmap(j->code, JIT_CODE_SIZE);
+    free(j->entries);
+    free(j->tapes);
+    memset(j, 0, sizeof(*j));
+}
+
+void jit_flush(Jit *j)
+{
+    memset(j->entries, 0, JIT_SLOTS*sizeof(Jit_Entry));
+    j->used = 0;
+    j->code_used = 0;
+    j->flushes++;
+}
+
+static uint64_t jit__hash(const uint8_t *tape, size_t n)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < n; ++i) h = (h ^ tape[i])*0x100000001B3ull;
+    return h | 1;
+}
+
+// Where the interpreter's bracket scan from i ends up
+static size_t jit__jump_target(const uint8_t *tape, size_t n, size_t i, bool back)
+{
+    int depth = 1;
+    size_t h = i;
+    while (depth > 0 && h < n && h > 0) {
+        if (back) {
+            h--;
+            if (tape[h] == JIT__MIL) depth++;
+            if (tape[h] == JIT__MIR) depth--;
+        } else {
+            h++;
+            if (h >= n) break;
+            if (tape[h] == JIT__MIR) depth++;
+            if (tape[h] == JIT__MIL) depth--;
+        }
+    }
+    return h;
+}
+
+#define jit__emit(p, ...) \
+    do { \
+        const uint8_t jit__bytes[] = {__VA_ARGS__}; \
+        memcpy((p), jit__bytes, sizeof(jit__bytes)); \
+        (p) += sizeof(jit__bytes); \
+    } while (0)
+
+static void jit__emit32(uint8_t **p, uint32_t v)
+{
+    memcpy(*p, &v, 4);
+    *p += 4;
+}
+
+// Registers: rdi src, rsi dst, r10 tables, r8 read head, r9 write head, rax steps, rcx scratch
+// Sets the pages around code[from, to) to prot, the buffer stays W^X as long as
+// only jit__compile asks for PROT_WRITE and hands them back as PROT_EXEC
+static bool jit__protect(Jit *j, size_t from, size_t to, int prot)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t lo = from & ~(page - 1);
+    size_t hi = (to + page - 1) & ~(page - 1);
+    if (hi > JIT_CODE_SIZE) hi = JIT_CODE_SIZE;
+    return mprotect(j->code + lo, hi - lo, prot) == 0;
+}
+
+static bool jit__compile(Jit *j, const uint8_t *tape, uint32_t *offset)
+{
+    size_t n = j->tape_size;
+    uint8_t mask = n - 1;
+    for (size_t i = 0; i < n; ++i) {
+        if (tape[i] >= JIT__COUNT) return false;
+    }
+    // this thread is the only one running the buffer, nothing executes it while it is writable
+    if (!jit__protect(j, j->code_used, j->code_used + JIT__MAX_CODE(n), PROT_READ | PROT_WRITE)) return false;
+    uint8_t *start = j->code + j->code_used;
+    uint8_t *p = start;
+    uint8_t *labels[129];           // label n is the exit
+    uint8_t *fixups[128];           // rel32 of the jump at instruction i, NULL if there is none
+    size_t targets[128];
+
+    jit__emit(p, 0x49, 0x89, 0xD2);                 // mov r10, rdx
+    jit__emit(p, 0x31, 0xC0);                       // xor eax, eax
+    jit__emit(p, 0x45, 0x31, 0xC0);                 // xor r8d, r8d
+    jit__emit(p, 0x45, 0x31, 0xC9);                 // xor r9d, r9d
+    uint8_t *limit_fixups[128];
+    for (size_t i = 0; i < n; ++i) {
+        labels[i] = p;
+        fixups[i] = NULL;
+        jit__emit(p, 0x48, 0x3D);                   // cmp rax, max_steps
+        jit__emit32(&p, j->max_steps);
+        jit__emit(p, 0x0F, 0x83);                   // jae exit
+        limit_fixups[i] = p;
+        jit__emit32(&p, 0);
+        switch (tape[i]) {
+            case JIT__O: break;
+            case JIT__MRL: jit__emit(p, 0x49, 0x83, 0xC0, mask, 0x49, 0x83, 0xE0, mask); break; // add r8, n-1; and r8, mask
+            case JIT__MRR: jit__emit(p, 0x49, 0x83, 0xC0, 0x01, 0x49, 0x83, 0xE0, mask); break; // add r8, 1; and r8, mask
+            case JIT__MWL: jit__emit(p, 0x49, 0x83, 0xC1, mask, 0x49, 0x83, 0xE1, mask); break; // add r9, n-1; and r9, mask
+            case JIT__MWR: jit__emit(p, 0x49, 0x83, 0xC1, 0x01, 0x49, 0x83, 0xE1, mask); break; // add r9, 1; and r9, mask
+            case JIT__S:   jit__emit(p, 0x4D, 0x87, 0xC8); break;                               // xchg r8, r9
+            case JIT__WE:
+                jit__emit(p, 0x42, 0x0F, 0xB6, 0x0C, 0x07);             // movzx ecx, byte [rdi + r8]
+                jit__emit(p, 0x42, 0x88, 0x0C, 0x0E);                   // mov [rsi + r9], cl
+                break;
+            case JIT__WP:
+                jit__emit(p, 0x42, 0x0F, 0xB6, 0x0C, 0x07);             // movzx ecx, byte [rdi + r8]
+                jit__emit(p, 0x41, 0x0F, 0xB6, 0x0C, 0x0A);             // movzx ecx, byte [r10 + rcx]
+                jit__emit(p, 0x42, 0x88, 0x0C, 0x0E);                   // mov [rsi + r9], cl
+                break;
+            case JIT__WM:
+                jit__emit(p, 0x42, 0x0F, 0xB6, 0x0C, 0x07);             // movzx ecx, byte [rdi + r8]
+                jit__emit(p, 0x41, 0x0F, 0xB6, 0x4C, 0x0A, 0x10);       // movzx ecx, byte [r10 + rcx + 16]
+                jit__emit(p, 0x42, 0x88, 0x0C, 0x0E);                   // mov [rsi + r9], cl
+                break;
+            case JIT__MIL:
+            case JIT__MIR:
+                jit__emit(p, 0x48, 0xFF, 0xC0);                         // inc rax
+                jit__emit(p, 0x42, 0x0F, 0xB6, 0x0C, 0x07);             // movzx ecx, byte [rdi + r8]
+                jit__emit(p, 0x85, 0xC9);                               // test ecx, ecx
+                // l jumps back while the cell is set, r jumps ahead while it is zero
+                if (tape[i] == JIT__MIL) jit__emit(p, 0x0F, 0x85);      // jnz target
+                else jit__emit(p, 0x0F, 0x84);                          // jz target
+                fixups[i] = p;
+                targets[i] = jit__jump_target(tape, n, i, tape[i] == JIT__MIL);
+                jit__emit32(&p, 0);
+                continue;
+        }
+        jit__emit(p, 0x48, 0xFF, 0xC0);                 // inc rax
+    }
+    labels[n] = p;
+    jit__emit(p, 0xC3);                                 // ret
+
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t *exit = labels[n];
+        int32_t rel = exit - (limit_fixups[i] + 4);
+        memcpy(limit_fixups[i], &rel, 4);
+        if (fixups[i] != NULL) {
+            rel = labels[targets[i] < n ? targets[i] : n] - (fixups[i] + 4);
+            memcpy(fixups[i], &rel, 4);
+        }
+    }
+    if (!jit__protect(j, j->code_used, j->code_used + JIT__MAX_CODE(n), PROT_READ | PROT_EXEC)) {
+        // earlier code on these pages is not executable anymore
+        jit_flush(j);
+        return false;
+    }
+    *offset = start - j->code;
+    j->code_used = (p - j->code + 15) & ~(size_t)15;
+    j->compiles++;
+    return true;
+}
+
+bool jit_run_bf6(Jit *j, const uint8_t *src, uint8_t *dst, size_t *steps)
+{
+    size_t n = j->tape_size;
+    uint64_t h = jit__hash(src, n);
+    size_t slot = h%JIT_SLOTS;
+    j->lookups++;
+    while (j->entries[slot].hash != 0 &&
+           (j->entries[slot].hash != h || memcmp(&j->tapes[slot*n], src, n) != 0)) {
+        slot = (slot + 1)%JIT_SLOTS;
+    }
+    Jit_Entry *e = &j->entries[slot];
+    if (e->hash == 0) {
+        if (j->used >= JIT_SLOTS*3/4) {
+            jit_flush(j);
+            return jit_run_bf6(j, src, dst, steps);
+        }
+        e->hash = h;
+        memcpy(&j->tapes[slot*n], src, n);
+        j->used++;
+    }
+    if (e->code == 0) {
+        if (++e->hits < j->hot) return false;
+        if (j->code_used + JIT__MAX_CODE(n) > JIT_CODE_SIZE) {
+            jit_flush(j);
+            return jit_run_bf6(j, src, dst, steps);
+        }
+        uint32_t offset;
+        // opcodes outside the alphabet stay with the interpreter
+        if (!jit__compile(j, src, &offset)) return false;
+        e->code = offset + 1;
+    }
+    Jit__Fn fn = (Jit__Fn)(j->code + e->code - 1);
+    *steps = fn(src, dst, j->tables);
+    j->runs++;
+    return true;
+}
+
+#endif // JIT_IMPLEMENTATION
@@ -1,4 +1,6 @@
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -6,10 +8,40 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #define NOB_IMPLEMENTATION
 #include "nob.h"
+#define COUNTERS_IMPLEMENTATION
+#include "counters.h"
 #define ARENA_IMPLEMENTATION
 #include "arena.h"
+#define HIST_IMPLEMENTATION
+#include "hist.h"
+#define REPORT_IMPLEMENTATION
+#include "report.h"
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#define PROFILE_IMPLEMENTATION
+#include "profile.h"
+#define JIT_IMPLEMENTATION
+#include "jit.h"
+#define BIGMEM_IMPLEMENTATION
+#include "bigmem.h"
+#define REPEAT_IMPLEMENTATION
+#define REPEAT_ALLOC(bytes) bigmem_alloc(bytes)
+#define REPEAT_FREE(p, bytes) bigmem_free((p), (bytes))
+#include "repeat.h"
+#define MEMO_IMPLEMENTATION
+#include "memo.h"
+#define BASIN_IMPLEMENTATION
+#include "basin.h"
+#define CYCLES_IMPLEMENTATION
+#include "cycles.h"
+#define SWISS_IMPLEMENTATION
+#define SWISS_ALLOC(bytes) bigmem_alloc(bytes)
+#define SWISS_FREE(p, bytes) bigmem_free((p), (bytes))
+#include "swiss.h"
 
 
 static Arena static_arena = {0};
@@ -21,6 +53,58 @@ static Arena *context_arena = &static_arena;
 
 #define MAX_TAPE_SIZE 64
 #define MAX_INST_COUNT 25600
+#define BENCH_MEMO_MB 64
+
+// Instructions executed by the last evaluate_bfN call on this thread
+static _Thread_local size_t eval_steps = 0;
+// Of those the ones that actually ran, skipped laps and memo hits don't
+static _Thread_local size_t eval_executed = 0;
+
+// Longest run of w instructions in the last evaluate_bf6 call on this thread
+// that copied consecutive source cells to consecutive result cells
+typedef struct {
+    size_t length;
+    size_t from;    // first source cell of the run
+    size_t to;      // first result cell of the run
+} Copy_Run;
+static _Thread_local Copy_Run eval_copy = {0};
+
+// -jit: evaluate_bf6 runs hot tapes as native code, every evaluating thread has its own cache.
+// Compiled code runs every lap of a loop, so it needs -norepeat.
+static bool use_jit = false;
+static _Thread_local Jit *eval_jit = NULL;
+static _Atomic u64 jit_lookups, jit_runs, jit_compiles, jit_flushes;
+
+// evaluate_bf6 skips whole laps of a loop once its head state repeats, -norepeat turns it off
+static bool use_repeat = true;
+static _Thread_local Repeat eval_repeat = {0};
+
+// evaluate_bf6 runs the jump-free start of a tape without the interpreter, -nostraight turns it off
+static bool use_straight = true;
+
+// -memo: results of evaluate_bf6 keyed by the source cells it read, shared by all threads
+typedef struct {
+    u8 tape[MAX_TAPE_SIZE];
+    uint32_t steps;
+    u8 copy_length, copy_from, copy_to;
+} Memo_Result;
+static Memo *eval_memo = NULL;
+
+// Source cells in order of their first read, while evaluate_bf6 records a memo miss
+typedef struct {
+    u64 seen;
+    u8 cells[MAX_TAPE_SIZE];
+    size_t count;
+} Read_Trace;
+static_assert(MAX_TAPE_SIZE <= 64, "Read_Trace.seen has a bit per cell");
+static _Thread_local Read_Trace eval_trace;
+#define TRACE_READ(trace, i) \
+    do { \
+        if ((trace) != NULL && (i) < MAX_TAPE_SIZE && !((trace)->seen >> (i) & 1)) { \
+            (trace)->seen |= 1ull << (i); \
+            (trace)->cells[(trace)->count++] = (i); \
+        } \
+    } while (0)
 
 typedef struct {
     u8 tape[MAX_TAPE_SIZE];
@@ -33,6 +117,49 @@ typedef struct {
     size_t capacity;
 } Programs;
 
+// The tapes of one search trajectory, columns instead of Programs: every tape
+// fills exactly one cache line of a 64 byte aligned block and the step
+// numbers sit in a compact column of their own.
+typedef struct {
+    u8 (*tapes)[MAX_TAPE_SIZE];
+    uint32_t *ex_numbers;
+    size_t count;
+    size_t capacity;
+} Trajectory;
+
+_Static_assert(MAX_TAPE_SIZE % BIGMEM_ALIGN == 0, "trajectory tapes must start on a cache line");
+
+void trajectory_free(Trajectory *t) {
+    bigmem_free(t->tapes, t->capacity*MAX_TAPE_SIZE);
+    bigmem_free(t->ex_numbers, t->capacity*sizeof(uint32_t));
+    memset(t, 0, sizeof(*t));
+}
+
+// Returns the index of the appended tape
+size_t trajectory_push(Trajectory *t, const u8 *tape, size_t ex_number) {
+    if (t->count == t->capacity) {
+        // bigmem blocks are BIGMEM_ALIGN aligned, long trajectories get huge pages
+        size_t capacity = t->capacity > 0 ? t->capacity*2 : 256;
+        u8 (*tapes)[MAX_TAPE_SIZE] = bigmem_alloc(capacity*MAX_TAPE_SIZE);
+        uint32_t *ex_numbers = bigmem_alloc(capacity*sizeof(uint32_t));
+        NOB_ASSERT(tapes != NULL && ex_numbers != NULL && "Buy more RAM lol");
+        if (t->count > 0) {
+            memcpy(tapes, t->tapes, t->count*MAX_TAPE_SIZE);
+            memcpy(ex_numbers, t->ex_numbers, t->count*sizeof(uint32_t));
+        }
+        size_t count = t->count;
+        trajectory_free(t);
+        t->tapes = tapes;
+        t->ex_numbers = ex_numbers;
+        t->count = count;
+        t->capacity = capacity;
+    }
+    memcpy(t->tapes[t->count], tape, MAX_TAPE_SIZE);
+    t->ex_numbers[t->count] = (uint32_t)ex_number;
+    return t->count++;
+}
+
+
 typedef enum {
     O,
     MRL,
@@ -130,57 +257,17 @@ void print_programs(Programs list) {
 Hash Table implementations
 */
 
-typedef struct {
-    size_t program_index;
-    bool occupied;
-} PKV;
-
-typedef struct {
-    PKV *items;
-    size_t count;
-    size_t capacity;
-}PKVs;
-
-
-// we should allocate these da in an arena.
-typedef struct {
-    Program *items;     //  array of Programs with their tape data, can be NULL 
-    bool occupied;
-    size_t counter;     // cycle or sequence length
-    size_t count;
-    size_t capacity;
-} HIST_DATA ; // Program Sequence Length
-
-typedef enum {
-    PCL,
-    PSL,
-} HIST_KIND;
-
-// we should allocate tisbn da in an arena.
-typedef struct {
-    HIST_DATA *items;
-    size_t count;
-    size_t capacity;
-    HIST_KIND as;
-} HIST; // Histogram
-
-
-#define hash_init(ht, cap) \
-    do { \
-            (ht)->items = malloc(sizeof(*(ht)->items)*(cap)); \
-            if ((ht)->items) { \
-                memset((ht)->items, 0, sizeof((*(ht)->items))*(cap)); \
-                (ht)->capacity = (cap); \
-                (ht)->count = 0; \
-            } else { \
-                nob_log(NOB_ERROR, "Failed to allocate new hash table!"); \
-            } \
-    } while(0)
+// Tapes seen along a trajectory: a swiss.h table of trajectory indices that
+// starts small, grows with the trajectory and shrinks back on reset
+#define TAPE_SET_SLOTS 1024
 
 #define hash_reset(ht) \
 do { \
-    memset((ht)->items, 0, sizeof(*(ht)->items)*((ht)->capacity)); \
-    (ht)->count = 0; \
+    TIMER_BEGIN(T_RESET); \
+    COUNTER_ADD(C_HASH_RESETS, 1); \
+    COUNTER_ADD(C_HASH_RESET_BYTES, (ht)->capacity); \
+    swiss_reset(ht); \
+    TIMER_END(T_RESET); \
 } while(0)
     
 uint64_t hash(u8 *buf, size_t buf_size) {
@@ -201,61 +288,38 @@ bool tape_eq(u8 *a, u8* b) {
     return cond;    
 }
 
-// for sorting da
-int compare_ex_nr(const void *a, const void *b) {
-    const Program *ap = a;
-    const Program *bp = b;
-    return (int)ap->ex_number - (int)bp->ex_number;
+typedef struct {
+    Trajectory *trajectory;
+    const u8 *tape;
+} Tape_Key;
+
+static bool tape_key_eq(const void *ctx, uint32_t value) {
+    const Tape_Key *k = ctx;
+    return memcmp(k->trajectory->tapes[value], k->tape, MAX_TAPE_SIZE) == 0;
 }
 
-size_t add_to_hash(PKVs *ht,Programs *programs, size_t program_index) {
-    Program *p = &programs->items[program_index];
-    u64 h = hash((u8*)p->tape, MAX_TAPE_SIZE)%ht->capacity;
-    
-    for (size_t i = 0; i < ht->capacity && ht->items[h].occupied && !tape_eq(programs->items[ht->items[h].program_index].tape, p->tape); ++i){
-        h = (h+1)%ht->capacity;
-    }
-    if (ht->items[h].occupied) {
-        if(!(tape_eq(programs->items[ht->items[h].program_index].tape, p->tape))) {
-            nob_log(NOB_ERROR, "Table overflow, increase table slot number!");
-            return 0;
-        }
-        size_t cycle_number = p->ex_number - programs->items[ht->items[h].program_index].ex_number;
-        // nob_log(NOB_INFO,"Cycle detected with size: %zu, after %zu program executions", cycle_number, program->ex_number);
-        return cycle_number; 
-    } else {
-        ht->items[h].occupied = true;
-        ht->items[h].program_index =  program_index;
-        ht->count++;
-    }
+// Returns the distance to the earlier step the tape was seen at, 0 when it is new
+size_t add_to_hash(Swiss *ht, Trajectory *t, size_t program_index) {
+    Tape_Key key = {t, t->tapes[program_index]};
+    // djb2 barely mixes its low bits, the table picks groups with them
+    uint32_t h = (uint32_t)((hash(t->tapes[program_index], MAX_TAPE_SIZE)*0x9E3779B97F4A7C15ull) >> 32);
+    uint32_t seen = swiss_insert(ht, h, (uint32_t)program_index, tape_key_eq, &key);
+    COUNTER_ADD(C_HASH_LOOKUPS, 1);
+    COUNTER_ADD(C_HASH_PROBES, ht->groups - 1);
+    COUNTER_MAX(C_HASH_PROBE_MAX, ht->groups - 1);
+    COUNTER_ADD(C_HASH_GROWS, ht->grew);
+    if (seen != SWISS_NONE) return t->ex_numbers[program_index] - t->ex_numbers[seen];
+    COUNTER_MAX(C_HASH_FILL_MAX, ht->count);
+    COUNTER_MAX(C_HASH_SLOTS, ht->capacity);
     return 0;
 }
 
-#define add_to_hist(da, idx, cutoff, prog)  \
-    do { \
-        size_t index_to_add = (idx); \
-        (da)->items[idx].occupied = true; \
-        (da)->items[idx].counter++; \
-        if (index_to_add >= cutoff) { \
-            Program newProg = {0}; \
-            memcpy(newProg.tape, prog.tape, MAX_TAPE_SIZE * sizeof(u8)); \
-            nob_da_append((&(da)->items[idx]), newProg); \
-        } \
-        break; \
-    } while(0)
-    
-#define print_histo(da) \
-    do { \
-        for (size_t i = 1; i < (da).capacity; ++i) { \
-            if ((da).items[i].occupied == true) { \
-                printf("%zu: %zu\n", i, (da).items[i].counter);\
-            }    \
-        } \
-    } while(0)
+// Root of everything a run writes, -o. Shard processes each get their own.
+static const char *output_dir = ".";
 
 bool write_programs_to_file(Programs *programs, size_t ex_number, size_t cycle_number, BFL bf) {
     char dir_path[200];
-        snprintf(dir_path, sizeof(dir_path), "./%s_programs", _bfl_str[bf]);
+        snprintf(dir_path, sizeof(dir_path), "%s/%s_programs", output_dir, _bfl_str[bf]);
         if (!nob_mkdir_if_not_exists(dir_path)) {
             nob_log(NOB_ERROR, "Could not create directory %s", dir_path);
             return false;
@@ -289,6 +353,7 @@ bool write_programs_to_file(Programs *programs, size_t ex_number, size_t cycle_n
         nob_log(NOB_ERROR, "Could not create unique file name or open file %s", file_path);
         return false;
     }
+    TIMER_BEGIN(T_WRITE);
     for (size_t i = 0; i < programs->count; ++i) {
         Program *program = &programs->items[i];
         for (int j = 0; j < MAX_TAPE_SIZE; j++) {
@@ -297,10 +362,46 @@ bool write_programs_to_file(Programs *programs, size_t ex_number, size_t cycle_n
         }
         fprintf(file, "\n");
     }
+    COUNTER_ADD(C_FILES_WRITTEN, 1);
+    COUNTER_ADD(C_BYTES_WRITTEN, ftell(file));
     fclose(file);
+    TIMER_END(T_WRITE);
     return true;
 }
 
+// Copies the record trajectories of a shard process into our own programs dir
+bool merge_records(const char *shard_dir, BFL bf) {
+    const char *src_dir = nob_temp_sprintf("%s/%s_programs", shard_dir, _bfl_str[bf]);
+    if (nob_file_exists(src_dir) != 1) return true;
+    char dst_dir[200];
+    snprintf(dst_dir, sizeof(dst_dir), "%s/%s_programs", output_dir, _bfl_str[bf]);
+    if (!nob_mkdir_if_not_exists(dst_dir)) return false;
+    
+    Nob_File_Paths children = {0};
+    if (!nob_read_entire_dir(src_dir, &children)) return false;
+    bool ok = true;
+    for (size_t i = 0; i < children.count; ++i) {
+        Nob_String_View name = nob_sv_from_cstr(children.items[i]);
+        if (!nob_sv_end_with(name, ".txt")) continue;
+        name.count -= 4;
+        char src_path[400], dst_path[400];
+        snprintf(src_path, sizeof(src_path), "%s/%s", src_dir, children.items[i]);
+        // two shards can hit the same record, same discriminator as write_programs_to_file
+        int discriminator = 0;
+        do {
+            if (discriminator == 0) {
+                snprintf(dst_path, sizeof(dst_path), "%s/"SV_Fmt".txt", dst_dir, SV_Arg(name));
+            } else {
+                snprintf(dst_path, sizeof(dst_path), "%s/"SV_Fmt"_%d.txt", dst_dir, SV_Arg(name), discriminator);
+            }
+            discriminator++;
+        } while (nob_file_exists(dst_path) == 1 && discriminator < 1000);
+        ok = nob_copy_file(src_path, dst_path) && ok;
+    }
+    nob_da_free(children);
+    return ok;
+}
+
 bool flag_int(int *argc, char ***argv, size_t *value)
 {
     const char *flag = nob_shift(*argv, *argc);
@@ -312,6 +413,75 @@ bool flag_int(int *argc, char ***argv, size_t *value)
     return true;
 }
 
+// Extends the copy run when a w copies the cells right after it, tracks the longest in eval_copy
+static inline void copy_extend(Copy_Run *copy, size_t read_head, size_t write_head) {
+    if (copy->length > 0 && read_head == (copy->from + copy->length) % MAX_TAPE_SIZE &&
+        write_head == (copy->to + copy->length) % MAX_TAPE_SIZE && copy->length < MAX_TAPE_SIZE) {
+        copy->length++;
+    } else {
+        *copy = (Copy_Run){1, read_head, write_head};
+    }
+    if (copy->length > eval_copy.length) eval_copy = *copy;
+}
+
+/*
+Straight-line start of bf6 tapes
+
+Up to the first l or r every cell runs exactly once in order, and where the heads
+are only depends on the instructions. straight_length finds that prefix,
+straight_run executes it from tables instead of the switch: moves are added to
+heads[swapped] (read) or heads[!swapped] (write), s flips swapped, and
+instructions that don't write store into a spare cell past the tape.
+*/
+
+typedef struct {
+    u8 read_move;   // added to the read head mod MAX_TAPE_SIZE
+    u8 write_move;
+    u8 swap;
+    u8 write;
+    u8 delta;       // added to the read cell mod COUNT
+} Straight_Op;
+
+static const Straight_Op straight_ops[COUNT] = {
+    [MRL] = {.read_move = MAX_TAPE_SIZE - 1},
+    [MRR] = {.read_move = 1},
+    [MWL] = {.write_move = MAX_TAPE_SIZE - 1},
+    [MWR] = {.write_move = 1},
+    [S]   = {.swap = 1},
+    [WP]  = {.write = 1, .delta = 1},
+    [WE]  = {.write = 1},
+    [WM]  = {.write = 1, .delta = COUNT - 1},
+};
+
+// Cells before the first jump, or before an invalid one the interpreter has to report
+size_t straight_length(const u8 *tape) {
+    size_t i = 0;
+    while (i < MAX_TAPE_SIZE && tape[i] != MIL && tape[i] != MIR && tape[i] < COUNT) i++;
+    return i;
+}
+
+// Runs the first n cells of source into result, leaves the heads and copy run where the interpreter would
+void straight_run(const u8 *source, u8 *result, size_t n, size_t *read_head, size_t *write_head, Copy_Run *copy, Read_Trace *trace) {
+    u8 out[MAX_TAPE_SIZE + 1];
+    memcpy(out, result, MAX_TAPE_SIZE);
+    size_t heads[2] = {*read_head, *write_head};
+    size_t swapped = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const Straight_Op *op = &straight_ops[source[i]];
+        size_t r = (heads[swapped] + op->read_move) % MAX_TAPE_SIZE;
+        size_t w = (heads[swapped ^ 1] + op->write_move) % MAX_TAPE_SIZE;
+        out[op->write ? w : MAX_TAPE_SIZE] = (source[r] + op->delta) % COUNT;
+        if (op->write) TRACE_READ(trace, r);
+        if (source[i] == WE) copy_extend(copy, r, w);
+        heads[swapped] = r;
+        heads[swapped ^ 1] = w;
+        swapped ^= op->swap;
+    }
+    memcpy(result, out, MAX_TAPE_SIZE);
+    *read_head = heads[swapped];
+    *write_head = heads[swapped ^ 1];
+}
+
 Program *evaluate_bf6(Programs *programs, Program *source) {
     if (source == NULL) {
         return NULL;
@@ -321,12 +491,66 @@ Program *evaluate_bf6(Programs *programs, Program *source) {
     size_t ins_head = 0;    // Instruction pointer for source program
     
     size_t ins_count = 0;
+    TIMER_BEGIN(T_EVALUATE);
+    Copy_Run copy = {0};    // run the last w extended
+    eval_copy = copy;
     
     Program result = {0};
     result.ex_number = source->ex_number + 1;
+    Read_Trace *trace = NULL;
+    if (eval_memo != NULL) {
+        Memo_Result m;
+        if (memo_find(eval_memo, source->tape, &m)) {
+            memcpy(result.tape, m.tape, MAX_TAPE_SIZE);
+            eval_steps = m.steps;
+            eval_executed = 0;
+            eval_copy = (Copy_Run){m.copy_length, m.copy_from, m.copy_to};
+            COUNTER_ADD(C_EVALUATIONS, 1);
+            COUNTER_ADD(C_STEPS, m.steps);
+            COUNTER_ADD(C_MEMO_HITS, 1);
+            TIMER_END(T_EVALUATE);
+            nob_da_append(programs, result);
+            return &programs->items[programs->count-1];
+        }
+        trace = &eval_trace;
+        trace->seen = 0;
+        trace->count = 0;
+    }
+    if (eval_jit != NULL && jit_run_bf6(eval_jit, source->tape, result.tape, &ins_count)) {
+        eval_steps = eval_executed = ins_count;
+        COUNTER_ADD(C_EVALUATIONS, 1);
+        COUNTER_ADD(C_STEPS, ins_count);
+        TIMER_END(T_EVALUATE);
+        nob_da_append(programs, result);
+        return &programs->items[programs->count-1];
+    }
+    // profiled runs see every op in the interpreter
+#ifndef PROFILE
+    if (use_straight) {
+        size_t n = straight_length(source->tape);
+        for (size_t i = 0; i <= n; ++i) TRACE_READ(trace, i);
+        straight_run(source->tape, result.tape, n, &read_head, &write_head, &copy, trace);
+        ins_head = n;
+        ins_count = n;
+        COUNTER_ADD(C_STRAIGHT_STEPS, n);
+    }
+#endif
+    PROFILE_BEGIN(prof);
+    // Writes only depend on the read-only source, so once (ins_head, read_head,
+    // write_head) repeats, every lap of the loop does the same writes. A loop has to
+    // pass a step that doesn't advance ins_head, heads are recorded there. The first
+    // repeat gives the lap length, the lap after it has to end with the same copy run
+    // too, then the remaining whole laps are skipped and the last partial lap is run.
+    bool repeat = use_repeat;
+    size_t lap = 0, lap_end = 0, skipped = 0;
+    u64 lap_state = 0;
+    Copy_Run lap_copy = {0};
+    if (repeat) repeat_begin(&eval_repeat);
     //memcpy(result.tape, source->tape, MAX_TAPE_SIZE * sizeof(u8));
     while (ins_count < MAX_INST_COUNT) {
         if (ins_head >= MAX_TAPE_SIZE) break;
+        size_t prev_ins_head = ins_head;
+        TRACE_READ(trace, ins_head);
         BF7 instruction = source->tape[ins_head];
         if (instruction >= COUNT ){
             nob_log(NOB_ERROR, "IMPOSSIBLE INSTRUCTION %d at %d", instruction, ins_head);
@@ -336,6 +560,7 @@ Program *evaluate_bf6(Programs *programs, Program *source) {
             print_program_u8(&result);
             exit(1);
         }
+        PROFILE_OP(prof, instruction, read_head, write_head);
 
         switch (instruction) {
             case O:{
@@ -363,27 +588,41 @@ Program *evaluate_bf6(Programs *programs, Program *source) {
                 break; 
             }                             
             case MIL:{
+                TRACE_READ(trace, read_head);
                 if (source->tape[read_head] != 0) {
                     int bracket_count = 1;
+                    size_t scan_start = ins_head;
                     while (bracket_count > 0 && ins_head < MAX_TAPE_SIZE && ins_head > 0) {
                         ins_head--;
+                        TRACE_READ(trace, ins_head);
                         if (source->tape[ins_head] == MIL) bracket_count++;
                         if (source->tape[ins_head] == MIR) bracket_count--;
                     }
+                    COUNTER_ADD(C_BRACKET_SCANS, 1);
+                    COUNTER_ADD(C_BRACKET_DISTANCE, scan_start - ins_head);
+                    PROFILE_BRANCH(prof, MIL, true, scan_start - ins_head);
                 } else {
+                    PROFILE_BRANCH(prof, MIL, false, 0);
                     ins_head = (ins_head + 1);
                 }
                 break;
             }
             case MIR:{
+                TRACE_READ(trace, read_head);
                 if (source->tape[read_head] == 0) {
                     int bracket_count = 1;
+                    size_t scan_start = ins_head;
                     while (bracket_count > 0 && ins_head < MAX_TAPE_SIZE && ins_head > 0) {
                         ins_head++;
+                        TRACE_READ(trace, ins_head);
                         if (source->tape[ins_head] == MIR) bracket_count++;
                         if (source->tape[ins_head] == MIL) bracket_count--;
                     }
+                    COUNTER_ADD(C_BRACKET_SCANS, 1);
+                    COUNTER_ADD(C_BRACKET_DISTANCE, ins_head - scan_start);
+                    PROFILE_BRANCH(prof, MIR, true, ins_head - scan_start);
                 } else {
+                    PROFILE_BRANCH(prof, MIR, false, 0);
                     ins_head = (ins_head + 1);
                 }
                 break;
@@ -396,16 +635,20 @@ Program *evaluate_bf6(Programs *programs, Program *source) {
                 break;
             }            
             case WP:{
+                TRACE_READ(trace, read_head);
                 result.tape[write_head] = (source->tape[read_head] + 1) % COUNT;
                 ins_head = (ins_head + 1);
                 break; 
             }  
             case WE: {
+                TRACE_READ(trace, read_head);
                 result.tape[write_head] = source->tape[read_head];
+                copy_extend(&copy, read_head, write_head);
                 ins_head = (ins_head + 1);
                 break;
             }                
             case WM:{
+                TRACE_READ(trace, read_head);
                 result.tape[write_head] = (source->tape[read_head] + COUNT - 1) % COUNT;
                 ins_head = (ins_head + 1);
                 break; 
@@ -418,11 +661,71 @@ Program *evaluate_bf6(Programs *programs, Program *source) {
         }
         ins_count++;
         if(ins_head > MAX_TAPE_SIZE) break;
+        if (repeat && ins_head <= prev_ins_head) {
+            u64 state = ((u64)ins_head*MAX_TAPE_SIZE + read_head)*MAX_TAPE_SIZE + write_head;
+            if (lap == 0) {
+                size_t seen = repeat_visit(&eval_repeat, state, ins_count);
+                if (seen != REPEAT_NONE) {
+                    lap = ins_count - seen;
+                    lap_end = ins_count + lap;
+                    lap_state = state;
+                    lap_copy = copy;
+                }
+            } else if (ins_count == lap_end) {
+                assert(state == lap_state);
+                if (memcmp(&copy, &lap_copy, sizeof(copy)) == 0) {
+                    skipped = (MAX_INST_COUNT - ins_count)/lap*lap;
+                    ins_count += skipped;
+                    repeat = false;
+                    COUNTER_ADD(C_REPEATS, 1);
+                    COUNTER_ADD(C_REPEAT_SKIPPED, skipped);
+                } else {
+                    // the copy run is still growing, wait another lap
+                    lap_end += lap;
+                    lap_copy = copy;
+                }
+            }
+        }
     }
+    if (trace != NULL) {
+        Memo_Result m = {.steps = ins_count, .copy_length = eval_copy.length,
+                         .copy_from = eval_copy.from, .copy_to = eval_copy.to};
+        memcpy(m.tape, result.tape, MAX_TAPE_SIZE);
+        memo_insert(eval_memo, source->tape, trace->cells, trace->count, &m);
+    }
+    eval_steps = ins_count;
+    eval_executed = ins_count - skipped;
+    COUNTER_ADD(C_EVALUATIONS, 1);
+    COUNTER_ADD(C_STEPS, ins_count);
+    TIMER_END(T_EVALUATE);
+    PROFILE_END(prof);
     nob_da_append(programs, result);
     return &programs->items[programs->count-1];
 }
 
+// Gives the calling thread a JIT cache when -jit is on
+void jit_thread_begin(void) {
+    if (!use_jit || eval_jit != NULL) return;
+    Jit *j = malloc(sizeof(Jit));
+    if (j != NULL && jit_init(j, MAX_TAPE_SIZE, MAX_INST_COUNT, COUNT)) {
+        eval_jit = j;
+    } else {
+        free(j);
+    }
+}
+
+void jit_thread_end(void) {
+    Jit *j = eval_jit;
+    if (j == NULL) return;
+    atomic_fetch_add(&jit_lookups, j->lookups);
+    atomic_fetch_add(&jit_runs, j->runs);
+    atomic_fetch_add(&jit_compiles, j->compiles);
+    atomic_fetch_add(&jit_flushes, j->flushes);
+    jit_free(j);
+    free(j);
+    eval_jit = NULL;
+}
+
 // Program *evaluate_bf7(Programs *programs, Program *source) {
 //     if (source == NULL) {
 //         return NULL;
@@ -569,10 +872,31 @@ Program *generate_program(Programs *prgs, size_t idx) {
     return &prgs->items[prgs->count - 1];
 }
 
-Program *generate_random_program(Programs *prgs, size_t seq_length) {
+// splitmix64, every experiment gets its own stream so runs don't depend on thread scheduling
+u64 rng_next(u64 *state) {
+    u64 z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+u64 experiment_rng(u64 seed, size_t experiment) {
+    u64 state = seed ^ ((u64)experiment * 0xD1B54A32D192ED03ull);
+    rng_next(&state);
+    return state;
+}
+
+// Decides which tapes the histograms keep as exemplars, a stream of its own so it
+// doesn't follow the tape's cells
+u64 sample_priority(u64 seed, size_t experiment) {
+    u64 state = experiment_rng(~seed, experiment);
+    return rng_next(&state);
+}
+
+Program *generate_random_program(Programs *prgs, size_t seq_length, u64 *rng) {
     Program p = {0};
     for(int i = 0; i < seq_length; i++) {
-        p.tape[i] = rand() % COUNT;
+        p.tape[i] = rng_next(rng) % COUNT;
     }
     
     // SEQ s = {0};
@@ -586,68 +910,1167 @@ Program *generate_random_program(Programs *prgs, size_t seq_length) {
     return &prgs->items[prgs->count - 1];
 }
 
-bool dump_histo_to_file(HIST *hist, size_t cutoff, size_t c, BFL bf) {
-    char dir_path[100];
-    snprintf(dir_path, sizeof(dir_path), "./%s_init_programs", _bfl_str[bf]);
-    if (!nob_mkdir_if_not_exists(dir_path)) {
-        nob_log(NOB_ERROR, "Could not create directory %s", dir_path);
+#define MAX_EX_NUMBER 2000000
+#define DP_MAX_EX_NUMBER 2000000000 // -dp keeps no tapes, so it can afford a thousand times more steps
+#define DO_SEARCH 10000000
+#define HIST_EXEMPLARS 16
+#define HIST2D_EXEMPLARS 4
+#define REPLICATOR_MIN 16
+    
+/*
+Program files
+
+-f maps the whole file and indexes its lines once, the workers then claim lines
+the same way they claim random experiments. Each result lands in its line's
+slot so the scores come out in input order no matter which thread ran it.
+*/
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t *lines;      // line i is [lines[i], lines[i+1]), count + 1 entries
+    size_t count;
+} Program_File;
+
+typedef struct {
+    size_t ex_number;
+    size_t cycle_number;
+} Score;
+
+// characters outside the alphabet read as O, like an unset cell
+static u8 ins_from_char[256];
+
+bool program_file_open(Program_File *f, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        nob_log(NOB_ERROR, "Could not open file %s: %s", path, strerror(errno));
         return false;
     }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        nob_log(NOB_ERROR, "Could not stat file %s: %s", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    f->size = st.st_size;
+    f->data = NULL;
+    if (f->size > 0) {
+        f->data = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (f->data == MAP_FAILED) {
+            nob_log(NOB_ERROR, "Could not map file %s: %s", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        madvise(f->data, f->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
     
-    for (size_t i = cutoff; i < hist->capacity; ++i) { // iterate over the buckets
-        if((hist->items[i].occupied) && (hist->items[i].counter >= c)) {
-            
-            char file_path[100];
-            FILE *file = NULL;
-            
-            const char *hist_type = hist->as == PCL ? "cycle" : "seq"; 
-            
-            snprintf(file_path, sizeof(file_path), "%s/%s-%zu-%zu.txt",
-                    dir_path, hist_type, i, hist->items[i].counter);
-            
-            file = fopen(file_path, "w");
-            
-            if (file == NULL) {
-                nob_log(NOB_ERROR, "Could not create unique file name or open file %s", file_path);
-                return false;
+    f->count = 0;
+    for (char *p = f->data, *end = f->data + f->size; p < end; ++f->count) {
+        char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    f->lines = malloc((f->count + 1)*sizeof(size_t));
+    NOB_ASSERT(f->lines != NULL && "Buy more RAM lol");
+    size_t i = 0;
+    for (char *p = f->data, *end = f->data + f->size; p < end; ++i) {
+        f->lines[i] = p - f->data;
+        char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    f->lines[f->count] = f->size;
+    
+    for (size_t c = 0; c < COUNT; ++c) ins_from_char[(u8)ins_bf7[c][0]] = c;
+    return true;
+}
+
+void program_file_close(Program_File *f) {
+    if (f->data != NULL) munmap(f->data, f->size);
+    free(f->lines);
+    memset(f, 0, sizeof(*f));
+}
+
+Nob_String_View program_file_line(const Program_File *f, size_t line) {
+    Nob_String_View sv = nob_sv_from_parts(f->data + f->lines[line], f->lines[line + 1] - f->lines[line]);
+    while (sv.count > 0 && (sv.data[sv.count - 1] == '\n' || sv.data[sv.count - 1] == '\r')) sv.count--;
+    return sv;
+}
+
+Program *program_from_line(Programs *prgs, const Program_File *f, size_t line) {
+    Nob_String_View sv = program_file_line(f, line);
+    Program p = {0};
+    for (size_t i = 0; i < sv.count && i < MAX_TAPE_SIZE; ++i) {
+        p.tape[i] = ins_from_char[(u8)sv.data[i]];
+    }
+    nob_da_append(prgs, p);
+    return &prgs->items[prgs->count - 1];
+}
+
+bool write_scores(const char *path, const Program_File *f, const Score *scores) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s", path);
+        return false;
+    }
+    fprintf(out, "line,ex_number,cycle_number,program\n");
+    for (size_t i = 0; i < f->count; ++i) {
+        Nob_String_View sv = program_file_line(f, i);
+        fprintf(out, "%zu,%zu,%zu,"SV_Fmt"\n", i + 1, scores[i].ex_number, scores[i].cycle_number, SV_Arg(sv));
+    }
+    bool ok = !ferror(out);
+    fclose(out);
+    if (!ok) {
+        nob_log(NOB_ERROR, "Could not write %s", path);
+        return false;
+    }
+    nob_log(NOB_INFO, "wrote %zu scores to %s", f->count, path);
+    return true;
+}
+
+/*
+Search
+*/
+
+#define CHECKPOINT_MAGIC 0x4B434642u // "BFCK"
+#define CHECKPOINT_VERSION 4
+#define CHECKPOINT_INTERVAL 60
+
+typedef struct {
+    u64 magic;
+    u64 version;
+    u64 seed;
+    u64 start;          // the run covers experiments [start, end)
+    u64 end;
+    u64 boundary;       // experiments [start, boundary) are in the checkpoint
+    u64 highest_cycle_number;
+    u64 highest_execution_number;
+    u64 tape_size;
+    u64 exemplars;
+    u64 joint_exemplars;
+    u64 shard_count;    // followed by shard_count (u64 size, saved shard) pairs
+} Checkpoint_Header;
+
+typedef struct {
+    _Atomic size_t epoch;           // last checkpoint this shard was saved for
+    _Atomic bool done;              // no worker writes to the shard anymore
+    u64 highest_cycle_number;       // records of the experiments in this shard
+    u64 highest_execution_number;
+    Nob_String_Builder saved;       // both records, then pcls, psls, joint and cycles
+} Checkpoint_Shard;
+
+// Pipeline stages timed by -bench-search
+typedef enum {
+    STAGE_GENERATE,
+    STAGE_EVALUATE,
+    STAGE_HASH,
+    STAGE_RESET,
+    STAGE_HIST,
+    STAGE_RECORD,
+    STAGE_COUNT
+} Stage;
+
+const char *stage_names[STAGE_COUNT] = {
+    [STAGE_GENERATE] = "generate",
+    [STAGE_EVALUATE] = "evaluate",
+    [STAGE_HASH]     = "hash",
+    [STAGE_RESET]    = "reset",
+    [STAGE_HIST]     = "hist",
+    [STAGE_RECORD]   = "record",
+};
+
+static inline void stage_lap(u64 *ticks, Stage stage, u64 *t) {
+    u64 now = bench_ticks();
+    ticks[stage] += now - *t;
+    *t = now;
+}
+
+typedef struct {
+    size_t start;       // experiments [start, do_search) belong to this run
+    size_t do_search;
+    u64 seed;
+    size_t seq_length;
+    BFL bfl;
+    Program* (*evaluate)(Programs *, Program *);
+    
+    _Atomic size_t next_experiment;
+    _Atomic size_t highest_cycle_number;
+    _Atomic size_t highest_execution_number;
+    pthread_mutex_t record_lock; // only taken when a record is about to be written
+    
+    bool timed;
+    _Atomic u64 stage_ticks[STAGE_COUNT];
+    _Atomic size_t steps;           // evaluations along all trajectories
+    
+    Hist pcls;
+    Hist psls;
+    Hist2D joint;   // (ex_number, cycle_number) pairs
+    
+    // Checkpoints, see checkpoint_poll
+    size_t start_cycle_number;      // record thresholds before any experiment ran
+    size_t start_execution_number;
+    size_t shard_count;             // >= threads when resuming from a run with more threads
+    Checkpoint_Shard *checkpoint;   // one per shard
+    _Atomic size_t checkpoint_epoch;
+    _Atomic size_t checkpoint_boundary;
+    
+    // -f: experiment i re-evaluates line i of file instead of a random tape
+    const Program_File *file;
+    Score *scores;
+    
+    // Replicators, see lineage_flush
+    size_t replicator_min;          // copy run length that counts as a hit, 0 disables
+    const char *lineage_path;
+    FILE *lineage;                  // see lineage_open
+    pthread_mutex_t lineage_lock;
+    _Atomic size_t replicator_hits;
+    
+    // every cycle an experiment ends in, by canonical tape
+    Cycle_Registry cycles;
+    
+    // Distinguished points, see dp_run
+    size_t dp_bits;                 // 0 keeps every tape in a hash table
+    size_t dp_max;                  // step limit instead of MAX_EX_NUMBER
+
+    bool numa;                      // -numa: workers are spread over the nodes, see bigmem.h
+} Search;
+
+typedef struct {
+    Search *search;
+    size_t id;      // also the histogram shard
+    pthread_t thread;
+} Worker;
+
+/*
+Replicators
+
+evaluate_bf6 tracks the longest run of w instructions that copied consecutive
+source cells to consecutive result cells, that is one compare per w. When a
+step of a trajectory copies at least replicator_min cells in one run, and more
+than any earlier step of the same experiment, the step is appended to the
+lineage log as a Lineage_Entry. The tapes themselves are not stored, the
+experiment index and the seed in the Lineage_Header regenerate the whole
+trajectory.
+
+Entries are buffered per worker and appended under a lock. A worker flushes its
+buffer before it saves its checkpoint shard, so the log holds every entry below
+a checkpoint boundary. A fresh run truncates the log, -resume drops the entries
+at or past the boundary since those experiments run again.
+*/
+
+#define LINEAGE_MAGIC 0x4E494C42u // "BLIN"
+#define LINEAGE_VERSION 1
+#define LINEAGE_BUFFER 256
+
+typedef struct {
+    u64 magic;
+    u64 version;
+    u64 seed;
+    u64 start;          // the run covers experiments [start, end)
+    u64 end;            // followed by the entries
+} Lineage_Header;
+
+typedef struct {
+    u64 experiment;
+    u64 step;           // ex_number of the parent
+    u64 parent;         // hash of the tape that ran
+    u64 child;          // hash of the tape it wrote
+    uint16_t length;    // cells copied in one run
+    uint16_t from;      // first parent cell of the run
+    uint16_t to;        // first child cell of the run
+    uint16_t reserved;
+} Lineage_Entry;
+
+typedef struct {
+    Lineage_Entry *items;
+    size_t count;
+    size_t capacity;
+} Lineage_Entries;
+
+// Starts the log of this run, on -resume with the entries of the old log below `boundary`
+bool lineage_open(Search *s, size_t boundary, bool resume) {
+    Lineage_Header header = {
+        .magic = LINEAGE_MAGIC,
+        .version = LINEAGE_VERSION,
+        .seed = s->seed,
+        .start = s->start,
+        .end = s->do_search,
+    };
+    Nob_String_Builder old = {0};
+    if (resume && nob_file_exists(s->lineage_path) == 1 && !nob_read_entire_file(s->lineage_path, &old)) return false;
+    
+    // written next to the old log and renamed over it, like a checkpoint
+    const char *tmp_path = nob_temp_sprintf("%s.tmp", s->lineage_path);
+    s->lineage = fopen(tmp_path, "wb");
+    if (s->lineage == NULL) {
+        nob_log(NOB_ERROR, "Could not open lineage log %s: %s", tmp_path, strerror(errno));
+        nob_sb_free(old);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, s->lineage) == 1;
+    if (old.count > 0) {
+        Lineage_Header old_header = {0};
+        if (old.count >= sizeof(old_header)) memcpy(&old_header, old.items, sizeof(old_header));
+        if (memcmp(&old_header, &header, sizeof(header)) != 0) {
+            nob_log(NOB_WARNING, "%s belongs to another run, its entries are dropped", s->lineage_path);
+        } else {
+            size_t count = (old.count - sizeof(header))/sizeof(Lineage_Entry), kept = 0;
+            for (size_t i = 0; ok && i < count; ++i) {
+                Lineage_Entry e;
+                memcpy(&e, old.items + sizeof(header) + i*sizeof(e), sizeof(e));
+                if (e.experiment >= boundary) continue;
+                ok = fwrite(&e, sizeof(e), 1, s->lineage) == 1;
+                kept += 1;
+            }
+            nob_log(NOB_INFO, "kept %zu of %zu lineage entries below experiment %zu", kept, count, boundary);
+        }
+    }
+    nob_sb_free(old);
+    ok = ok && fflush(s->lineage) == 0;
+    if (!ok || rename(tmp_path, s->lineage_path) != 0) {
+        nob_log(NOB_ERROR, "Could not write lineage log %s: %s", s->lineage_path, strerror(errno));
+        fclose(s->lineage);
+        s->lineage = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool lineage_flush(Search *s, Lineage_Entries *entries) {
+    if (entries->count == 0) return true;
+    pthread_mutex_lock(&s->lineage_lock);
+    bool ok = s->lineage != NULL && fwrite(entries->items, sizeof(Lineage_Entry), entries->count, s->lineage) == entries->count;
+    if (ok) fflush(s->lineage);
+    pthread_mutex_unlock(&s->lineage_lock);
+    entries->count = 0;
+    return ok;
+}
+
+/*
+Checkpoints
+
+A checkpoint holds every experiment below a boundary and nothing above it.
+Workers claim experiments in increasing order, so when a checkpoint is
+requested each worker saves its own shard right before it starts its first
+experiment at or past the boundary. Nobody waits for anybody else, a worker is
+only paused for as long as it takes to copy its own shard. Shards of workers
+that already finished are saved by the checkpoint thread, which then writes
+the file next to the old one and renames it over.
+*/
+
+Nob_String_View sv_chop_left(Nob_String_View *sv, size_t n) {
+    if (n > sv->count) n = sv->count;
+    Nob_String_View result = nob_sv_from_parts(sv->data, n);
+    sv->data += n;
+    sv->count -= n;
+    return result;
+}
+
+void checkpoint_save_shard(Search *s, size_t shard) {
+    Checkpoint_Shard *c = &s->checkpoint[shard];
+    c->saved.count = 0;
+    nob_sb_append_buf(&c->saved, &c->highest_cycle_number, sizeof(u64));
+    nob_sb_append_buf(&c->saved, &c->highest_execution_number, sizeof(u64));
+    hist_shard_save(&s->pcls, shard, &c->saved);
+    hist_shard_save(&s->psls, shard, &c->saved);
+    hist2d_shard_save(&s->joint, shard, &c->saved);
+    cycles_shard_save(&s->cycles, shard, &c->saved);
+}
+
+// Called by a worker right after it claimed `experiment`, before running it
+void checkpoint_poll(Search *s, size_t shard, size_t experiment, Lineage_Entries *lineage) {
+    Checkpoint_Shard *c = &s->checkpoint[shard];
+    size_t epoch = atomic_load(&s->checkpoint_epoch);
+    if (atomic_load_explicit(&c->epoch, memory_order_relaxed) == epoch) return;
+    size_t boundary;
+    while ((boundary = atomic_load(&s->checkpoint_boundary)) == SIZE_MAX) {
+        // the checkpoint thread is between publishing the epoch and the boundary
+    }
+    if (experiment < boundary) return;
+    lineage_flush(s, lineage);
+    checkpoint_save_shard(s, shard);
+    atomic_store_explicit(&c->epoch, epoch, memory_order_release);
+}
+
+bool checkpoint_write(Search *s, const char *path) {
+    double start = bench_seconds();
+    size_t epoch = atomic_load(&s->checkpoint_epoch) + 1;
+    atomic_store(&s->checkpoint_boundary, SIZE_MAX);
+    atomic_store(&s->checkpoint_epoch, epoch);
+    size_t boundary = atomic_load(&s->next_experiment);
+    if (boundary > s->do_search) boundary = s->do_search;
+    atomic_store(&s->checkpoint_boundary, boundary);
+    
+    for (;;) {
+        bool all = true;
+        for (size_t i = 0; i < s->shard_count; ++i) {
+            Checkpoint_Shard *c = &s->checkpoint[i];
+            if (atomic_load_explicit(&c->epoch, memory_order_acquire) == epoch) continue;
+            if (atomic_load_explicit(&c->done, memory_order_acquire)) {
+                if (atomic_load(&c->epoch) != epoch) checkpoint_save_shard(s, i);
+                atomic_store(&c->epoch, epoch);
+                continue;
+            }
+            all = false;
+        }
+        if (all) break;
+        nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    }
+    
+    Checkpoint_Header header = {
+        .magic = CHECKPOINT_MAGIC,
+        .version = CHECKPOINT_VERSION,
+        .seed = s->seed,
+        .start = s->start,
+        .end = s->do_search,
+        .boundary = boundary,
+        .highest_cycle_number = s->start_cycle_number,
+        .highest_execution_number = s->start_execution_number,
+        .tape_size = MAX_TAPE_SIZE,
+        .exemplars = s->pcls.exemplars,
+        .joint_exemplars = s->joint.exemplars,
+        .shard_count = s->shard_count,
+    };
+    for (size_t i = 0; i < s->shard_count; ++i) {
+        u64 records[2];
+        memcpy(records, s->checkpoint[i].saved.items, sizeof(records));
+        if (records[0] > header.highest_cycle_number) header.highest_cycle_number = records[0];
+        if (records[1] > header.highest_execution_number) header.highest_execution_number = records[1];
+    }
+    
+    const char *tmp_path = nob_temp_sprintf("%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        nob_log(NOB_ERROR, "Could not open checkpoint %s", tmp_path);
+        return false;
+    }
+    size_t bytes = sizeof(header);
+    fwrite(&header, sizeof(header), 1, file);
+    for (size_t i = 0; i < s->shard_count; ++i) {
+        u64 size = s->checkpoint[i].saved.count;
+        fwrite(&size, sizeof(size), 1, file);
+        fwrite(s->checkpoint[i].saved.items, 1, size, file);
+        bytes += sizeof(size) + size;
+    }
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        nob_log(NOB_ERROR, "Could not write checkpoint %s", path);
+        return false;
+    }
+    COUNTER_ADD(C_FILES_WRITTEN, 1);
+    COUNTER_ADD(C_BYTES_WRITTEN, bytes);
+    nob_log(NOB_INFO, "checkpoint: %zu experiments, %zu bytes to %s in %.3fs", boundary, bytes, path, bench_seconds() - start);
+    return true;
+}
+
+bool checkpoint_read_header(Nob_String_View data, size_t exemplars, size_t joint_exemplars, Checkpoint_Header *header) {
+    if (data.count < sizeof(*header)) {
+        nob_log(NOB_ERROR, "Checkpoint is truncated");
+        return false;
+    }
+    memcpy(header, data.data, sizeof(*header));
+    if (header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION) {
+        nob_log(NOB_ERROR, "Not a checkpoint of this version");
+        return false;
+    }
+    if (header->tape_size != MAX_TAPE_SIZE || header->exemplars != exemplars || header->joint_exemplars != joint_exemplars) {
+        nob_log(NOB_ERROR, "Checkpoint was taken with tape size %zu, -k %zu, -kj %zu",
+                (size_t)header->tape_size, (size_t)header->exemplars, (size_t)header->joint_exemplars);
+        return false;
+    }
+    return true;
+}
+
+// Loads the saved shards into shards [first, first + shard_count) of s
+bool checkpoint_read_shards(Search *s, Nob_String_View data, size_t first) {
+    Checkpoint_Header header;
+    memcpy(&header, data.data, sizeof(header));
+    sv_chop_left(&data, sizeof(header));
+    for (size_t i = first; i < first + header.shard_count; ++i) {
+        Checkpoint_Shard *c = &s->checkpoint[i];
+        u64 size = 0;
+        if (data.count < sizeof(size)) break;
+        memcpy(&size, data.data, sizeof(size));
+        sv_chop_left(&data, sizeof(size));
+        if (size > data.count) break;
+        Nob_String_View shard = sv_chop_left(&data, size);
+        if (shard.count < 2*sizeof(u64)) break;
+        memcpy(&c->highest_cycle_number, shard.data, sizeof(u64));
+        memcpy(&c->highest_execution_number, shard.data + sizeof(u64), sizeof(u64));
+        sv_chop_left(&shard, 2*sizeof(u64));
+        if (!hist_shard_load(&s->pcls, i, &shard) || !hist_shard_load(&s->psls, i, &shard) ||
+            !hist2d_shard_load(&s->joint, i, &shard) || !cycles_shard_load(&s->cycles, i, &shard)) break;
+        if (i + 1 == first + header.shard_count) return true;
+    }
+    nob_log(NOB_ERROR, "Checkpoint is corrupted");
+    return false;
+}
+
+// tapes are pushed in step order, so nothing needs sorting
+void trajectory_to_programs(const Trajectory *t, Programs *programs) {
+    for (size_t i = 0; i < t->count; ++i) {
+        Program p = {.ex_number = t->ex_numbers[i]};
+        memcpy(p.tape, t->tapes[i], MAX_TAPE_SIZE);
+        nob_da_append(programs, p);
+    }
+}
+
+// Cheap check without the lock, record_trajectory decides under it
+bool record_beaten(Search *s, size_t ex_number, size_t cycle_number) {
+    return cycle_number > atomic_load_explicit(&s->highest_cycle_number, memory_order_relaxed) ||
+           ex_number > atomic_load_explicit(&s->highest_execution_number, memory_order_relaxed);
+}
+
+void record_trajectory(Search *s, Trajectory *t, size_t ex_number, size_t cycle_number) {
+    if (!record_beaten(s, ex_number, cycle_number)) return;
+    
+    pthread_mutex_lock(&s->record_lock);
+    Programs programs = {0};
+    if (cycle_number > atomic_load(&s->highest_cycle_number) || ex_number > atomic_load(&s->highest_execution_number)) {
+        trajectory_to_programs(t, &programs);
+    }
+    if (cycle_number > atomic_load(&s->highest_cycle_number)) {
+        write_programs_to_file(&programs, ex_number, cycle_number, s->bfl);
+        nob_log(NOB_INFO,"Cycle detected with size: %zu, after %zu program executions", cycle_number, (size_t)t->ex_numbers[t->count-1]);
+        atomic_store(&s->highest_cycle_number, cycle_number);
+    }
+    if (ex_number > atomic_load(&s->highest_execution_number)) {
+        write_programs_to_file(&programs, ex_number, cycle_number, s->bfl);
+        nob_log(NOB_INFO,"%zu unique program executions, cycle_size: %zu", ex_number, cycle_number);
+        atomic_store(&s->highest_execution_number, ex_number);
+    }
+    nob_da_free(programs);
+    pthread_mutex_unlock(&s->record_lock);
+}
+
+/*
+Distinguished points
+
+-dp k follows a trajectory without keeping its tapes. Only tapes whose hash
+starts with k zero bits are stored, about one every 2^k steps, and a cycle is
+seen when one of them comes around again. Cycles too short to hold one are
+caught by Brent's method: the current tape is compared with an anchor that
+moves to the current tape after 1, 2, 4, ... steps. Either way the earlier
+sighting e is on the cycle and the distance to it is the cycle length c.
+
+Every stored point before e is on the tail, otherwise it would have come
+around before e did. So the entry into the cycle lies between the last of
+them, or the start tape, and e: one tape is run c steps ahead of that point
+and both are stepped together until they meet. Running once around from e
+finds the canonical tape for the cycle registry. Memory grows with the steps
+over 2^k instead of with the steps, at the price of rerunning about 2c
+evaluations plus twice the gap to the last point.
+
+The results match the hashed search, which never hashes the start tape: with
+mu the index of the first tape on the cycle, ex_number is max(mu, 1) + c - 1.
+*/
+
+typedef struct {
+    Programs points;        // in step order, ex_number is the step
+    uint32_t *slots;             // point + 1, 0 when empty
+    size_t slot_capacity;   // power of two
+} Dp_Table;
+
+void dp_reset(Dp_Table *dp) {
+    if (dp->slots != NULL) memset(dp->slots, 0, dp->slot_capacity*sizeof(uint32_t));
+    dp->points.count = 0;
+}
+
+void dp_free(Dp_Table *dp) {
+    nob_da_free(dp->points);
+    free(dp->slots);
+    memset(dp, 0, sizeof(*dp));
+}
+
+// Returns the step the tape was stored at before, or SIZE_MAX after storing it
+size_t dp_visit(Dp_Table *dp, const Program *p, size_t step, u64 h) {
+    if (2*(dp->points.count + 1) > dp->slot_capacity) {
+        size_t capacity = dp->slot_capacity > 0 ? dp->slot_capacity*2 : 256;
+        uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+        NOB_ASSERT(slots != NULL && "Buy more RAM lol");
+        for (size_t i = 0; i < dp->points.count; ++i) {
+            size_t j = cycles_hash(dp->points.items[i].tape, MAX_TAPE_SIZE) & (capacity - 1);
+            while (slots[j] != 0) j = (j + 1) & (capacity - 1);
+            slots[j] = (uint32_t)i + 1;
+        }
+        free(dp->slots);
+        dp->slots = slots;
+        dp->slot_capacity = capacity;
+    }
+    size_t j = h & (dp->slot_capacity - 1);
+    for (; dp->slots[j] != 0; j = (j + 1) & (dp->slot_capacity - 1)) {
+        Program *q = &dp->points.items[dp->slots[j] - 1];
+        if (tape_eq(q->tape, (u8 *)p->tape)) return q->ex_number;
+    }
+    Program point = *p;
+    point.ex_number = step;
+    nob_da_append(&dp->points, point);
+    dp->slots[j] = (uint32_t)dp->points.count;
+    return SIZE_MAX;
+}
+
+// Replaces programs->items[0] with the tape it evaluates to
+static inline Program *step_program(Search *s, Programs *programs) {
+    programs->count = 1;
+    Program *p = s->evaluate(programs, &programs->items[0]);
+    programs->items[0] = *p;
+    programs->count = 1;
+    return &programs->items[0];
+}
+
+// Runs init for steps steps again, filling t the way the search loop does
+void replay_trajectory(Search *s, Programs *programs, Trajectory *t, const Program *init, size_t steps) {
+    programs->count = 0;
+    nob_da_append(programs, *init);
+    t->count = 0;
+    trajectory_push(t, init->tape, 0);
+    for (size_t i = 1; i <= steps; ++i) trajectory_push(t, step_program(s, programs)->tape, i);
+}
+
+// -f keeps the sequential rule: lines are walked in file order and a tie with the
+// record is written again, so the last of equal lines wins however threads ran
+void record_file_trajectories(Search *s) {
+    Programs programs = {0};
+    Trajectory trajectory = {0};
+    jit_thread_begin();
+    for (size_t line = 0; line < s->file->count; ++line) {
+        Score score = s->scores[line];
+        bool cycle = score.cycle_number >= atomic_load(&s->highest_cycle_number);
+        bool execution = score.ex_number >= atomic_load(&s->highest_execution_number);
+        if (!cycle && !execution) continue;
+        Program init = {0};
+        Programs one = {.items = &init, .capacity = 1};
+        program_from_line(&one, s->file, line);
+        replay_trajectory(s, &programs, &trajectory, &init, score.ex_number + (score.cycle_number > 0));
+        Programs columns = {0};
+        trajectory_to_programs(&trajectory, &columns);
+        if (cycle) {
+            write_programs_to_file(&columns, score.ex_number, score.cycle_number, s->bfl);
+            nob_log(NOB_INFO,"Cycle detected with size: %zu, after %zu program executions", score.cycle_number, (size_t)trajectory.ex_numbers[trajectory.count-1]);
+            atomic_store(&s->highest_cycle_number, score.cycle_number);
+        }
+        if (execution) {
+            write_programs_to_file(&columns, score.ex_number, score.cycle_number, s->bfl);
+            nob_log(NOB_INFO,"%zu unique program executions, cycle_size: %zu", score.ex_number, score.cycle_number);
+            atomic_store(&s->highest_execution_number, score.ex_number);
+        }
+        nob_da_free(columns);
+    }
+    jit_thread_end();
+    repeat_free(&eval_repeat);
+    nob_da_free(programs);
+    trajectory_free(&trajectory);
+}
+
+// Lineage hits go to pending with their step, the caller drops the ones past ex_number
+void dp_run(Search *s, Dp_Table *dp, Programs *programs, const Program *init, size_t copied,
+            Lineage_Entries *pending, size_t experiment, size_t *ex_number, size_t *cycle_number,
+            u8 *canonical, u64 *canonical_hash) {
+    dp_reset(dp);
+    programs->count = 0;
+    nob_da_append(programs, *init);
+    Program anchor = *init;
+    size_t anchor_step = 0, power = 1;
+    size_t seen = SIZE_MAX, step = 0;
+    while (step < s->dp_max) {
+        u64 parent = pending != NULL ? hash(programs->items[0].tape, MAX_TAPE_SIZE) : 0;
+        Program *p = step_program(s, programs);
+        if (pending != NULL && eval_copy.length > copied) {
+            copied = eval_copy.length;
+            Lineage_Entry e = {
+                .experiment = experiment,
+                .step = step,
+                .parent = parent,
+                .child = hash(p->tape, MAX_TAPE_SIZE),
+                .length = eval_copy.length,
+                .from = eval_copy.from,
+                .to = eval_copy.to,
+            };
+            nob_da_append(pending, e);
+        }
+        ++step;
+        if (tape_eq(p->tape, anchor.tape)) {
+            seen = anchor_step;
+            break;
+        }
+        u64 h = cycles_hash(p->tape, MAX_TAPE_SIZE);
+        if (h >> (64 - s->dp_bits) == 0 && (seen = dp_visit(dp, p, step, h)) != SIZE_MAX) break;
+        if (step - anchor_step == power) {
+            anchor = *p;
+            anchor_step = step;
+            power *= 2;
+        }
+    }
+    *ex_number = s->dp_max;
+    *cycle_number = 0;
+    if (seen == SIZE_MAX) return;
+    size_t c = step - seen;
+    
+    // canonical tape, once around from the tape that came back
+    *canonical_hash = cycles_hash(programs->items[0].tape, MAX_TAPE_SIZE);
+    memcpy(canonical, programs->items[0].tape, MAX_TAPE_SIZE);
+    for (size_t i = 1; i < c; ++i) {
+        Program *p = step_program(s, programs);
+        u64 h = cycles_hash(p->tape, MAX_TAPE_SIZE);
+        if (h < *canonical_hash || (h == *canonical_hash && memcmp(p->tape, canonical, MAX_TAPE_SIZE) < 0)) {
+            *canonical_hash = h;
+            memcpy(canonical, p->tape, MAX_TAPE_SIZE);
+        }
+    }
+    
+    // the entry lies after the last point stored before the sighting
+    Program tortoise = *init;
+    size_t mu = 0;
+    for (size_t i = dp->points.count; i-- > 0;) {
+        if (dp->points.items[i].ex_number < seen) {
+            tortoise = dp->points.items[i];
+            mu = tortoise.ex_number;
+            break;
+        }
+    }
+    programs->items[0] = tortoise;
+    for (size_t i = 0; i < c; ++i) step_program(s, programs);
+    Program hare = programs->items[0];
+    while (!tape_eq(tortoise.tape, hare.tape)) {
+        programs->items[0] = tortoise;
+        tortoise = *step_program(s, programs);
+        programs->items[0] = hare;
+        hare = *step_program(s, programs);
+        ++mu;
+    }
+    if (mu == 0) mu = 1;
+    if (mu + c - 1 >= s->dp_max) return;
+    *ex_number = mu + c - 1;
+    *cycle_number = c;
+}
+
+void *search_worker(void *arg) {
+    Worker *w = arg;
+    Search *s = w->search;
+    // before the first allocation, so every table of this worker lands on its node
+    if (s->numa) bigmem_bind_thread(w->id % bigmem_node_count());
+    Swiss ht_pkv = {0};
+    if (s->dp_bits == 0) swiss_init(&ht_pkv, TAPE_SET_SLOTS);
+    u64 ticks[STAGE_COUNT] = {0};
+    u64 t = 0;
+    Programs programs = {0};        // the tape being evaluated and its result
+    Trajectory trajectory = {0};
+    size_t steps = 0;
+    Lineage_Entries lineage = {0};
+    Dp_Table dp = {0};
+    Lineage_Entries pending = {0};
+    jit_thread_begin();
+    
+    for (;;) {
+        // sequentially consistent so checkpoint_write sees every claim past its boundary
+        size_t experiment = atomic_fetch_add(&s->next_experiment, 1);
+        checkpoint_poll(s, w->id, experiment, &lineage);
+        if (experiment >= s->do_search) break;
+        if (s->timed) t = bench_ticks();
+        // reused across experiments
+        programs.count = 0;
+        trajectory.count = 0;
+        size_t ex_number = 0;
+        size_t cycle_number = 0;
+        Program *p0;
+        if (s->file != NULL) {
+            p0 = program_from_line(&programs, s->file, experiment);
+        } else {
+            u64 rng = experiment_rng(s->seed, experiment);
+            p0 = generate_random_program(&programs, s->seq_length, &rng);
+        }
+        Program init_p = *p0;
+        trajectory_push(&trajectory, init_p.tape, 0);
+        size_t copied = s->replicator_min > 0 ? s->replicator_min - 1 : SIZE_MAX;
+        if (s->timed) stage_lap(ticks, STAGE_GENERATE, &t);
+        if (s->dp_bits > 0) {
+            u8 canonical[MAX_TAPE_SIZE];
+            u64 h;
+            pending.count = 0;
+            dp_run(s, &dp, &programs, &init_p, copied, s->replicator_min > 0 ? &pending : NULL, experiment,
+                   &ex_number, &cycle_number, canonical, &h);
+            if (s->timed) stage_lap(ticks, STAGE_EVALUATE, &t);
+            for (size_t i = 0; i < pending.count && pending.items[i].step <= ex_number; ++i) {
+                nob_da_append(&lineage, pending.items[i]);
+                atomic_fetch_add_explicit(&s->replicator_hits, 1, memory_order_relaxed);
             }
-            
-            for (size_t j = 0; j < hist->items[i].count; ++j) { 
-                Program p = hist->items[i].items[j];
-                for (int j = 0; j < MAX_TAPE_SIZE; j++) {
-                    unsigned char instruction = p.tape[j] % COUNT;
-                    fprintf(file, "%s", ins_bf7[instruction]);
+            if (lineage.count >= LINEAGE_BUFFER) lineage_flush(s, &lineage);
+            if (cycle_number > 0) cycles_add(&s->cycles, w->id, canonical, h, cycle_number, init_p.tape, experiment);
+            if (s->scores == NULL && record_beaten(s, ex_number, cycle_number)) {
+                // no tapes were kept, a record runs again for its dump
+                size_t steps = ex_number + (cycle_number > 0);
+                if (steps <= MAX_EX_NUMBER) {
+                    replay_trajectory(s, &programs, &trajectory, &init_p, steps);
+                } else {
+                    nob_log(NOB_WARNING, "%zu steps are too many to replay, only the start tape of the record is written", steps);
                 }
-                fprintf(file, "\n");
             }
-            fclose(file);
+        }
+        while (s->dp_bits == 0 && ex_number < MAX_EX_NUMBER) { 
+            p0 = step_program(s, &programs);
+            if (s->timed) stage_lap(ticks, STAGE_EVALUATE, &t);
+            size_t index = trajectory_push(&trajectory, p0->tape, ex_number + 1);
+            if (eval_copy.length > copied) {
+                copied = eval_copy.length;
+                Lineage_Entry e = {
+                    .experiment = experiment,
+                    .step = ex_number,
+                    .parent = hash(trajectory.tapes[index - 1], MAX_TAPE_SIZE),
+                    .child = hash(p0->tape, MAX_TAPE_SIZE),
+                    .length = eval_copy.length,
+                    .from = eval_copy.from,
+                    .to = eval_copy.to,
+                };
+                nob_da_append(&lineage, e);
+                atomic_fetch_add_explicit(&s->replicator_hits, 1, memory_order_relaxed);
+                if (lineage.count >= LINEAGE_BUFFER) lineage_flush(s, &lineage);
+            }
+            TIMER_BEGIN(T_HASH);
+            cycle_number = add_to_hash(&ht_pkv, &trajectory, index);
+            TIMER_END(T_HASH);
+            if (s->timed) stage_lap(ticks, STAGE_HASH, &t);
+            if(cycle_number) break;
+            ++ex_number;
+        }
+        if (s->dp_bits == 0) hash_reset(&ht_pkv);
+        if (s->timed) stage_lap(ticks, STAGE_RESET, &t);
+        u64 prio = sample_priority(s->seed, experiment);
+        hist_add(&s->pcls, w->id, cycle_number, init_p.tape, prio);
+        hist_add(&s->psls, w->id, ex_number, init_p.tape, prio);
+        hist2d_add(&s->joint, w->id, ex_number, cycle_number, init_p.tape, prio);
+        if (s->dp_bits == 0 && cycle_number > 0) {
+            // the last tape repeats the first one of the cycle
+            const u8 *cycle = trajectory.tapes[trajectory.count - 1 - cycle_number];
+            u64 h;
+            size_t k = cycle_canonical(cycle, MAX_TAPE_SIZE, cycle_number, MAX_TAPE_SIZE, &h);
+            cycles_add(&s->cycles, w->id, &cycle[k*MAX_TAPE_SIZE], h, cycle_number, init_p.tape, experiment);
+        }
+        Checkpoint_Shard *c = &s->checkpoint[w->id];
+        if (cycle_number > c->highest_cycle_number) c->highest_cycle_number = cycle_number;
+        if (ex_number > c->highest_execution_number) c->highest_execution_number = ex_number;
+        if (s->timed) stage_lap(ticks, STAGE_HIST, &t);
+        if (s->scores != NULL) s->scores[experiment] = (Score){ex_number, cycle_number};
+        else record_trajectory(s, &trajectory, ex_number, cycle_number);
+        if (s->timed) stage_lap(ticks, STAGE_RECORD, &t);
+        steps += ex_number + (cycle_number > 0);
+    }
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        atomic_fetch_add_explicit(&s->stage_ticks[i], ticks[i], memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&s->steps, steps, memory_order_relaxed);
+    jit_thread_end();
+    repeat_free(&eval_repeat);
+    lineage_flush(s, &lineage);
+    nob_da_free(lineage);
+    nob_da_free(pending);
+    dp_free(&dp);
+    nob_da_free(programs);
+    trajectory_free(&trajectory);
+    swiss_free(&ht_pkv);
+    atomic_store_explicit(&s->checkpoint[w->id].done, true, memory_order_release);
+    return NULL;
+}
+
+/*
+Basins
+
+-basin L maps every tape whose first L cells take every value of the alphabet,
+the rest zero, like the random search starts with seq_length L. The histograms
+come from the graph: a search starting at x never hashes x itself, so it stops
+after tail(next(x)) + cycle_length steps with cycle_number = cycle_length.
+*/
+
+void basin_eval_bf6(const u8 *src, u8 *dst) {
+    Program items[2];
+    Programs programs = {.items = items, .capacity = NOB_ARRAY_LEN(items)};
+    Program p = {0};
+    memcpy(p.tape, src, MAX_TAPE_SIZE);
+    nob_da_append(&programs, p);
+    evaluate_bf6(&programs, &programs.items[0]);
+    memcpy(dst, programs.items[1].tape, MAX_TAPE_SIZE);
+}
+
+void basin_thread_end(void) {
+    repeat_free(&eval_repeat);
+}
+
+bool run_basin(Search *s, size_t length, size_t threads, BFL bf) {
+    size_t start_count = 1;
+    for (size_t i = 0; i < length; ++i) {
+        if (start_count > UINT32_MAX/COUNT) {
+            nob_log(NOB_ERROR, "basin: %zu cell starts don't fit in 32 bit node ids", length);
+            return false;
+        }
+        start_count *= COUNT;
+    }
+    u8 *starts = calloc(start_count, MAX_TAPE_SIZE);
+    if (starts == NULL) {
+        nob_log(NOB_ERROR, "basin: could not allocate %zu start tapes", start_count);
+        return false;
+    }
+    for (size_t i = 0; i < start_count; ++i) {
+        for (size_t j = 0, idx = i; j < length; ++j, idx /= COUNT) starts[i*MAX_TAPE_SIZE + j] = idx % COUNT;
+    }
+
+    nob_log(NOB_INFO, "basin: mapping %zu tapes of %zu cells (%zu threads)", start_count, length, threads);
+    double start_seconds = bench_seconds();
+    Basin b = {.tape_size = MAX_TAPE_SIZE, .threads = threads, .eval = basin_eval_bf6, .thread_end = basin_thread_end};
+    bool ok = basin_build(&b, starts, start_count);
+    free(starts);
+    if (!ok) {
+        basin_free(&b);
+        return false;
+    }
+    double built_seconds = bench_seconds();
+    basin_solve(&b);
+    nob_log(NOB_INFO, "basin: %zu nodes and %zu cycles, evaluated in %.2fs, solved in %.2fs",
+            b.node_count, b.cycle_count, built_seconds - start_seconds, bench_seconds() - built_seconds);
+    const char *path = nob_temp_sprintf("%s/%s_basin_%zu.bin", output_dir, _bfl_str[bf], length);
+    ok = basin_write(&b, path, COUNT, length);
+    if (ok) nob_log(NOB_INFO, "basin: wrote %s", path);
+
+    Checkpoint_Shard *c = &s->checkpoint[0];
+    for (size_t x = 0; x < b.start_count; ++x) {
+        const u8 *tape = &b.tapes[x*MAX_TAPE_SIZE];
+        size_t y = b.next[x];
+        size_t cycle_number = b.cycle_length[y];
+        size_t ex_number = b.tail[y] + cycle_number;
+        u64 prio = sample_priority(s->seed, x);
+        hist_add(&s->pcls, 0, cycle_number, tape, prio);
+        hist_add(&s->psls, 0, ex_number, tape, prio);
+        hist2d_add(&s->joint, 0, ex_number, cycle_number, tape, prio);
+        if (cycle_number > c->highest_cycle_number) c->highest_cycle_number = cycle_number;
+        if (ex_number > c->highest_execution_number) c->highest_execution_number = ex_number;
+    }
+    if (c->highest_cycle_number > s->highest_cycle_number) s->highest_cycle_number = c->highest_cycle_number;
+    if (c->highest_execution_number > s->highest_execution_number) s->highest_execution_number = c->highest_execution_number;
+    basin_free(&b);
+    return ok;
+}
+
+/*
+Benchmarks
+*/
+
+typedef struct {
+    Program* (*evaluate)(Programs *, Program *);
+    Programs programs;
+} Bench_Ctx;
+
+size_t bench_evaluate(void *ctx, const u8 *tape, size_t *executed) {
+    Bench_Ctx *b = ctx;
+    b->programs.count = 0;
+    Program p = {0};
+    memcpy(p.tape, tape, MAX_TAPE_SIZE);
+    nob_da_append(&b->programs, p);
+    b->evaluate(&b->programs, &b->programs.items[0]);
+    if (executed != NULL) *executed = eval_executed;
+    return eval_steps;
+}
+
+// Flushes the JIT cache first, so every evaluation pays for compiling its tape
+size_t bench_evaluate_compile(void *ctx, const u8 *tape, size_t *executed) {
+    jit_flush(eval_jit);
+    return bench_evaluate(ctx, tape, executed);
+}
+
+// Compiled code has to leave the same tape after the same number of steps as the interpreter
+bool jit_check(Bench_Ctx *ctx, const Bench_Corpus *c) {
+    Jit *j = eval_jit;
+    for (size_t i = 0; i < c->count; ++i) {
+        const u8 *tape = &c->items[i*MAX_TAPE_SIZE];
+        eval_jit = NULL;
+        size_t steps = bench_evaluate(ctx, tape, NULL);
+        Program expected = ctx->programs.items[1];
+        eval_jit = j;
+        size_t runs = j->runs;
+        size_t jit_steps = bench_evaluate(ctx, tape, NULL);
+        if (j->runs == runs) continue;
+        if (jit_steps != steps || memcmp(expected.tape, ctx->programs.items[1].tape, MAX_TAPE_SIZE) != 0) {
+            nob_log(NOB_ERROR, "jit: tape %zu of the %s corpus differs from the interpreter", i, c->name);
+            return false;
+        }
+    }
+    return true;
+}
+
+// A fast path has to leave the same tape, steps and copy run as the interpreter without it
+bool fast_path_check(Bench_Ctx *ctx, const Bench_Corpus *c, bool *use, const char *name) {
+    for (size_t i = 0; i < c->count; ++i) {
+        const u8 *tape = &c->items[i*MAX_TAPE_SIZE];
+        *use = false;
+        size_t steps = bench_evaluate(ctx, tape, NULL);
+        Program expected = ctx->programs.items[1];
+        Copy_Run copy = eval_copy;
+        *use = true;
+        if (bench_evaluate(ctx, tape, NULL) != steps ||
+            memcmp(expected.tape, ctx->programs.items[1].tape, MAX_TAPE_SIZE) != 0 ||
+            memcmp(&copy, &eval_copy, sizeof(copy)) != 0) {
+            nob_log(NOB_ERROR, "%s: tape %zu of the %s corpus differs without it", name, i, c->name);
+            return false;
+        }
+    }
+    return true;
+}
+
+// A memo hit has to give what interpreting the tape gives, also for a tape
+// that only differs in a cell the recorded evaluation never read
+bool memo_check(Bench_Ctx *ctx, Memo *memo, const Bench_Corpus *c) {
+    for (size_t i = 0; i < c->count; ++i) {
+        u8 tape[MAX_TAPE_SIZE];
+        memcpy(tape, &c->items[i*MAX_TAPE_SIZE], MAX_TAPE_SIZE);
+        eval_memo = memo;
+        size_t hits = atomic_load(&memo->hits);
+        bench_evaluate(ctx, tape, NULL);
+        if (atomic_load(&memo->hits) == hits) {
+            size_t j = 0;
+            while (j < MAX_TAPE_SIZE && (eval_trace.seen >> j & 1)) j++;
+            if (j < MAX_TAPE_SIZE) tape[j] = (tape[j] + 1) % COUNT;
+        }
+        eval_memo = NULL;
+        size_t steps = bench_evaluate(ctx, tape, NULL);
+        Program expected = ctx->programs.items[1];
+        Copy_Run copy = eval_copy;
+        eval_memo = memo;
+        hits = atomic_load(&memo->hits);
+        size_t memo_steps = bench_evaluate(ctx, tape, NULL);
+        eval_memo = NULL;
+        if (atomic_load(&memo->hits) == hits) continue;
+        if (memo_steps != steps ||
+            memcmp(expected.tape, ctx->programs.items[1].tape, MAX_TAPE_SIZE) != 0 ||
+            memcmp(&copy, &eval_copy, sizeof(copy)) != 0) {
+            nob_log(NOB_ERROR, "memo: tape %zu of the %s corpus differs from the interpreter", i, c->name);
+            return false;
         }
     }
     return true;
 }
+
+bool run_benchmarks(const char *json_path) {
+    Bench b = {.driver = "detect_cycles"};
+    Bench_Corpus random = {0}, loops = {0}, straight = {0}, saved = {0};
+    bench_corpus_random(&random, BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, COUNT, BENCH_SEED);
+    bench_corpus_loops(&loops, BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, COUNT, MIL, MIR, BENCH_SEED);
+    bench_corpus_straight(&straight, BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, COUNT, MIL, MIR, BENCH_SEED);
+    bench_corpus_from_dir(&saved, "./bf6_programs", BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, ins_bf7, COUNT);
     
-#define MAX_EX_NUMBER 2000000
-#define DO_SEARCH 10000000
+    Bench_Ctx ctx = {.evaluate = evaluate_bf6};
+    bench_run(&b, "bf6", &random, bench_evaluate, &ctx);
+    bench_run(&b, "bf6", &loops, bench_evaluate, &ctx);
+    bench_run(&b, "bf6", &straight, bench_evaluate, &ctx);
+    bench_run(&b, "bf6", &saved, bench_evaluate, &ctx);
     
+    // bf6-jit runs a warm cache, bf6-jit-compile compiles on every evaluation.
+    // Compiling pays off once a tape is evaluated more often than the break-even.
+    bool ok = true;
+    use_jit = true;
+    jit_thread_begin();
+    if (eval_jit != NULL) {
+        const Bench_Corpus *corpora[] = {&random, &loops, &straight, &saved};
+        eval_jit->hot = 1;
+        for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) ok = jit_check(&ctx, corpora[i]);
+        for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) {
+            if (corpora[i]->count == 0) continue;
+            size_t interpreted = 0;
+            while (interpreted < b.count && strcmp(b.items[interpreted].corpus, corpora[i]->name) != 0) interpreted++;
+            bench_run(&b, "bf6-jit", corpora[i], bench_evaluate, &ctx);
+            bench_run(&b, "bf6-jit-compile", corpora[i], bench_evaluate_compile, &ctx);
+            double interpret_ns = b.items[interpreted].seconds*1e9/b.items[interpreted].evaluations;
+            double jit_ns = b.items[b.count - 2].seconds*1e9/b.items[b.count - 2].evaluations;
+            double compile_ns = b.items[b.count - 1].seconds*1e9/b.items[b.count - 1].evaluations - jit_ns;
+            if (jit_ns < interpret_ns) {
+                nob_log(NOB_INFO, "jit %-8s %8.0f ns interpreted, %8.0f ns compiled, %8.0f ns to compile, pays off after %.1f evaluations",
+                        corpora[i]->name, interpret_ns, jit_ns, compile_ns, compile_ns/(interpret_ns - jit_ns));
+            } else {
+                nob_log(NOB_INFO, "jit %-8s %8.0f ns interpreted, %8.0f ns compiled, never pays off",
+                        corpora[i]->name, interpret_ns, jit_ns);
+            }
+        }
+        jit_thread_end();
+    }
+    use_jit = false;
+
+    // bf6-norepeat runs every lap of a loop up to MAX_INST_COUNT,
+    // bf6-nostraight interprets the jump-free start of a tape too
+    const Bench_Corpus *corpora[] = {&random, &loops, &straight, &saved};
+    for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) {
+        ok = fast_path_check(&ctx, corpora[i], &use_repeat, "repeat") &&
+             fast_path_check(&ctx, corpora[i], &use_straight, "straight");
+    }
+    use_repeat = false;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) {
+        bench_run(&b, "bf6-norepeat", corpora[i], bench_evaluate, &ctx);
+    }
+    use_repeat = true;
+    use_straight = false;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) {
+        bench_run(&b, "bf6-nostraight", corpora[i], bench_evaluate, &ctx);
+    }
+    use_straight = true;
+
+    // bf6-memo evaluates every tape a second time, the first pass filled the memo
+    Memo memo = {0};
+    if (ok && memo_init(&memo, (size_t)BENCH_MEMO_MB << 20, MAX_TAPE_SIZE, COUNT, sizeof(Memo_Result))) {
+        for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) ok = memo_check(&ctx, &memo, corpora[i]);
+        eval_memo = &memo;
+        for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) {
+            bench_run(&b, "bf6-memo", corpora[i], bench_evaluate, &ctx);
+        }
+        eval_memo = NULL;
+        nob_log(NOB_INFO, "memo: %zu of %zu evaluations hit, %zu wipes",
+                atomic_load(&memo.hits), atomic_load(&memo.lookups), atomic_load(&memo.wipes));
+        memo_free(&memo);
+    }
     
+    ok = bench_write_json(&b, json_path) && ok;
+    nob_da_free(ctx.programs);
+    nob_da_free(b);
+    bench_corpus_free(&random);
+    bench_corpus_free(&loops);
+    bench_corpus_free(&straight);
+    bench_corpus_free(&saved);
+    return ok;
+}
 
 int main(int argc, char **argv) {
     
     const char *program_name = nob_shift(argv, argc);
     
-    srand(time(NULL));
     size_t do_search = DO_SEARCH;
-    size_t cycle_number = 0;
     size_t highest_cycle_number = 66;
     size_t highest_execution_number = 200;
     size_t cutoff_cycle_length = 30;
     size_t cutoff_sequence_length = 100;
     size_t cutoff_counter = 1;
+    size_t exemplars = HIST_EXEMPLARS;
+    size_t joint_exemplars = HIST2D_EXEMPLARS;
     size_t bfl = 6;
     size_t start_idx = 0;
+    size_t seed = time(NULL);
+    bool seed_given = false;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 0 ? (size_t)cpus : 1;
+    size_t report_interval = 10;
+    const char *stats_path = NULL;
+    const char *bench_path = NULL;
+    const char *bench_search_path = NULL;
+    size_t profile_rate = PROFILE_RATE;
+    const char *checkpoint_path = NULL;
+    size_t checkpoint_interval = CHECKPOINT_INTERVAL;
+    bool resume = false;
+    Nob_File_Paths merge_dirs = {0};
     Program* (*evaluate)(Programs *, Program *) = evaluate_bf6;
     
     char *file_name = NULL;
+    const char *scores_path = NULL;
+    size_t replicator_min = REPLICATOR_MIN;
+    size_t memo_mb = 0;
+    size_t basin_length = 0;
+    size_t dp_bits = 0;
+    size_t dp_max = DP_MAX_EX_NUMBER;
+    bool numa = false;
+    const char *lineage_path = NULL;
+    const char *cycles_path = NULL;
     
     while (argc > 0) {
         const char *flag = argv[0];
@@ -663,6 +2086,78 @@ int main(int argc, char **argv) {
         else if (strcmp(flag, "-s") == 0){
             if (!flag_int(&argc, &argv, &start_idx)) return 1;
         }
+        else if (strcmp(flag, "-j") == 0){
+            if (!flag_int(&argc, &argv, &threads)) return 1;
+            if (threads == 0) threads = 1;
+        }
+        else if (strcmp(flag, "-seed") == 0){
+            if (!flag_int(&argc, &argv, &seed)) return 1;
+            seed_given = true;
+        }
+        else if (strcmp(flag, "-k") == 0){
+            if (!flag_int(&argc, &argv, &exemplars)) return 1;
+        }
+        else if (strcmp(flag, "-bench") == 0) {
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
+            }
+            bench_path = nob_shift(argv, argc);
+        }
+        else if (strcmp(flag, "-bench-search") == 0) {
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
+            }
+            bench_search_path = nob_shift(argv, argc);
+        }
+        else if (strcmp(flag, "-prof") == 0){
+            if (!flag_int(&argc, &argv, &profile_rate)) return 1;
+        }
+        else if (strcmp(flag, "-kj") == 0){
+            if (!flag_int(&argc, &argv, &joint_exemplars)) return 1;
+        }
+        else if (strcmp(flag, "-ri") == 0){
+            if (!flag_int(&argc, &argv, &report_interval)) return 1;
+        }
+        else if (strcmp(flag, "-stats") == 0){
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
+            }
+            stats_path = nob_shift(argv, argc);
+        }
+        else if (strcmp(flag, "-ckpt") == 0){
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
+            }
+            checkpoint_path = nob_shift(argv, argc);
+        }
+        else if (strcmp(flag, "-ci") == 0){
+            if (!flag_int(&argc, &argv, &checkpoint_interval)) return 1;
+        }
+        else if (strcmp(flag, "-o") == 0){
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
+            }
+            output_dir = nob_shift(argv, argc);
+        }
+        else if (strcmp(flag, "-merge") == 0){
+            // every following argument up to the next flag is a shard output dir
+            nob_shift(argv, argc);
+            while (argc > 0 && argv[0][0] != '-') nob_da_append(&merge_dirs, nob_shift(argv, argc));
+        }
+        else if (strcmp(flag, "-resume") == 0){
+            nob_shift(argv, argc);
+            resume = true;
+        }
         else if (strcmp(flag, "-f") == 0){
             const char *flag = nob_shift(argv, argc);
             if ((argc) <= 0) {
@@ -671,149 +2166,355 @@ int main(int argc, char **argv) {
             }
             file_name = nob_shift(argv, argc);
         }
-        else {
-            break;
+        else if (strcmp(flag, "-jit") == 0){
+            nob_shift(argv, argc);
+            use_jit = true;
         }
-    }
-    HIST psls = {0};
-    hash_init(&psls, MAX_EX_NUMBER);
-    psls.as = PSL;
-    HIST pcls = {0};
-    hash_init(&pcls, MAX_EX_NUMBER);
-    pcls.as = PCL;
-    PKVs ht_pkv = {0};
-    hash_init(&ht_pkv, MAX_EX_NUMBER);
-        
-    if (file_name != NULL) {
-        nob_log(NOB_INFO, "Evaluating programs from file %s", file_name);
-
-        FILE *file = fopen(file_name, "r");
-        if (file == NULL) {
-            nob_log(NOB_ERROR, "Could not open file %s", file_name);
-            return 1;
+        else if (strcmp(flag, "-norepeat") == 0){
+            nob_shift(argv, argc);
+            use_repeat = false;
         }
-
-        char line[MAX_TAPE_SIZE*2];
-        while (fgets(line, sizeof(line), file)) {
-            Programs programs = {0};
-            PKVs ht_pkv = {0};
-            hash_init(&ht_pkv, MAX_EX_NUMBER);
-
-            Program init_p = {0};
-            size_t len = strlen(line);
-            if (len > 0 && line[len-1] == '\n') {
-                line[--len] = 0;
+        else if (strcmp(flag, "-nostraight") == 0){
+            nob_shift(argv, argc);
+            use_straight = false;
+        }
+        else if (strcmp(flag, "-hugetlb") == 0){
+            nob_shift(argv, argc);
+            bigmem_pages = BIGMEM_PAGES_HUGETLB;
+        }
+        else if (strcmp(flag, "-nohuge") == 0){
+            nob_shift(argv, argc);
+            bigmem_pages = BIGMEM_PAGES_SMALL;
+        }
+        else if (strcmp(flag, "-numa") == 0){
+            nob_shift(argv, argc);
+            numa = true;
+        }
+        else if (strcmp(flag, "-rep") == 0){
+            if (!flag_int(&argc, &argv, &replicator_min)) return 1;
+        }
+        else if (strcmp(flag, "-memo") == 0){
+            if (!flag_int(&argc, &argv, &memo_mb)) return 1;
+        }
+        else if (strcmp(flag, "-basin") == 0){
+            if (!flag_int(&argc, &argv, &basin_length)) return 1;
+        }
+        else if (strcmp(flag, "-dp") == 0){
+            if (!flag_int(&argc, &argv, &dp_bits)) return 1;
+            if (dp_bits > 32) {
+                nob_log(NOB_ERROR, "-dp takes at most 32 zero bits");
+                return 1;
             }
-
-            for (size_t i = 0; i < len && i < MAX_TAPE_SIZE; i++) {
-                for (int j = 0; j < COUNT; j++) {
-                    if (line[i] == ins_bf7[j][0]) {
-                        init_p.tape[i] = j;
-                        break;
-                    }
-                }
+        }
+        else if (strcmp(flag, "-dpmax") == 0){
+            if (!flag_int(&argc, &argv, &dp_max)) return 1;
+        }
+        else if (strcmp(flag, "-lineage") == 0){
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
             }
-            nob_log(NOB_INFO, "P:  %s", init_p.tape);
-
-            nob_da_append(&programs, init_p);
-            Program *p0 = &programs.items[0];
-            // print_program(p0);
-            size_t ex_number = 0;
-            while (ex_number < MAX_EX_NUMBER) {
-                p0 = evaluate(&programs, p0);
-                size_t index = p0 - programs.items;
-                cycle_number = add_to_hash(&ht_pkv, &programs, index);
-                if(cycle_number) break;
-                ++ex_number;
+            lineage_path = nob_shift(argv, argc);
+        }
+        else if (strcmp(flag, "-cycles") == 0){
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
             }
-
-            add_to_hist(&pcls, cycle_number, cutoff_cycle_length, &init_p);
-            add_to_hist(&psls, ex_number, cutoff_sequence_length, &init_p);
-
-            if (cycle_number >= highest_cycle_number) {
-                qsort(programs.items, programs.count, sizeof(programs.items[0]), compare_ex_nr);
-                write_programs_to_file(&programs, ex_number, cycle_number, bfl-1);
-                nob_log(NOB_INFO,"Cycle detected with size: %zu, after %zu program executions", cycle_number, programs.items[programs.count-1].ex_number);
-                highest_cycle_number = cycle_number;
+            cycles_path = nob_shift(argv, argc);
+        }
+        else if (strcmp(flag, "-scores") == 0){
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
             }
-            if (ex_number >= highest_execution_number) {
-                qsort(programs.items, programs.count, sizeof(programs.items[0]), compare_ex_nr);
-                write_programs_to_file(&programs, ex_number, cycle_number, bfl-1);
-                nob_log(NOB_INFO,"%zu unique program executions, cycle_size: %zu", ex_number, cycle_number);
-                highest_execution_number = ex_number;
+            scores_path = nob_shift(argv, argc);
+        }
+        else {
+            break;
+        }
+    }
+    if (bench_path != NULL) return run_benchmarks(bench_path) ? 0 : 1;
+    profile_set_rate(profile_rate);
+    Memo memo = {0};
+    if (memo_mb > 0) {
+        if (!memo_init(&memo, memo_mb << 20, MAX_TAPE_SIZE, COUNT, sizeof(Memo_Result))) return 1;
+        eval_memo = &memo;
+        if (use_jit) {
+            nob_log(NOB_INFO, "-jit is off with -memo, compiled tapes do not record the cells they read");
+            use_jit = false;
+        }
+    }
+    if (use_jit && use_repeat) {
+        nob_log(NOB_INFO, "-jit is off while repeated laps are skipped, compiled tapes run every lap, add -norepeat to use it");
+        use_jit = false;
+    }
+    if (use_jit && replicator_min > 0) {
+        nob_log(NOB_INFO, "replicator detection is off with -jit, compiled tapes do not track copies");
+        replicator_min = 0;
+    }
+    if (!nob_mkdir_if_not_exists(output_dir)) return 1;
+    char init_dir[300];
+    snprintf(init_dir, sizeof(init_dir), "%s/%s_init_programs", output_dir, _bfl_str[bfl-1]);
+    
+    // -f re-scores every line of a program file, one experiment per line
+    Program_File program_file = {0};
+    Score *scores = NULL;
+    if (file_name != NULL) {
+        if (!program_file_open(&program_file, file_name)) return 1;
+        start_idx = 0;
+        do_search = program_file.count;
+        scores = calloc(program_file.count + 1, sizeof(Score));
+        NOB_ASSERT(scores != NULL && "Buy more RAM lol");
+    }
+    
+    // -s runs experiments [start_idx, start_idx + do_search), shard processes get disjoint ranges
+    Search search = {
+        .start = start_idx,
+        .do_search = start_idx + do_search,
+        .seed = seed,
+        .seq_length = 48,
+        .bfl = bfl-1,
+        .evaluate = evaluate,
+        .next_experiment = start_idx,
+        .highest_cycle_number = highest_cycle_number,
+        .highest_execution_number = highest_execution_number,
+        .record_lock = PTHREAD_MUTEX_INITIALIZER,
+        .timed = bench_search_path != NULL,
+        .start_cycle_number = highest_cycle_number,
+        .start_execution_number = highest_execution_number,
+        .file = file_name != NULL ? &program_file : NULL,
+        .scores = scores,
+        .replicator_min = replicator_min,
+        .lineage_lock = PTHREAD_MUTEX_INITIALIZER,
+        .dp_bits = dp_bits,
+        .dp_max = dp_max,
+        .numa = numa,
+    };
+    char default_lineage_path[300];
+    snprintf(default_lineage_path, sizeof(default_lineage_path), "%s/%s_lineage.bin", output_dir, _bfl_str[bfl-1]);
+    search.lineage_path = lineage_path != NULL ? lineage_path : default_lineage_path;
+    size_t shards = threads;
+    
+    // checkpoints only cover the random search, and -bench-search should not leave one behind
+    char default_checkpoint_path[300];
+    snprintf(default_checkpoint_path, sizeof(default_checkpoint_path), "%s/%s_checkpoint.bin", output_dir, _bfl_str[bfl-1]);
+    if (checkpoint_path == NULL) checkpoint_path = default_checkpoint_path;
+    if (file_name != NULL || bench_search_path != NULL || merge_dirs.count > 0) checkpoint_interval = 0;
+    if (resume && checkpoint_interval == 0) {
+        nob_log(NOB_ERROR, "-resume needs a random search with checkpoints enabled");
+        return 1;
+    }
+    
+    // -resume loads our own checkpoint, -merge the final checkpoints of shard processes
+    Nob_File_Paths load_paths = {0};
+    if (resume) nob_da_append(&load_paths, checkpoint_path);
+    for (size_t i = 0; i < merge_dirs.count; ++i) {
+        nob_da_append(&load_paths, nob_temp_sprintf("%s/%s_checkpoint.bin", merge_dirs.items[i], _bfl_str[bfl-1]));
+    }
+    Nob_String_Builder *loaded = calloc(load_paths.count + 1, sizeof(Nob_String_Builder));
+    size_t loaded_shards = 0;
+    size_t resumed_at = start_idx;
+    for (size_t i = 0; i < load_paths.count; ++i) {
+        Checkpoint_Header header;
+        if (!nob_read_entire_file(load_paths.items[i], &loaded[i])) return 1;
+        if (!checkpoint_read_header(nob_sb_to_sv(loaded[i]), exemplars, joint_exemplars, &header)) return 1;
+        loaded_shards += header.shard_count;
+        if (header.highest_cycle_number > search.highest_cycle_number) search.highest_cycle_number = header.highest_cycle_number;
+        if (header.highest_execution_number > search.highest_execution_number) search.highest_execution_number = header.highest_execution_number;
+        if (resume) {
+            // without -seed the checkpoint's seed is taken, the range has to match though
+            if ((seed_given && header.seed != seed) || header.start != start_idx || header.end != start_idx + do_search) {
+                nob_log(NOB_ERROR, "%s covers experiments [%zu, %zu) with seed %zu, not [%zu, %zu) with seed %zu",
+                        load_paths.items[i], (size_t)header.start, (size_t)header.end, (size_t)header.seed,
+                        start_idx, start_idx + do_search, seed);
+                return 1;
             }
-
-            nob_da_free(programs);
-            nob_da_free(ht_pkv);
+            if (header.boundary < header.start || header.boundary > header.end) {
+                nob_log(NOB_ERROR, "%s is corrupted, boundary %zu lies outside [%zu, %zu)", load_paths.items[i],
+                        (size_t)header.boundary, (size_t)header.start, (size_t)header.end);
+                return 1;
+            }
+            nob_log(NOB_INFO, "resuming at experiment %zu of [%zu, %zu) (seed %zu)", (size_t)header.boundary,
+                    (size_t)header.start, (size_t)header.end, (size_t)header.seed);
+            seed = search.seed = header.seed;
+            search.next_experiment = resumed_at = header.boundary;
         }
-
-        fclose(file);
-
-        nob_log(NOB_INFO,"Cycle length histogram:");
-        print_histo(pcls);
-        nob_log(NOB_INFO,"Program execution sequence length histogram");
-        print_histo(psls);
-        dump_histo_to_file(&pcls, cutoff_cycle_length, cutoff_counter, bfl-1);
-        dump_histo_to_file(&psls, cutoff_sequence_length, cutoff_counter, bfl-1);
-        nob_da_free(pcls);
-        nob_da_free(psls);
-
+    }
+    size_t basin_threads = 0;
+    if (merge_dirs.count > 0) {
+        // nothing to run, the merged shards are printed and dumped like a finished search
+        search.do_search = 0;
+        threads = 0;
+        shards = loaded_shards;
+    } else if (basin_length > 0) {
+        // the graph replaces the workers, its histograms go into a single shard
+        search.do_search = 0;
+        basin_threads = threads;
+        threads = 0;
+        shards = 1;
+    } else if (loaded_shards > shards) {
+        shards = loaded_shards;
+    }
+    
+    if (!hist_init(&search.pcls, "cycle", shards, MAX_TAPE_SIZE, cutoff_cycle_length, exemplars)) return 1;
+    if (!hist_init(&search.psls, "seq", shards, MAX_TAPE_SIZE, cutoff_sequence_length, exemplars)) return 1;
+    if (!hist2d_init(&search.joint, shards, MAX_TAPE_SIZE, joint_exemplars)) return 1;
+    if (!cycles_init(&search.cycles, shards, MAX_TAPE_SIZE)) return 1;
+    search.shard_count = shards;
+    search.checkpoint = calloc(shards, sizeof(Checkpoint_Shard));
+    for (size_t i = threads; i < shards; ++i) search.checkpoint[i].done = true;
+    for (size_t i = 0, first = 0; i < load_paths.count; ++i) {
+        Checkpoint_Header header;
+        memcpy(&header, loaded[i].items, sizeof(header));
+        if (!checkpoint_read_shards(&search, nob_sb_to_sv(loaded[i]), first)) return 1;
+        first += header.shard_count;
+        nob_sb_free(loaded[i]);
+    }
+    free(loaded);
+    for (size_t i = 0; i < merge_dirs.count; ++i) {
+        if (!merge_records(merge_dirs.items[i], bfl-1)) return 1;
+    }
+    
+    char default_stats_path[300];
+    snprintf(default_stats_path, sizeof(default_stats_path), "%s/%s_stats.jsonl", output_dir, _bfl_str[bfl-1]);
+    Reporter reporter = {
+        .stats_path = stats_path != NULL ? stats_path : default_stats_path,
+        .interval = (double)report_interval,
+        // the range this process owns, -resume already has [start_idx, boundary) of it in the histograms
+        .total = merge_dirs.count == 0 ? do_search : 0,
+        .done = merge_dirs.count == 0 && resumed_at > start_idx ? resumed_at - start_idx : 0,
+    };
+    reporter_add_hist(&reporter, &search.pcls);
+    reporter_add_hist(&reporter, &search.psls);
+    reporter_add_value(&reporter, "highest_cycle_number", &search.highest_cycle_number);
+    reporter_add_value(&reporter, "highest_execution_number", &search.highest_execution_number);
+    reporter_add_value(&reporter, "replicator_hits", &search.replicator_hits);
+    reporter_add_value(&reporter, "distinct_cycles", &search.cycles.distinct);
+    if (eval_memo != NULL) {
+        reporter_add_value(&reporter, "memo_lookups", &memo.lookups);
+        reporter_add_value(&reporter, "memo_hits", &memo.hits);
+    }
+    if (!reporter_start(&reporter)) return 1;
+    char default_cycles_path[300];
+    snprintf(default_cycles_path, sizeof(default_cycles_path), "%s/%s_cycles.csv", output_dir, _bfl_str[bfl-1]);
+    if (cycles_path == NULL) cycles_path = default_cycles_path;
+        
+    if (merge_dirs.count > 0) {
+        nob_log(NOB_INFO, "Merged %zu experiments from %zu shard dirs into %s", (size_t)hist_total(&search.pcls), merge_dirs.count, output_dir);
+        if (!cycles_write(&search.cycles, cycles_path, ins_bf7, COUNT)) return 1;
+        nob_log(NOB_INFO, "%zu distinct cycles written to %s", atomic_load(&search.cycles.distinct), cycles_path);
+    } else if (basin_length > 0) {
+        if (!run_basin(&search, basin_length, basin_threads, bfl-1)) return 1;
     } else {
-        nob_log(NOB_INFO,"Starting Experiment...");
+        if (file_name != NULL) {
+            nob_log(NOB_INFO, "Evaluating %zu programs from file %s (%zu threads)", program_file.count, file_name, threads);
+        } else {
+            nob_log(NOB_INFO,"Starting Experiment... (seed %zu, %zu threads)", seed, threads);
+        }
         
-        while (do_search) {
-            if( do_search % 500000== 0){
-               nob_log(NOB_INFO,"Cycle length histogram:");
-               print_histo(pcls);
-               nob_log(NOB_INFO,"Program execution sequence length histogram");
-               print_histo(psls);
-               nob_log(NOB_INFO, "experiments: %zu", DO_SEARCH - do_search);
-            }
-            Programs programs = {0};
-            size_t ex_number = 0;
-            Program *p0 = generate_random_program(&programs, 48); //(start_idx + DO_SEARCH) - do_search
-            Program init_p = *p0;
-            while (ex_number < MAX_EX_NUMBER) { 
-                p0 = evaluate(&programs, p0);
-                size_t index = p0 - programs.items;
-                cycle_number = add_to_hash(&ht_pkv, &programs, index);
-                if(cycle_number) break;
-                ++ex_number;
+        if (search.replicator_min > 0 && !lineage_open(&search, resumed_at, resume)) return 1;
+        double start_seconds = bench_seconds();
+        u64 start_ticks = bench_ticks();
+        int misses = bench_search_path != NULL ? bench_cache_misses_start() : -1;
+        Worker *workers = calloc(threads, sizeof(Worker));
+        for (size_t i = 0; i < threads; ++i) {
+            workers[i].search = &search;
+            workers[i].id = i;
+            if (pthread_create(&workers[i].thread, NULL, search_worker, &workers[i]) != 0) {
+                nob_log(NOB_ERROR, "Could not start worker %zu", i);
+                return 1;
             }
-            hash_reset(&ht_pkv);
-            add_to_hist(&pcls, cycle_number, cutoff_cycle_length, &init_p);
-            add_to_hist(&psls, ex_number, cutoff_sequence_length, &init_p);
-            // nob_log(NOB_INFO, "p%zu: %zu-%zu", DO_SEARCH - do_search, cycle_number, ex_number);
-            // write_programs_to_file(&programs, ex_number, cycle_number, bfl-1, DO_SEARCH - do_search);
-            if (cycle_number > highest_cycle_number) {
-                qsort(programs.items, programs.count, sizeof(programs.items[0]), compare_ex_nr);
-                // print_programs(programs);
-                write_programs_to_file(&programs, ex_number, cycle_number, bfl-1);
-                nob_log(NOB_INFO,"Cycle detected with size: %zu, after %zu program executions", cycle_number, programs.items[programs.count-1].ex_number);
-                highest_cycle_number = cycle_number;
-            }
-            if (ex_number > highest_execution_number) {
-                qsort(programs.items, programs.count, sizeof(programs.items[0]), compare_ex_nr);
-                // print_programs(programs);
-                write_programs_to_file(&programs, ex_number, cycle_number, bfl-1);
-                nob_log(NOB_INFO,"%zu unique program executions, cycle_size: %zu", ex_number, cycle_number);
-                highest_execution_number = ex_number;
+        }
+        if (checkpoint_interval > 0) {
+            double last = bench_seconds();
+            for (bool running = true; running;) {
+                nanosleep(&(struct timespec){.tv_nsec = 100000000}, NULL);
+                running = false;
+                for (size_t i = 0; i < threads; ++i) running = running || !atomic_load(&search.checkpoint[i].done);
+                if (running && bench_seconds() - last >= checkpoint_interval) {
+                    checkpoint_write(&search, checkpoint_path);
+                    last = bench_seconds();
+                }
             }
-            nob_da_free(programs);
-            --do_search;
-        }
-        nob_log(NOB_INFO,"Cycle length histogram:");
-        print_histo(pcls);
-        nob_log(NOB_INFO,"Program execution sequence length histogram");
-        print_histo(psls);
-        dump_histo_to_file(&pcls, cutoff_cycle_length, cutoff_counter, bfl-1);
-        dump_histo_to_file(&psls, cutoff_sequence_length, cutoff_counter, bfl-1);
-        nob_da_free(pcls);
-        nob_da_free(psls);
-        nob_da_free(ht_pkv);
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        u64 cache_misses = bench_cache_misses_stop(misses);
+        free(workers);
+        if (file_name != NULL) record_file_trajectories(&search);
+        if (numa || bigmem_pages == BIGMEM_PAGES_HUGETLB) {
+            nob_log(NOB_INFO, "bigmem: %zu blocks mapped, %zu on reserved huge pages, %zu bound to their node (%zu nodes)",
+                    atomic_load(&bigmem_maps), atomic_load(&bigmem_hugetlb_maps), atomic_load(&bigmem_bound_maps),
+                    bigmem_node_count());
+        }
+        if (use_jit) {
+            nob_log(NOB_INFO, "jit: %zu of %zu evaluations ran compiled code, %zu compiles, %zu flushes",
+                    (size_t)jit_runs, (size_t)jit_lookups, (size_t)jit_compiles, (size_t)jit_flushes);
+        }
+        if (eval_memo != NULL) {
+            size_t lookups = atomic_load(&memo.lookups), hits = atomic_load(&memo.hits);
+            nob_log(NOB_INFO, "memo: %zu of %zu evaluations hit (%.1f%%), %zu results stored, %zu wipes of %zu MB",
+                    hits, lookups, lookups > 0 ? 100.0*hits/lookups : 0.0,
+                    atomic_load(&memo.inserts), atomic_load(&memo.wipes), memo_mb);
+        }
+        if (search.lineage != NULL) {
+            fclose(search.lineage);
+            nob_log(NOB_INFO, "%zu replicator hits appended to %s", atomic_load(&search.replicator_hits), search.lineage_path);
+        }
+        if (!cycles_write(&search.cycles, cycles_path, ins_bf7, COUNT)) return 1;
+        nob_log(NOB_INFO, "%zu distinct cycles written to %s", atomic_load(&search.cycles.distinct), cycles_path);
+        if (checkpoint_interval > 0) checkpoint_write(&search, checkpoint_path);
+        if (file_name != NULL) {
+            char default_scores_path[300];
+            snprintf(default_scores_path, sizeof(default_scores_path), "%s/%s_scores.csv", output_dir, _bfl_str[bfl-1]);
+            bool ok = write_scores(scores_path != NULL ? scores_path : default_scores_path, &program_file, scores);
+            free(scores);
+            program_file_close(&program_file);
+            if (!ok) return 1;
+        }
         
+        if (bench_search_path != NULL) {
+            Bench_Pipeline pipeline = {
+                .driver = "detect_cycles",
+                .experiments = do_search,
+                .threads = threads,
+                .seed = seed,
+                .seconds = bench_seconds() - start_seconds,
+                .stage_count = STAGE_COUNT,
+                .peak_rss_kb = bench_peak_rss_kb(),
+                .steps = atomic_load(&search.steps),
+                .cache_misses = cache_misses,
+            };
+            pipeline.ticks_per_second = (bench_ticks() - start_ticks)/pipeline.seconds;
+            for (size_t i = 0; i < STAGE_COUNT; ++i) {
+                pipeline.stages[i] = (Bench_Stage){stage_names[i], atomic_load(&search.stage_ticks[i])};
+            }
+            reporter_stop(&reporter);
+            bench_pipeline_log(&pipeline);
+            return bench_pipeline_write_json(&pipeline, bench_search_path) ? 0 : 1;
+        }
     }
+    reporter_stop(&reporter);
     
-    
-    
+    nob_log(NOB_INFO,"Cycle length histogram:");
+    hist_print(&search.pcls);
+    nob_log(NOB_INFO,"Program execution sequence length histogram");
+    hist_print(&search.psls);
+    hist_dump_exemplars(&search.pcls, init_dir, cutoff_counter, ins_bf7, COUNT);
+    hist_dump_exemplars(&search.psls, init_dir, cutoff_counter, ins_bf7, COUNT);
+    hist2d_dump(&search.joint, nob_temp_sprintf("%s/joint.bin", init_dir), nob_temp_sprintf("%s/joint.csv", init_dir));
+#ifdef PROFILE
+    profile_dump(nob_temp_sprintf("%s/profile.txt", init_dir), ins_bf7, COUNT);
+#endif
+    hist_free(&search.pcls);
+    hist_free(&search.psls);
+    hist2d_free(&search.joint);
+    cycles_free(&search.cycles);
+    memo_free(&memo);
+    return 0;
 }
@@ -5,11 +5,16 @@
 #include <assert.h>
 #define NOB_IMPLEMENTATION
 #include "nob.h"
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 #define MIN_PROGRAM_SIZE 64
 #define MAX_TAPE_SIZE 256
 #define MAX_INST_COUNT 12800
+
+// Instructions executed by the last evaluate_bfN call on this thread
+static _Thread_local size_t eval_steps = 0;
 #define u8 uint8_t
 #define u64 uint64_t
 
@@ -194,6 +199,7 @@ Program *evaluate_test(Programs *programs, Program *source) {
         result.tape[ins_head] = source->tape[ins_head];
         ++ins_head;
     }
+    eval_steps = ins_count;
     nob_da_append(programs, result);
     return &programs->items[programs->count-1];
 }
@@ -277,6 +283,7 @@ Program *evaluate_bf1(Programs *programs, Program *source) {
         ins_count++;
     }
     
+    eval_steps = ins_count;
     nob_da_append(programs, result);
 
     return &programs->items[programs->count-1];
@@ -361,6 +368,7 @@ Program *evaluate_bf2(Programs *programs, Program *source) {
         if (ins_head > MAX_TAPE_SIZE) break;
     }
     
+    eval_steps = ins_count;
     nob_da_append(programs, result);
 
     return &programs->items[programs->count-1];
@@ -465,6 +473,7 @@ Program *evaluate_bf3(Programs *programs, Program *source) {
         if(ins_head > MAX_TAPE_SIZE) break;
     }
     
+    eval_steps = ins_count;
     nob_da_append(programs, result);
 
     return &programs->items[programs->count-1];
@@ -549,6 +558,7 @@ Program *evaluate_bf4(Programs *programs, Program *source) {
         if(ins_head > MAX_TAPE_SIZE) break;
     }
     
+    eval_steps = ins_count;
     nob_da_append(programs, result);
 
     return &programs->items[programs->count-1];
@@ -635,6 +645,7 @@ Program *evaluate_bf5(Programs *programs, Program *source) {
     }
    
     
+    eval_steps = ins_count;
     nob_da_append(programs, result);
 
     return &programs->items[programs->count-1];
@@ -704,6 +715,64 @@ bool flag_int(int *argc, char ***argv, size_t *value)
 
 
 
+/*
+Benchmarks
+*/
+
+typedef struct {
+    Program* (*evaluate)(Programs *, Program *);
+    Programs programs;
+} Bench_Ctx;
+
+size_t bench_evaluate(void *ctx, const u8 *tape, size_t *executed) {
+    Bench_Ctx *b = ctx;
+    b->programs.count = 0;
+    Program p = {0};
+    memcpy(p.tape, tape, MAX_TAPE_SIZE);
+    nob_da_append(&b->programs, p);
+    b->evaluate(&b->programs, &b->programs.items[0]);
+    // no lap skipping here, every step runs
+    *executed = eval_steps;
+    return eval_steps;
+}
+
+bool run_benchmarks(const char *json_path) {
+    Bench b = {.driver = "detect_cycles_bf45"};
+    Bench_Corpus random = {0}, loops = {0}, bf4 = {0}, bf5 = {0};
+    bench_corpus_random(&random, BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, COUNT, BENCH_SEED);
+    bench_corpus_loops(&loops, BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, COUNT, INS_JMP_LEFT, INS_JMP_RIGHT, BENCH_SEED);
+    bench_corpus_from_dir(&bf4, "./bf4_programs", BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, ins_bf1, COUNT);
+    bench_corpus_from_dir(&bf5, "./bf5_programs", BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, ins_bf1, COUNT);
+    
+    struct {
+        const char *name;
+        Program* (*evaluate)(Programs *, Program *);
+        Bench_Corpus *saved;
+    } kernels[] = {
+        {"bf1", evaluate_bf1, NULL},
+        {"bf2", evaluate_bf2, NULL},
+        {"bf3", evaluate_bf3, NULL},
+        {"bf4", evaluate_bf4, &bf4},
+        {"bf5", evaluate_bf5, &bf5},
+    };
+    Bench_Ctx ctx = {0};
+    for (size_t i = 0; i < NOB_ARRAY_LEN(kernels); ++i) {
+        ctx.evaluate = kernels[i].evaluate;
+        bench_run(&b, kernels[i].name, &random, bench_evaluate, &ctx);
+        bench_run(&b, kernels[i].name, &loops, bench_evaluate, &ctx);
+        if (kernels[i].saved) bench_run(&b, kernels[i].name, kernels[i].saved, bench_evaluate, &ctx);
+    }
+    
+    bool ok = bench_write_json(&b, json_path);
+    nob_da_free(ctx.programs);
+    nob_da_free(b);
+    bench_corpus_free(&random);
+    bench_corpus_free(&loops);
+    bench_corpus_free(&bf4);
+    bench_corpus_free(&bf5);
+    return ok;
+}
+
 int main(int argc, char **argv) {
     
     const char *program_name = nob_shift(argv, argc);
@@ -715,6 +784,7 @@ int main(int argc, char **argv) {
     size_t highest_execution_number = 50;
     size_t bfl = 5;
     Program* (*evaluate)(Programs *, Program *) = evaluate_bf5;
+    const char *bench_path = NULL;
     
     while (argc > 0) {
         const char *flag = argv[0];
@@ -729,10 +799,19 @@ int main(int argc, char **argv) {
         }
         else if (strcmp(flag, "-bfl") == 0) {
             if (!flag_int(&argc, &argv, &bfl)) return 1;
+        }
+        else if (strcmp(flag, "-bench") == 0) {
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
+            }
+            bench_path = nob_shift(argv, argc);
         } else {
             break;
         }
     }
+    if (bench_path != NULL) return run_benchmarks(bench_path) ? 0 : 1;
     
     switch (bfl - 1) {
         case BFL1:
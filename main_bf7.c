@@ -5,6 +5,10 @@
 #include <time.h>
 #define NOB_IMPLEMENTATION
 #include "nob.h"
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#define REPEAT_IMPLEMENTATION
+#include "repeat.h"
 
 #define u8 uint8_t
 #define u64 uint64_t
@@ -12,6 +16,15 @@
 #define MAX_TAPE_SIZE 256
 #define MAX_INST_COUNT 25600
 
+// evaluate_bf7 skips whole laps of a loop once its state repeats, -norepeat turns it off
+static bool use_repeat = true;
+static Repeat eval_repeat = {0};
+
+// Instructions executed by the last evaluate_bfN call on this thread
+static _Thread_local size_t eval_steps = 0;
+// Of those the ones that actually ran, skipped laps don't
+static _Thread_local size_t eval_executed = 0;
+
 typedef struct {
     u8 tape[MAX_TAPE_SIZE];
     size_t ex_number;
@@ -129,28 +142,6 @@ typedef struct {
     size_t capacity;
 }PKVs;
 
-typedef struct {
-    size_t index;
-    size_t count;
-} PSL; // Program Sequence Length
-
-typedef struct {
-    PSL *items;
-    size_t count;
-    size_t capacity;
-} PSLs; // Program Sequence Length Hash Table
-
-typedef struct {
-    size_t index;
-    size_t count;
-} PCL; // Program Cycle Length
-
-typedef struct {
-    PCL *items;
-    size_t count;
-    size_t capacity;
-} PCLs; // Program Cycle Length Hash Table
-
 #define hash_init(ht, cap) \
     do { \
             (ht)->items = malloc(sizeof(*(ht)->items)*(cap)); \
@@ -211,41 +202,6 @@ size_t add_to_hash(PKVs *ht,Programs *programs, size_t program_index) {
     return 0;
 }
 
-#define add_to_da(da, index)  \
-    do { \
-        for (size_t i = 0; i < (da)->count; **i) { \
-            if ((da)->items[i].index == (index)) { \
-                (da)->items[i].count = (da)->items[i].count + 1;\
-                break; \
-            } else {\
-                nob_da_append(((da), (((PSL)){.index = (index), .count = 0})));\
-            }\
-        }\
-    } while(0)
-
-int compare_index(const void *a, const void *b) {
-    const PSL *ap = a;
-    const PSL *bp = b;    
-    return (int)ap->index - (int)bp->index;
-}
-    
-#define print_da(da) \
-    do { \
-        qsort(((da).items, (da).count, sizeof((da).items[0]), compare_index)); \
-        for (size_t i = 0; i < (da)->count; **i) { \
-            printf("%zu: %zu", (da)->items.index, (da)->items.count);\
-        } \
-    } while(0) \
-
-bool test_ad_add() {
-    PSL psls = {0};
-    for (size_t i = 0; i < 10; ++i) {
-        add_to_da(&psls, i);
-    }
-    print_da(psls);
-    return true;
-}
-
 #define MAX_EX_NUMBER 50000
 #define DO_SEARCH 100000000
 
@@ -325,8 +281,19 @@ Program *evaluate_bf7(Programs *programs, Program *source) {
     Program result = {0};
     result.ex_number = source->ex_number + 1;
     memcpy(result.tape, source->tape, MAX_TAPE_SIZE * sizeof(u8));
+    // The tape also holds the program, so a repeated (heads, directions, write)
+    // state alone doesn't mean a loop. States are recorded where the instruction
+    // head turns around, which every loop has to do. A repeat gives a candidate
+    // lap, it's taken when state and tape are the same again one lap later, then
+    // the remaining whole laps are skipped and the last partial lap is run.
+    bool repeat = use_repeat;
+    size_t lap = 0, lap_end = 0, skipped = 0;
+    u64 lap_state = 0;
+    u8 lap_tape[MAX_TAPE_SIZE];
+    if (repeat) repeat_begin(&eval_repeat);
     while (ins_count < MAX_INST_COUNT) {
         if (ins_head >= MAX_TAPE_SIZE) break;
+        int prev_insh_d = insh_d;
         BF6 instruction = result.tape[ins_head];
         if (instruction >= COUNT ){
             nob_log(NOB_ERROR, "IMPOSSIBLE INSTRUCTION %d at %d", instruction, ins_head);
@@ -390,13 +357,108 @@ Program *evaluate_bf7(Programs *programs, Program *source) {
         
         ins_count++;
         if(ins_head > MAX_TAPE_SIZE || ins_head < 0) break;
+        if (repeat && (insh_d != prev_insh_d || ins_count == lap_end) && ins_head < MAX_TAPE_SIZE) {
+            u64 state = ((((u64)ins_head*MAX_TAPE_SIZE + read_head)*MAX_TAPE_SIZE + write_head)*8 +
+                         (readh_d > 0)*4 + (writeh_d > 0)*2 + (insh_d > 0))*3 + (write + 1);
+            if (lap > 0 && ins_count == lap_end) {
+                if (state != lap_state) {
+                    lap = 0;
+                } else if (memcmp(result.tape, lap_tape, MAX_TAPE_SIZE) == 0) {
+                    skipped = (MAX_INST_COUNT - ins_count)/lap*lap;
+                    ins_count += skipped;
+                    repeat = false;
+                } else {
+                    // the loop rewrote part of itself, wait another lap
+                    lap_end += lap;
+                    memcpy(lap_tape, result.tape, MAX_TAPE_SIZE);
+                }
+            } else if (lap == 0 && insh_d != prev_insh_d) {
+                size_t seen = repeat_visit(&eval_repeat, state, ins_count);
+                if (seen != REPEAT_NONE) {
+                    lap = ins_count - seen;
+                    lap_end = ins_count + lap;
+                    lap_state = state;
+                    memcpy(lap_tape, result.tape, MAX_TAPE_SIZE);
+                }
+            }
+        }
     }
+    eval_steps = ins_count;
+    eval_executed = ins_count - skipped;
     nob_da_append(programs, result);
     return &programs->items[programs->count-1];
 }
 
 
 
+/*
+Benchmarks
+*/
+
+typedef struct {
+    Program* (*evaluate)(Programs *, Program *);
+    Programs programs;
+} Bench_Ctx;
+
+size_t bench_evaluate(void *ctx, const u8 *tape, size_t *executed) {
+    Bench_Ctx *b = ctx;
+    b->programs.count = 0;
+    Program p = {0};
+    memcpy(p.tape, tape, MAX_TAPE_SIZE);
+    nob_da_append(&b->programs, p);
+    b->evaluate(&b->programs, &b->programs.items[0]);
+    if (executed != NULL) *executed = eval_executed;
+    return eval_steps;
+}
+
+// Skipping repeated laps has to leave the same tape after the same number of steps
+bool repeat_check(Bench_Ctx *ctx, const Bench_Corpus *c) {
+    for (size_t i = 0; i < c->count; ++i) {
+        const u8 *tape = &c->items[i*MAX_TAPE_SIZE];
+        use_repeat = false;
+        size_t steps = bench_evaluate(ctx, tape, NULL);
+        Program expected = ctx->programs.items[1];
+        use_repeat = true;
+        if (bench_evaluate(ctx, tape, NULL) != steps ||
+            memcmp(expected.tape, ctx->programs.items[1].tape, MAX_TAPE_SIZE) != 0) {
+            nob_log(NOB_ERROR, "repeat: tape %zu of the %s corpus differs without skipping", i, c->name);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool run_benchmarks(const char *json_path) {
+    Bench b = {.driver = "detect_cycles_bf7"};
+    Bench_Corpus random = {0}, loops = {0}, saved = {0};
+    bench_corpus_random(&random, BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, COUNT, BENCH_SEED);
+    bench_corpus_loops(&loops, BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, COUNT, MIL, MIR, BENCH_SEED);
+    bench_corpus_from_dir(&saved, "./bf7_programs", BENCH_CORPUS_SIZE, MAX_TAPE_SIZE, ins_bf7, COUNT);
+    
+    Bench_Ctx ctx = {.evaluate = evaluate_bf7};
+    bench_run(&b, "bf7", &random, bench_evaluate, &ctx);
+    bench_run(&b, "bf7", &loops, bench_evaluate, &ctx);
+    bench_run(&b, "bf7", &saved, bench_evaluate, &ctx);
+
+    // bf7-norepeat runs every lap of a loop up to MAX_INST_COUNT
+    const Bench_Corpus *corpora[] = {&random, &loops, &saved};
+    bool ok = true;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) ok = repeat_check(&ctx, corpora[i]);
+    use_repeat = false;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(corpora) && ok; ++i) {
+        bench_run(&b, "bf7-norepeat", corpora[i], bench_evaluate, &ctx);
+    }
+    use_repeat = true;
+
+    ok = bench_write_json(&b, json_path) && ok;
+    nob_da_free(ctx.programs);
+    nob_da_free(b);
+    bench_corpus_free(&random);
+    bench_corpus_free(&loops);
+    bench_corpus_free(&saved);
+    return ok;
+}
+
 int main(int argc, char **argv) {
     
     const char *program_name = nob_shift(argv, argc);
@@ -408,6 +470,7 @@ int main(int argc, char **argv) {
     size_t highest_execution_number = 1;
     size_t bfl = 7;
     Program* (*evaluate)(Programs *, Program *) = evaluate_bf7;
+    const char *bench_path = NULL;
     
     while (argc > 0) {
         const char *flag = argv[0];
@@ -419,10 +482,23 @@ int main(int argc, char **argv) {
         }
         else if (strcmp(flag, "-he") == 0) {
             if (!flag_int(&argc, &argv, &highest_execution_number)) return 1;
+        }
+        else if (strcmp(flag, "-norepeat") == 0) {
+            nob_shift(argv, argc);
+            use_repeat = false;
+        }
+        else if (strcmp(flag, "-bench") == 0) {
+            const char *flag = nob_shift(argv, argc);
+            if ((argc) <= 0) {
+                nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+                return 1;
+            }
+            bench_path = nob_shift(argv, argc);
         } else {
             break;
         }
     }
+    if (bench_path != NULL) return run_benchmarks(bench_path) ? 0 : 1;
         
     while (do_search) {
         if( do_search % 10000== 0){
@@ -5,6 +5,16 @@
 #include <time.h>
 #define NOB_IMPLEMENTATION
 #include "nob.h"
+#define COUNTERS_IMPLEMENTATION
+#include "counters.h"
+#define HIST_IMPLEMENTATION
+#include "hist.h"
+#define REPORT_IMPLEMENTATION
+#include "report.h"
+#define PROFILE_IMPLEMENTATION
+#include "profile.h"
+#define REPEAT_IMPLEMENTATION
+#include "repeat.h"
 
 #define u8 uint8_t
 #define u64 uint64_t
@@ -12,6 +22,10 @@
 #define MAX_TAPE_SIZE 256
 #define MAX_INST_COUNT 25600
 
+// evaluate_bf7 skips whole laps of a loop once its state repeats, -norepeat turns it off
+static bool use_repeat = true;
+static Repeat eval_repeat = {0};
+
 typedef struct {
     u8 tape[MAX_TAPE_SIZE];
     size_t ex_number;
@@ -129,28 +143,6 @@ typedef struct {
     size_t capacity;
 }PKVs;
 
-typedef struct {
-    size_t index;
-    size_t count;
-} PSL; // Program Sequence Length
-
-typedef struct {
-    PSL *items;
-    size_t count;
-    size_t capacity;
-} PSLs; // Program Sequence Length Hash Table
-
-typedef struct {
-    size_t index;
-    size_t count;
-} PCL; // Program Cycle Length
-
-typedef struct {
-    PCL *items;
-    size_t count;
-    size_t capacity;
-} PCLs; // Program Cycle Length Hash Table
-
 #define hash_init(ht, cap) \
     do { \
             (ht)->items = malloc(sizeof(*(ht)->items)*(cap)); \
@@ -211,57 +203,6 @@ size_t add_to_hash(PKVs *ht,Programs *programs, size_t program_index) {
     return 0;
 }
 
-#define add_to_da(da, idx, type)  \
-    do { \
-        bool found = false; \
-        size_t index_to_add = (idx); \
-        for (size_t i = 0; i < (da).count; ++i) { \
-            if ((da).items[i].index == index_to_add) { \
-                (da).items[i].count++; \
-                found = true; \
-                break; \
-            } \
-        } \
-        if (!found) { \
-            type new_item = {.index = index_to_add, .count = 1}; \
-            nob_da_append(&(da), new_item); \
-        } \
-    } while(0)
-    
-    
-int compare_index(const void *a, const void *b) {
-    const PSL *ap = a;
-    const PSL *bp = b;    
-    return (int)ap->index - (int)bp->index;
-}
-    
-#define print_da(da) \
-    do { \
-        qsort((da).items, (da).count, sizeof((da).items[0]), compare_index); \
-        for (size_t i = 0; i < (da).count; ++i) { \
-            printf("%zu: %zu\n", (da).items[i].index, (da).items[i].count);\
-        } \
-    } while(0)
-
-// bool test_ad_add() {
-//     PSLs psls = {0};
-//     psls.items = NULL;
-//     psls.count = 0;
-//     psls.capacity = 0;
-    
-//     for (size_t i = 0; i < 10; ++i) {
-//         add_to_da(psls, i);
-//         for (size_t j = 0; j < 20; ++j) {
-//             add_to_da(psls, j);
-//         }
-        
-//     }
-//     print_da(psls);
-    
-//     nob_da_free(psls);
-//     return true;
-// }
-
 #define MAX_EX_NUMBER 50000
 #define DO_SEARCH 10000000
 
@@ -337,17 +278,30 @@ Program *evaluate_bf7(Programs *programs, Program *source) {
     int write = 0;
     
     size_t ins_count = 0;
+    PROFILE_BEGIN(prof);
     
     Program result = {0};
     result.ex_number = source->ex_number + 1;
     memcpy(result.tape, source->tape, MAX_TAPE_SIZE * sizeof(u8));
+    // The tape also holds the program, so a repeated (heads, directions, write)
+    // state alone doesn't mean a loop. States are recorded where the instruction
+    // head turns around, which every loop has to do. A repeat gives a candidate
+    // lap, it's taken when state and tape are the same again one lap later, then
+    // the remaining whole laps are skipped and the last partial lap is run.
+    bool repeat = use_repeat;
+    size_t lap = 0, lap_end = 0;
+    u64 lap_state = 0;
+    u8 lap_tape[MAX_TAPE_SIZE];
+    if (repeat) repeat_begin(&eval_repeat);
     while (ins_count < MAX_INST_COUNT) {
         if (ins_head >= MAX_TAPE_SIZE) break;
+        int prev_insh_d = insh_d;
         BF6 instruction = result.tape[ins_head];
         if (instruction >= COUNT ){
             nob_log(NOB_ERROR, "IMPOSSIBLE INSTRUCTION %d at %d", instruction, ins_head);
             exit(1);
         }
+        PROFILE_OP(prof, instruction, read_head, write_head);
         switch (instruction) {
             case O:{
                 break;
@@ -369,10 +323,13 @@ Program *evaluate_bf7(Programs *programs, Program *source) {
                 break; 
             }                             
             case MIL:{
+                // taken when the instruction head actually turns around
+                PROFILE_BRANCH(prof, MIL, insh_d != -1, 0);
                 insh_d = -1;
                 break;
             }
             case MIR:{
+                PROFILE_BRANCH(prof, MIR, insh_d != 1, 0);
                 insh_d = 1;
                 break;
             }
@@ -406,7 +363,35 @@ Program *evaluate_bf7(Programs *programs, Program *source) {
         
         ins_count++;
         if(ins_head > MAX_TAPE_SIZE || ins_head < 0) break;
+        if (repeat && (insh_d != prev_insh_d || ins_count == lap_end) && ins_head < MAX_TAPE_SIZE) {
+            u64 state = ((((u64)ins_head*MAX_TAPE_SIZE + read_head)*MAX_TAPE_SIZE + write_head)*8 +
+                         (readh_d > 0)*4 + (writeh_d > 0)*2 + (insh_d > 0))*3 + (write + 1);
+            if (lap > 0 && ins_count == lap_end) {
+                if (state != lap_state) {
+                    lap = 0;
+                } else if (memcmp(result.tape, lap_tape, MAX_TAPE_SIZE) == 0) {
+                    size_t skipped = (MAX_INST_COUNT - ins_count)/lap*lap;
+                    ins_count += skipped;
+                    repeat = false;
+                    COUNTER_ADD(C_REPEATS, 1);
+                    COUNTER_ADD(C_REPEAT_SKIPPED, skipped);
+                } else {
+                    // the loop rewrote part of itself, wait another lap
+                    lap_end += lap;
+                    memcpy(lap_tape, result.tape, MAX_TAPE_SIZE);
+                }
+            } else if (lap == 0 && insh_d != prev_insh_d) {
+                size_t seen = repeat_visit(&eval_repeat, state, ins_count);
+                if (seen != REPEAT_NONE) {
+                    lap = ins_count - seen;
+                    lap_end = ins_count + lap;
+                    lap_state = state;
+                    memcpy(lap_tape, result.tape, MAX_TAPE_SIZE);
+                }
+            }
+        }
     }
+    PROFILE_END(prof);
     nob_da_append(programs, result);
     return &programs->items[programs->count-1];
 }
@@ -423,6 +408,7 @@ int main(int argc, char **argv) {
     size_t highest_cycle_number = 0;
     size_t highest_execution_number = 1;
     size_t bfl = 7;
+    size_t profile_rate = PROFILE_RATE;
     Program* (*evaluate)(Programs *, Program *) = evaluate_bf7;
     
     while (argc > 0) {
@@ -435,21 +421,39 @@ int main(int argc, char **argv) {
         }
         else if (strcmp(flag, "-he") == 0) {
             if (!flag_int(&argc, &argv, &highest_execution_number)) return 1;
+        }
+        else if (strcmp(flag, "-norepeat") == 0) {
+            nob_shift(argv, argc);
+            use_repeat = false;
+        }
+        else if (strcmp(flag, "-prof") == 0) {
+            if (!flag_int(&argc, &argv, &profile_rate)) return 1;
         } else {
             break;
         }
     }
-    PSLs psls = {0};
-    PCLs pcls = {0};
+    profile_set_rate(profile_rate);
+    Hist psls = {0};
+    Hist pcls = {0};
+    if (!hist_init(&pcls, "cycle", 1, MAX_TAPE_SIZE, 0, 0)) return 1;
+    if (!hist_init(&psls, "seq", 1, MAX_TAPE_SIZE, 0, 0)) return 1;
+    
+    // copies of the records the reporter thread may read
+    _Atomic size_t reported_cycle_number = highest_cycle_number;
+    _Atomic size_t reported_execution_number = highest_execution_number;
+    Reporter reporter = {
+        .stats_path = "./bf7_stats.jsonl",
+        .interval = 10,
+        .total = do_search,
+    };
+    reporter_add_hist(&reporter, &pcls);
+    reporter_add_hist(&reporter, &psls);
+    reporter_add_value(&reporter, "highest_cycle_number", &reported_cycle_number);
+    reporter_add_value(&reporter, "highest_execution_number", &reported_execution_number);
+    if (!reporter_start(&reporter)) return 1;
+    
     nob_log(NOB_INFO,"Starting Experiment...");    
     while (do_search) {
-        if( do_search % 1000000== 0){
-           nob_log(NOB_INFO,"Cycle length histogram:");
-           print_da(pcls);
-           nob_log(NOB_INFO,"Program execution sequence length histogram");
-           print_da(psls);
-           nob_log(NOB_INFO, "experiments: %zu", DO_SEARCH - do_search);
-        }
         Programs programs = {0};
         PKVs ht_pkv = {0};
         hash_init(&ht_pkv, MAX_EX_NUMBER);
@@ -463,14 +467,15 @@ int main(int argc, char **argv) {
             if(cycle_number) break;
             ++ex_number;
         }
-        add_to_da(pcls, cycle_number, PCL);
-        add_to_da(psls, ex_number, PSL);
+        hist_add(&pcls, 0, cycle_number, NULL, 0);
+        hist_add(&psls, 0, ex_number, NULL, 0);
         if (cycle_number > highest_cycle_number) {
             qsort(programs.items, programs.count, sizeof(programs.items[0]), compare_ex_nr);
             // print_programs(programs);
             write_programs_to_file(&programs, ex_number, cycle_number, bfl-1);
             nob_log(NOB_INFO,"Cycle detected with size: %zu, after %zu program executions", cycle_number, programs.items[programs.count-1].ex_number);
             highest_cycle_number = cycle_number;
+            atomic_store(&reported_cycle_number, highest_cycle_number);
         }
         if (ex_number > highest_execution_number) {
             qsort(programs.items, programs.count, sizeof(programs.items[0]), compare_ex_nr);
@@ -478,15 +483,22 @@ int main(int argc, char **argv) {
             write_programs_to_file(&programs, ex_number, cycle_number, bfl-1);
             nob_log(NOB_INFO,"%zu unique program executions, cycle_size: %zu", ex_number, cycle_number);
             highest_execution_number = ex_number;
+            atomic_store(&reported_execution_number, highest_execution_number);
         }
         nob_da_free(programs);
         nob_da_free(ht_pkv);
         --do_search;
     }
+    reporter_stop(&reporter);
     nob_log(NOB_INFO,"Cycle length histogram:");
-    print_da(pcls);
+    hist_print(&pcls);
     nob_log(NOB_INFO,"Program execution sequence length histogram");
-    print_da(psls);
-    nob_da_free(pcls);
-    nob_da_free(psls);
+    hist_print(&psls);
+#ifdef PROFILE
+    if (nob_mkdir_if_not_exists("./bf7_init_programs")) {
+        profile_dump("./bf7_init_programs/profile.txt", ins_bf7, COUNT);
+    }
+#endif
+    hist_free(&pcls);
+    hist_free(&psls);
 }
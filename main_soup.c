@@ -0,0 +1,347 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define NOB_IMPLEMENTATION
+#include "nob.h"
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#define SOUP_IMPLEMENTATION
+#include "soup.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include "palette.h"
+
+#define u8 uint8_t
+#define u64 uint64_t
+
+#define SOUP_TAPES (1 << 17)
+#define SOUP_TAPE_SIZE 32 // a pair is 64 cells, the tape size of main.c
+#define SOUP_EPOCHS 1000
+#define SOUP_MUTATION_RATE 0.00024
+#define MAX_INST_COUNT 25600
+
+typedef enum {
+    O,
+    MRL,
+    MRR,
+    MWL,
+    MWR,
+    MIL,
+    MIR,
+    S,
+    WP,
+    WE,
+    WM,
+    COUNT
+} BF7;
+
+static_assert(COUNT == 11, "Amount of instructions have changed");
+
+/*
+Pair evaluators
+
+Same instruction semantics as evaluate_bf6 in main.c and evaluate_bf7 in
+main_bf7.c, on a pair of len cells instead of a Program.
+*/
+
+// Reads src, writes into a zeroed dst
+size_t soup_eval_bf6(const u8 *src, u8 *dst, size_t len) {
+    size_t read_head = 0;
+    size_t write_head = 0;
+    size_t ins_head = 0;
+    size_t ins_count = 0;
+    memset(dst, 0, len);
+    while (ins_count < MAX_INST_COUNT) {
+        if (ins_head >= len) break;
+        switch ((BF7)src[ins_head]) {
+            case MRL: read_head = (read_head + len - 1) % len; ins_head++; break;
+            case MRR: read_head = (read_head + 1) % len; ins_head++; break;
+            case MWL: write_head = (write_head + len - 1) % len; ins_head++; break;
+            case MWR: write_head = (write_head + 1) % len; ins_head++; break;
+            case MIL: {
+                if (src[read_head] != 0) {
+                    int bracket_count = 1;
+                    while (bracket_count > 0 && ins_head < len && ins_head > 0) {
+                        ins_head--;
+                        if (src[ins_head] == MIL) bracket_count++;
+                        if (src[ins_head] == MIR) bracket_count--;
+                    }
+                } else {
+                    ins_head++;
+                }
+                break;
+            }
+            case MIR: {
+                if (src[read_head] == 0) {
+                    int bracket_count = 1;
+                    while (bracket_count > 0 && ins_head < len && ins_head > 0) {
+                        ins_head++;
+                        if (ins_head >= len) break;
+                        if (src[ins_head] == MIR) bracket_count++;
+                        if (src[ins_head] == MIL) bracket_count--;
+                    }
+                } else {
+                    ins_head++;
+                }
+                break;
+            }
+            case S: {
+                size_t temp = read_head;
+                read_head = write_head;
+                write_head = temp;
+                ins_head++;
+                break;
+            }
+            case WP: dst[write_head] = (src[read_head] + 1) % COUNT; ins_head++; break;
+            case WE: dst[write_head] = src[read_head]; ins_head++; break;
+            case WM: dst[write_head] = (src[read_head] + COUNT - 1) % COUNT; ins_head++; break;
+            case O:
+            case COUNT:
+            default: ins_head++; break;
+        }
+        ins_count++;
+    }
+    return ins_count;
+}
+
+// Starts from a copy of src and fetches instructions from dst, so the pair rewrites itself
+size_t soup_eval_bf7(const u8 *src, u8 *dst, size_t len) {
+    size_t read_head = 0;
+    size_t write_head = 0;
+    size_t ins_head = 0;
+    int readh_d = 1;
+    int writeh_d = 1;
+    int insh_d = 1;
+    int write = 0;
+    size_t ins_count = 0;
+    memcpy(dst, src, len);
+    while (ins_count < MAX_INST_COUNT) {
+        if (ins_head >= len) break;
+        switch ((BF7)dst[ins_head]) {
+            case MRL: readh_d = -1; break;
+            case MRR: readh_d = 1; break;
+            case MWL: writeh_d = -1; break;
+            case MWR: writeh_d = 1; break;
+            case MIL: insh_d = -1; break;
+            case MIR: insh_d = 1; break;
+            case S: {
+                size_t temp = read_head;
+                read_head = write_head;
+                write_head = temp;
+                break;
+            }
+            case WP: write = 1; break;
+            case WE: write = 0; break;
+            case WM: write = -1; break;
+            case O:
+            case COUNT:
+            default: break;
+        }
+        read_head = (read_head + readh_d + len) % len;
+        write_head = (write_head + writeh_d + len) % len;
+        dst[write_head] = (src[read_head] + write + COUNT) % COUNT;
+        ins_head = ins_head + insh_d;
+        ins_count++;
+    }
+    return ins_count;
+}
+
+// A lattice frame, every tape is a scale x scale square in the mean palette color of its cells
+bool write_frame(const Soup *s, const char *path, size_t scale) {
+    size_t w = s->width*scale, h = s->height*scale;
+    u8 *rgb = malloc(w*h*3);
+    if (rgb == NULL) return false;
+    for (size_t y = 0; y < s->height; ++y) {
+        for (size_t x = 0; x < s->width; ++x) {
+            const u8 *tape = &s->tapes[soup_grid_slot(s, x, y)*s->tape_size];
+            uint32_t counts[COUNT] = {0};
+            for (size_t i = 0; i < s->tape_size; ++i) counts[tape[i] % COUNT]++;
+            Color c = aggregate_color(counts);
+            for (size_t dy = 0; dy < scale; ++dy) {
+                u8 *px = &rgb[((y*scale + dy)*w + x*scale)*3];
+                for (size_t dx = 0; dx < scale; ++dx, px += 3) {
+                    px[0] = c.r;
+                    px[1] = c.g;
+                    px[2] = c.b;
+                }
+            }
+        }
+    }
+    bool ok = stbi_write_png(path, w, h, 3, rgb, w*3);
+    free(rgb);
+    if (!ok) nob_log(NOB_ERROR, "Could not write frame %s", path);
+    return ok;
+}
+
+bool flag_int(int *argc, char ***argv, size_t *value)
+{
+    const char *flag = nob_shift(*argv, *argc);
+    if ((*argc) <= 0) {
+        nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+        return false;
+    }
+    *value = (size_t)atoi(nob_shift(*argv, *argc));
+    return true;
+}
+
+bool flag_str(int *argc, char ***argv, const char **value)
+{
+    const char *flag = nob_shift(*argv, *argc);
+    if ((*argc) <= 0) {
+        nob_log(NOB_ERROR, "No argument is provided for %s", flag);
+        return false;
+    }
+    *value = nob_shift(*argv, *argc);
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    const char *program_name = nob_shift(argv, argc);
+    (void)program_name;
+
+    size_t tapes = SOUP_TAPES;
+    size_t tape_size = SOUP_TAPE_SIZE;
+    size_t epochs = SOUP_EPOCHS;
+    size_t bfl = 6;
+    size_t seed = time(NULL);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 0 ? (size_t)cpus : 1;
+    size_t snapshot_interval = 100;     // epochs, 0 only writes the final snapshot
+    size_t report_interval = 10;        // seconds
+    size_t width = 0, height = 0;       // -grid, 0 for a well-mixed soup
+    size_t frame_interval = 0;          // epochs between lattice frames, 0 for none
+    size_t frame_scale = 1;             // pixels per tape side
+    const char *mutation_rate = NULL;
+    const char *output_dir = ".";
+    const char *load_path = NULL;
+
+    while (argc > 0) {
+        const char *flag = argv[0];
+        if (strcmp(flag, "-n") == 0) {
+            if (!flag_int(&argc, &argv, &tapes)) return 1;
+        }
+        else if (strcmp(flag, "-t") == 0) {
+            if (!flag_int(&argc, &argv, &tape_size)) return 1;
+        }
+        else if (strcmp(flag, "-epochs") == 0) {
+            if (!flag_int(&argc, &argv, &epochs)) return 1;
+        }
+        else if (strcmp(flag, "-bf") == 0) {
+            if (!flag_int(&argc, &argv, &bfl)) return 1;
+        }
+        else if (strcmp(flag, "-seed") == 0) {
+            if (!flag_int(&argc, &argv, &seed)) return 1;
+        }
+        else if (strcmp(flag, "-j") == 0) {
+            if (!flag_int(&argc, &argv, &threads)) return 1;
+            if (threads == 0) threads = 1;
+        }
+        else if (strcmp(flag, "-snap") == 0) {
+            if (!flag_int(&argc, &argv, &snapshot_interval)) return 1;
+        }
+        else if (strcmp(flag, "-ri") == 0) {
+            if (!flag_int(&argc, &argv, &report_interval)) return 1;
+        }
+        else if (strcmp(flag, "-grid") == 0) {
+            // -grid <width> <height>
+            if (!flag_int(&argc, &argv, &width)) return 1;
+            if (argc <= 0) {
+                nob_log(NOB_ERROR, "-grid needs a width and a height");
+                return 1;
+            }
+            height = (size_t)atoi(nob_shift(argv, argc));
+        }
+        else if (strcmp(flag, "-frames") == 0) {
+            if (!flag_int(&argc, &argv, &frame_interval)) return 1;
+        }
+        else if (strcmp(flag, "-fscale") == 0) {
+            if (!flag_int(&argc, &argv, &frame_scale)) return 1;
+            if (frame_scale == 0) frame_scale = 1;
+        }
+        else if (strcmp(flag, "-mu") == 0) {
+            if (!flag_str(&argc, &argv, &mutation_rate)) return 1;
+        }
+        else if (strcmp(flag, "-o") == 0) {
+            if (!flag_str(&argc, &argv, &output_dir)) return 1;
+        }
+        else if (strcmp(flag, "-load") == 0) {
+            if (!flag_str(&argc, &argv, &load_path)) return 1;
+        }
+        else {
+            nob_log(NOB_ERROR, "Unknown flag %s", flag);
+            return 1;
+        }
+    }
+    if (bfl != 6 && bfl != 7) {
+        nob_log(NOB_ERROR, "The soup runs bf6 or bf7, not bf%zu", bfl);
+        return 1;
+    }
+
+    Soup soup = {
+        .tape_size = tape_size,
+        .count = tapes,
+        .alphabet = COUNT,
+        .mutation_rate = mutation_rate != NULL ? strtod(mutation_rate, NULL) : SOUP_MUTATION_RATE,
+        .seed = seed,
+        .threads = threads,
+        .eval = bfl == 6 ? soup_eval_bf6 : soup_eval_bf7,
+        .width = width,
+        .height = height,
+    };
+    if (load_path != NULL) {
+        if (!soup_snapshot_read(&soup, load_path)) return 1;
+        nob_log(NOB_INFO, "loaded %zu tapes at epoch %zu from %s", soup.count, (size_t)soup.epoch, load_path);
+    }
+    if (!soup_init(&soup)) return 1;
+    if (frame_interval > 0 && soup.width == 0) {
+        nob_log(NOB_ERROR, "-frames needs a lattice, see -grid");
+        return 1;
+    }
+
+    char snapshot_dir[300];
+    snprintf(snapshot_dir, sizeof(snapshot_dir), "%s/bf%zu_soup", output_dir, bfl);
+    if (!nob_mkdir_if_not_exists(output_dir) || !nob_mkdir_if_not_exists(snapshot_dir)) return 1;
+
+    if (soup.width > 0) {
+        nob_log(NOB_INFO, "bf%zu soup on a %zux%zu lattice of tapes of %zu cells, mutation rate %g (seed %zu, %zu threads)",
+                bfl, soup.width, soup.height, soup.tape_size, soup.mutation_rate, (size_t)soup.seed, soup.threads);
+    } else {
+        nob_log(NOB_INFO, "bf%zu soup of %zu tapes of %zu cells, mutation rate %g (seed %zu, %zu threads)",
+                bfl, soup.count, soup.tape_size, soup.mutation_rate, (size_t)soup.seed, soup.threads);
+    }
+
+    u64 end_epoch = soup.epoch + epochs;
+    double start = bench_seconds();
+    double last = start;
+    u64 last_interactions = 0;
+    while (soup.epoch < end_epoch) {
+        soup_epoch(&soup);
+        double now = bench_seconds();
+        if (now - last >= report_interval || soup.epoch == end_epoch) {
+            nob_log(NOB_INFO, "epoch %zu: %.0f interactions/s (avg %.0f), %.1f steps/interaction, %zu mutations",
+                    (size_t)soup.epoch, (soup.interactions - last_interactions)/(now - last),
+                    soup.interactions/(now - start), (double)soup.steps/soup.interactions, (size_t)soup.mutations);
+            last = now;
+            last_interactions = soup.interactions;
+        }
+        if ((snapshot_interval > 0 && soup.epoch % snapshot_interval == 0) || soup.epoch == end_epoch) {
+            if (!soup_snapshot_write(&soup, nob_temp_sprintf("%s/epoch-%08zu.bin", snapshot_dir, (size_t)soup.epoch))) return 1;
+            nob_temp_reset();
+        }
+        if (frame_interval > 0 && soup.epoch % frame_interval == 0) {
+            if (!write_frame(&soup, nob_temp_sprintf("%s/frame-%08zu.png", snapshot_dir, (size_t)soup.epoch), frame_scale)) return 1;
+            nob_temp_reset();
+        }
+    }
+    nob_log(NOB_INFO, "%zu interactions in %.3fs, %.0f interactions/s", (size_t)soup.interactions,
+            bench_seconds() - start, soup.interactions/(bench_seconds() - start));
+    soup_free(&soup);
+    return 0;
+}
@@ -0,0 +1,183 @@
+// memo.h - evaluation results keyed by the cells an evaluation read
+//
+// An evaluation that only reads some cells of its tape gives the same result
+// for every tape that agrees on those cells. The evaluator notes each cell the
+// first time it reads it. Which cell it reads next only depends on the values
+// it has read so far, so the reads of all evaluations form a trie: a node
+// names the next cell, its children are indexed by that cell's value and a
+// path ends in a leaf holding the result. memo_find walks the trie along a
+// tape, a miss is interpreted and memo_insert adds its path.
+//
+// One Memo is shared by all threads. Nodes and leaves come from fixed pools,
+// children are published with a compare-and-swap so lookups and inserts run
+// concurrently under a read lock. When a pool runs out the inserting thread
+// takes the write lock and wipes the whole trie, so memory stays bounded.
+//
+// Include after nob.h. Define MEMO_IMPLEMENTATION in exactly one file.
+
+#ifndef MEMO_H_
+#define MEMO_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMO_LEAF 0x80000000u
+
+typedef struct {
+    size_t tape_size;
+    size_t alphabet;
+    size_t value_size;
+
+    // node i is nodes[i*(1 + alphabet)]: the cell it reads, then its children.
+    // A child is 0 when empty, node index + 1, or leaf index + 1 | MEMO_LEAF.
+    _Atomic uint32_t *nodes;
+    size_t node_capacity;
+    _Atomic size_t node_count;
+    uint8_t *leaves;            // leaf_capacity*value_size
+    size_t leaf_capacity;
+    _Atomic size_t leaf_count;
+    _Atomic uint32_t root;
+    pthread_rwlock_t lock;
+
+    _Atomic size_t lookups;
+    _Atomic size_t hits;
+    _Atomic size_t inserts;
+    _Atomic size_t wipes;
+} Memo;
+
+// Splits bytes between nodes and leaves, leaves are sized for paths of about tape_size cells
+bool memo_init(Memo *m, size_t bytes, size_t tape_size, size_t alphabet, size_t value_size);
+void memo_free(Memo *m);
+// Copies the result of an earlier evaluation that read the same cells into value and returns true
+bool memo_find(Memo *m, const uint8_t *tape, void *value);
+// Adds the result of evaluating tape, reads are the cells it read in order of their first read
+void memo_insert(Memo *m, const uint8_t *tape, const uint8_t *reads, size_t read_count, const void *value);
+
+#endif // MEMO_H_
+
+#ifdef MEMO_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+#define memo__node(m, i) (&(m)->nodes[(size_t)(i)*(1 + (m)->alphabet)])
+
+bool memo_init(Memo *m, size_t bytes, size_t tape_size, size_t alphabet, size_t value_size)
+{
+    memset(m, 0, sizeof(*m));
+    m->tape_size = tape_size;
+    m->alphabet = alphabet;
+    m->value_size = value_size;
+    size_t node_bytes = (1 + alphabet)*sizeof(uint32_t);
+    size_t path_bytes = tape_size*node_bytes + value_size;
+    m->leaf_capacity = bytes/path_bytes;
+    m->node_capacity = (bytes - m->leaf_capacity*value_size)/node_bytes;
+    if (m->leaf_capacity == 0 || m->node_capacity >= MEMO_LEAF) {
+        nob_log(NOB_ERROR, "memo: %zu bytes don't fit a trie of %zu cell tapes", bytes, tape_size);
+        return false;
+    }
+    m->nodes = calloc(m->node_capacity, node_bytes);
+    m->leaves = malloc(m->leaf_capacity*value_size);
+    if (m->nodes == NULL || m->leaves == NULL) {
+        nob_log(NOB_ERROR, "memo: could not allocate %zu bytes", bytes);
+        memo_free(m);
+        return false;
+    }
+    pthread_rwlock_init(&m->lock, NULL);
+    return true;
+}
+
+void memo_free(Memo *m)
+{
+    if (m->nodes != NULL) pthread_rwlock_destroy(&m->lock);
+    free(m->nodes);
+    free(m->leaves);
+    m->nodes = NULL;
+    m->leaves = NULL;
+}
+
+bool memo_find(Memo *m, const uint8_t *tape, void *value)
+{
+    atomic_fetch_add_explicit(&m->lookups, 1, memory_order_relaxed);
+    pthread_rwlock_rdlock(&m->lock);
+    uint32_t ref = atomic_load_explicit(&m->root, memory_order_acquire);
+    while (ref != 0 && !(ref & MEMO_LEAF)) {
+        _Atomic uint32_t *node = memo__node(m, ref - 1);
+        uint8_t cell = tape[atomic_load_explicit(&node[0], memory_order_relaxed)];
+        if (cell >= m->alphabet) {
+            ref = 0;
+            break;
+        }
+        ref = atomic_load_explicit(&node[1 + cell], memory_order_acquire);
+    }
+    if (ref != 0) memcpy(value, &m->leaves[(size_t)((ref & ~MEMO_LEAF) - 1)*m->value_size], m->value_size);
+    pthread_rwlock_unlock(&m->lock);
+    if (ref == 0) return false;
+    atomic_fetch_add_explicit(&m->hits, 1, memory_order_relaxed);
+    return true;
+}
+
+// Publishes ref in an empty slot, or returns what another thread published first
+static uint32_t memo__publish(_Atomic uint32_t *slot, uint32_t ref)
+{
+    uint32_t expected = 0;
+    if (atomic_compare_exchange_strong_explicit(slot, &expected, ref, memory_order_release, memory_order_acquire)) return ref;
+    return expected;
+}
+
+// false when a pool ran out
+static bool memo__insert(Memo *m, const uint8_t *tape, const uint8_t *reads, size_t read_count, const void *value)
+{
+    _Atomic uint32_t *slot = &m->root;
+    for (size_t k = 0; k < read_count; ++k) {
+        uint8_t cell = tape[reads[k]];
+        if (cell >= m->alphabet) return true;
+        uint32_t ref = atomic_load_explicit(slot, memory_order_acquire);
+        if (ref == 0) {
+            size_t i = atomic_fetch_add_explicit(&m->node_count, 1, memory_order_relaxed);
+            if (i >= m->node_capacity) return false;
+            atomic_store_explicit(&memo__node(m, i)[0], reads[k], memory_order_relaxed);
+            ref = memo__publish(slot, (uint32_t)i + 1);
+        }
+        // another evaluator reading in a different order got here first
+        if (ref & MEMO_LEAF) return true;
+        _Atomic uint32_t *node = memo__node(m, ref - 1);
+        if (atomic_load_explicit(&node[0], memory_order_relaxed) != reads[k]) return true;
+        slot = &node[1 + cell];
+    }
+    if (atomic_load_explicit(slot, memory_order_acquire) != 0) return true;
+    size_t i = atomic_fetch_add_explicit(&m->leaf_count, 1, memory_order_relaxed);
+    if (i >= m->leaf_capacity) return false;
+    memcpy(&m->leaves[i*m->value_size], value, m->value_size);
+    if (memo__publish(slot, ((uint32_t)i + 1) | MEMO_LEAF) == (((uint32_t)i + 1) | MEMO_LEAF)) {
+        atomic_fetch_add_explicit(&m->inserts, 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+void memo_insert(Memo *m, const uint8_t *tape, const uint8_t *reads, size_t read_count, const void *value)
+{
+    pthread_rwlock_rdlock(&m->lock);
+    bool inserted = memo__insert(m, tape, reads, read_count, value);
+    pthread_rwlock_unlock(&m->lock);
+    if (inserted) return;
+
+    pthread_rwlock_wrlock(&m->lock);
+    // the pools may have been wiped while we waited for the lock
+    size_t nodes = atomic_load(&m->node_count), leaves = atomic_load(&m->leaf_count);
+    if (nodes >= m->node_capacity || leaves >= m->leaf_capacity) {
+        if (nodes > m->node_capacity) nodes = m->node_capacity;
+        memset((void *)m->nodes, 0, nodes*(1 + m->alphabet)*sizeof(uint32_t));
+        atomic_store(&m->node_count, 0);
+        atomic_store(&m->leaf_count, 0);
+        atomic_store(&m->root, 0);
+        atomic_fetch_add(&m->wipes, 1);
+    }
+    memo__insert(m, tape, reads, read_count, value);
+    pthread_rwlock_unlock(&m->lock);
+}
+
+#endif // MEMO_IMPLEMENTATION
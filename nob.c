@@ -1,6 +1,7 @@
 #define NOB_IMPLEMENTATION
 #define NOB_STRIP_PREFIX
 #include "nob.h"
+#include <time.h>
 
 // Folders must end with forward slash /
 #define BUILD_FOLDER "build/"
@@ -16,7 +17,242 @@
 #define builder_inputs(cmd, ...) \
     cmd_append(cmd, __VA_ARGS__)
 #define builder_libs(cmd) \
-    cmd_append(cmd, "-lm")
+    cmd_append(cmd, "-lm", "-lpthread")
+
+// ./nob -counters ... builds the drivers with the instrumentation of counters.h
+static bool counters = false;
+// ./nob -profile ... builds the drivers with the opcode profiler of profile.h
+static bool profile = false;
+
+bool build_driver(Cmd *cmd, const char *source, const char *output)
+{
+    builder_cc(cmd);
+    builder_flags(cmd);
+    if (counters) cmd_append(cmd, "-DCOUNTERS");
+    if (profile) cmd_append(cmd, "-DPROFILE");
+    builder_inputs(cmd, source);
+    builder_output(cmd, output);
+    builder_libs(cmd);
+    return cmd_run_sync_and_reset(cmd);
+}
+
+// Runs every driver's evaluator micro-benchmarks and collects them in one JSON file
+bool bench_eval(Cmd *cmd)
+{
+    struct {
+        const char *source;
+        const char *binary;
+    } drivers[] = {
+        {SRC_FOLDER"main.c",         BUILD_FOLDER"detect_cycles"},
+        {SRC_FOLDER"main_bf4and5.c", BUILD_FOLDER"detect_cycles_bf45"},
+        {SRC_FOLDER"main_bf7.c",     BUILD_FOLDER"detect_cycles_bf7"},
+    };
+    if (!mkdir_if_not_exists(BUILD_FOLDER"bench/")) return false;
+
+    String_Builder json = {0};
+    sb_append_cstr(&json, "[\n");
+    for (size_t i = 0; i < ARRAY_LEN(drivers); ++i) {
+        if (i > 0 && !build_driver(cmd, drivers[i].source, drivers[i].binary)) return false;
+        const char *result = temp_sprintf(BUILD_FOLDER"bench/%s.json", drivers[i].binary + strlen(BUILD_FOLDER));
+        cmd_append(cmd, drivers[i].binary, "-bench", result);
+        if (!cmd_run_sync_and_reset(cmd)) return false;
+        if (i > 0) sb_append_cstr(&json, ",\n");
+        if (!read_entire_file(result, &json)) return false;
+    }
+    sb_append_cstr(&json, "]\n");
+    if (!write_entire_file(BUILD_FOLDER"bench_eval.json", json.items, json.count)) return false;
+    nob_log(INFO, "wrote "BUILD_FOLDER"bench_eval.json");
+    sb_free(json);
+    return true;
+}
+
+// Fixed workload for the end-to-end search benchmark
+#define BENCH_EXPERIMENTS "10000"
+#define BENCH_SEED "1"
+#define BENCH_THREADS "1"
+#define BENCH_BASELINE BUILD_FOLDER"bench_baseline.json"
+#define BENCH_RESULT BUILD_FOLDER"bench_search.json"
+#define BENCH_THRESHOLD 10.0 // percent
+
+// Value of the first "key": after anchor, the JSON is the flat output of bench_pipeline_write_json
+bool json_number(String_View json, const char *anchor, const char *key, double *value)
+{
+    const char *p = anchor ? strstr(json.data, anchor) : json.data;
+    if (p == NULL) return false;
+    p = strstr(p, temp_sprintf("\"%s\":", key));
+    if (p == NULL) return false;
+    *value = strtod(p + strlen(key) + 3, NULL);
+    return true;
+}
+
+// Runs the main.c search pipeline on a fixed workload and fails when its
+// throughput drops more than threshold percent below the stored baseline
+bool bench_search(Cmd *cmd, bool update, double threshold)
+{
+    cmd_append(cmd, BUILD_FOLDER"detect_cycles",
+               "-e", BENCH_EXPERIMENTS, "-seed", BENCH_SEED, "-j", BENCH_THREADS,
+               "-hc", "1000000", "-he", "1000000000",
+               "-stats", BUILD_FOLDER"bench_search_stats.jsonl",
+               "-bench-search", BENCH_RESULT);
+    if (!cmd_run_sync_and_reset(cmd)) return false;
+
+    String_Builder current = {0};
+    if (!read_entire_file(BENCH_RESULT, &current)) return false;
+    sb_append_null(&current);
+    if (update || file_exists(BENCH_BASELINE) != 1) {
+        if (!write_entire_file(BENCH_BASELINE, current.items, current.count - 1)) return false;
+        nob_log(INFO, "saved "BENCH_RESULT" as the new baseline "BENCH_BASELINE);
+        sb_free(current);
+        return true;
+    }
+    String_Builder baseline = {0};
+    if (!read_entire_file(BENCH_BASELINE, &baseline)) return false;
+    sb_append_null(&baseline);
+    String_View now_json = sb_to_sv(current);
+    String_View base_json = sb_to_sv(baseline);
+
+    const char *stages[] = {"generate", "evaluate", "hash", "reset", "hist", "record"};
+    for (size_t i = 0; i < ARRAY_LEN(stages); ++i) {
+        const char *anchor = temp_sprintf("\"name\":\"%s\"", stages[i]);
+        double now, base;
+        if (!json_number(now_json, anchor, "experiments_per_sec", &now)) continue;
+        if (!json_number(base_json, anchor, "experiments_per_sec", &base) || base <= 0) continue;
+        nob_log(INFO, "  %-10s %14.1f exp/s baseline %14.1f (%+.1f%%)", stages[i], now, base, 100.0*(now - base)/base);
+    }
+    double now_rss = 0, base_rss = 0;
+    json_number(now_json, NULL, "peak_rss_kb", &now_rss);
+    json_number(base_json, NULL, "peak_rss_kb", &base_rss);
+    nob_log(INFO, "peak RSS %.0f KiB, baseline %.0f KiB", now_rss, base_rss);
+
+    double now = 0, base = 0;
+    bool ok = json_number(now_json, NULL, "experiments_per_sec", &now) &&
+              json_number(base_json, NULL, "experiments_per_sec", &base) && base > 0;
+    if (!ok) {
+        nob_log(ERROR, "Could not read experiments_per_sec from "BENCH_RESULT" or "BENCH_BASELINE);
+    } else {
+        double change = 100.0*(now - base)/base;
+        nob_log(INFO, "search throughput %.1f exp/s, baseline %.1f exp/s (%+.1f%%)", now, base, change);
+        if (change < -threshold) {
+            nob_log(ERROR, "Search throughput regressed by more than %.1f%%", threshold);
+            ok = false;
+        }
+    }
+    sb_free(current);
+    sb_free(baseline);
+    return ok;
+}
+
+// Sharded search: detect_cycles processes over disjoint experiment ranges of
+// the same seed, each with its own output dir. A shard that dies is restarted
+// from its checkpoint, or from scratch when it died before writing one. At the
+// end all shards are merged.
+#define SHARDS_FOLDER BUILD_FOLDER"shards/"
+#define SHARD_CHECKPOINT SHARDS_FOLDER"%zu/bf6_checkpoint.bin"
+#define SHARDS_RESTARTS 3
+
+typedef struct {
+    size_t count;
+    size_t experiments;
+    size_t seed;
+    size_t threads;     // per shard process
+    bool numa;          // bind shard k to NUMA node k % nodes with numactl
+    char **args;        // passed to every shard and to the merge
+    int arg_count;
+} Shards;
+
+size_t numa_node_count(void)
+{
+    File_Paths children = {0};
+    size_t nodes = 0;
+    if (file_exists("/sys/devices/system/node") == 1 && read_entire_dir("/sys/devices/system/node", &children)) {
+        for (size_t i = 0; i < children.count; ++i) {
+            const char *name = children.items[i];
+            if (strncmp(name, "node", 4) == 0 && name[4] >= '0' && name[4] <= '9') nodes++;
+        }
+    }
+    da_free(children);
+    return nodes > 0 ? nodes : 1;
+}
+
+Proc start_shard(Cmd *cmd, const Shards *sh, size_t k, size_t nodes, bool resume)
+{
+    size_t start = k*sh->experiments/sh->count;
+    size_t end = (k + 1)*sh->experiments/sh->count;
+    if (sh->numa) {
+        cmd_append(cmd, "numactl", temp_sprintf("--cpunodebind=%zu", k%nodes), temp_sprintf("--membind=%zu", k%nodes));
+    }
+    cmd_append(cmd, BUILD_FOLDER"detect_cycles",
+               "-s", temp_sprintf("%zu", start), "-e", temp_sprintf("%zu", end - start),
+               "-seed", temp_sprintf("%zu", sh->seed), "-j", temp_sprintf("%zu", sh->threads),
+               "-o", temp_sprintf(SHARDS_FOLDER"%zu", k));
+    if (resume) cmd_append(cmd, "-resume");
+    da_append_many(cmd, sh->args, sh->arg_count);
+    return cmd_run_async_and_reset(cmd);
+}
+
+bool run_shards(Cmd *cmd, const Shards *sh)
+{
+    if (!mkdir_if_not_exists(SHARDS_FOLDER)) return false;
+    size_t nodes = sh->numa ? numa_node_count() : 1;
+    nob_log(INFO, "running %zu experiments (seed %zu) in %zu shards of %zu threads on %zu NUMA nodes",
+            sh->experiments, sh->seed, sh->count, sh->threads, nodes);
+
+    // shard dirs are reused, a checkpoint left by an earlier run must not be resumed
+    for (size_t k = 0; k < sh->count; ++k) {
+        const char *checkpoint = temp_sprintf(SHARD_CHECKPOINT, k);
+        if (file_exists(checkpoint) == 1 && remove(checkpoint) != 0) {
+            nob_log(ERROR, "Could not remove stale checkpoint %s: %s", checkpoint, strerror(errno));
+            return false;
+        }
+    }
+
+    size_t *attempts = calloc(sh->count, sizeof(size_t));
+    bool *finished = calloc(sh->count, sizeof(bool));
+    size_t *shard_of = calloc(sh->count, sizeof(size_t));
+    Procs procs = {0};
+    bool ok = true;
+    // every round restarts the shards that failed in the previous one
+    while (ok) {
+        procs.count = 0;
+        for (size_t k = 0; k < sh->count; ++k) {
+            if (finished[k]) continue;
+            bool resume = attempts[k] > 0 && file_exists(temp_sprintf(SHARD_CHECKPOINT, k)) == 1;
+            if (attempts[k] > 0) nob_log(WARNING, "restarting shard %zu %s", k, resume ? "from its checkpoint" : "from scratch");
+            Proc proc = start_shard(cmd, sh, k, nodes, resume);
+            if (proc == INVALID_PROC) {
+                ok = false;
+                break;
+            }
+            shard_of[procs.count] = k;
+            da_append(&procs, proc);
+        }
+        if (procs.count == 0) break;
+        for (size_t i = 0; i < procs.count; ++i) {
+            size_t k = shard_of[i];
+            if (proc_wait(procs.items[i])) {
+                finished[k] = true;
+            } else if (++attempts[k] > SHARDS_RESTARTS) {
+                nob_log(ERROR, "shard %zu failed %d times, giving up", k, SHARDS_RESTARTS + 1);
+                ok = false;
+            } else {
+                nob_log(WARNING, "shard %zu failed", k);
+            }
+        }
+    }
+
+    if (ok) {
+        cmd_append(cmd, BUILD_FOLDER"detect_cycles", "-o", SHARDS_FOLDER"merged");
+        da_append_many(cmd, sh->args, sh->arg_count);
+        cmd_append(cmd, "-merge");
+        for (size_t k = 0; k < sh->count; ++k) cmd_append(cmd, temp_sprintf(SHARDS_FOLDER"%zu", k));
+        ok = cmd_run_sync_and_reset(cmd);
+    }
+    da_free(procs);
+    free(attempts);
+    free(finished);
+    free(shard_of);
+    return ok;
+}
 
 int main(int argc, char **argv)
 {
@@ -27,12 +263,19 @@ int main(int argc, char **argv)
 
     if (!mkdir_if_not_exists(BUILD_FOLDER)) return 1;
 
-    builder_cc(&cmd);
-    builder_flags(&cmd);
-    builder_inputs(&cmd, SRC_FOLDER"main.c");
-    builder_output(&cmd, BUILD_FOLDER"detect_cycles");
-    builder_libs(&cmd);
-    if (!cmd_run_sync_and_reset(&cmd)) return 1;
+    while (argc > 0 && argv[0][0] == '-') {
+        const char *flag = shift(argv, argc);
+        if (strcmp(flag, "-counters") == 0) {
+            counters = true;
+        } else if (strcmp(flag, "-profile") == 0) {
+            profile = true;
+        } else {
+            nob_log(ERROR, "Unknown flag %s", flag);
+            return 1;
+        }
+    }
+
+    if (!build_driver(&cmd, SRC_FOLDER"main.c", BUILD_FOLDER"detect_cycles")) return 1;
 
     if (argc > 0) {
         const char *command_name = shift(argv, argc);
@@ -40,6 +283,62 @@ int main(int argc, char **argv)
             cmd_append(&cmd, BUILD_FOLDER "detect_cycles");
             da_append_many(&cmd, argv, argc);
             if (!cmd_run_sync_and_reset(&cmd)) return 1;
+        } else if (strcmp(command_name, "run-bf7") == 0) {
+            if (!build_driver(&cmd, SRC_FOLDER"main_bf7_histo.c", BUILD_FOLDER"detect_cycles_bf7_histo")) return 1;
+            cmd_append(&cmd, BUILD_FOLDER "detect_cycles_bf7_histo");
+            da_append_many(&cmd, argv, argc);
+            if (!cmd_run_sync_and_reset(&cmd)) return 1;
+        } else if (strcmp(command_name, "soup") == 0) {
+            if (!build_driver(&cmd, SRC_FOLDER"main_soup.c", BUILD_FOLDER"soup")) return 1;
+            cmd_append(&cmd, BUILD_FOLDER "soup");
+            da_append_many(&cmd, argv, argc);
+            if (!cmd_run_sync_and_reset(&cmd)) return 1;
+        } else if (strcmp(command_name, "bench-eval") == 0) {
+            if (!bench_eval(&cmd)) return 1;
+        } else if (strcmp(command_name, "shards") == 0) {
+            // ./nob shards [-n shards] [-e experiments] [-seed seed] [-j threads] [-numa] [-- detect_cycles flags]
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            Shards sh = {.count = 2, .experiments = 1000000, .seed = (size_t)time(NULL)};
+            while (argc > 0) {
+                const char *arg = shift(argv, argc);
+                if (strcmp(arg, "--") == 0) {
+                    sh.args = argv;
+                    sh.arg_count = argc;
+                    break;
+                } else if (strcmp(arg, "-numa") == 0) {
+                    sh.numa = true;
+                } else if (argc > 0 && strcmp(arg, "-n") == 0) {
+                    sh.count = strtoull(shift(argv, argc), NULL, 10);
+                } else if (argc > 0 && strcmp(arg, "-e") == 0) {
+                    sh.experiments = strtoull(shift(argv, argc), NULL, 10);
+                } else if (argc > 0 && strcmp(arg, "-seed") == 0) {
+                    sh.seed = strtoull(shift(argv, argc), NULL, 10);
+                } else if (argc > 0 && strcmp(arg, "-j") == 0) {
+                    sh.threads = strtoull(shift(argv, argc), NULL, 10);
+                } else {
+                    nob_log(ERROR, "Unknown shards argument %s", arg);
+                    return 1;
+                }
+            }
+            if (sh.count == 0) sh.count = 1;
+            if (sh.threads == 0) sh.threads = cpus > (long)sh.count ? (size_t)cpus/sh.count : 1;
+            if (!run_shards(&cmd, &sh)) return 1;
+        } else if (strcmp(command_name, "bench") == 0) {
+            // ./nob bench [update] [-threshold <percent>]
+            bool update = false;
+            double threshold = BENCH_THRESHOLD;
+            while (argc > 0) {
+                const char *arg = shift(argv, argc);
+                if (strcmp(arg, "update") == 0) {
+                    update = true;
+                } else if (strcmp(arg, "-threshold") == 0 && argc > 0) {
+                    threshold = strtod(shift(argv, argc), NULL);
+                } else {
+                    nob_log(ERROR, "Unknown bench argument %s", arg);
+                    return 1;
+                }
+            }
+            if (!bench_search(&cmd, update, threshold)) return 1;
         } else {
             nob_log(ERROR, "Unknown command %s", command_name);
             return 1;
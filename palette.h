@@ -0,0 +1,42 @@
+// palette.h - opcode colors shared by ppix and the soup frames
+//
+// colors[i] is the color of opcode i in the bf7 alphabet "o<>{}lrspwm".
+
+#ifndef PALETTE_H_
+#define PALETTE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint8_t r, g, b;
+} Color;
+
+static const Color colors[11] = {
+    {0, 0, 0},
+    {255, 0, 0},    // Red
+    {0, 0, 255},    // Blue
+    {0, 180, 0},    // Green
+    {255, 140, 0},  // Orange
+    {147, 0, 211},  // Purple
+    {0, 206, 209},  // Turquoise
+    {255, 105, 180},// Pink
+    {139, 69, 19},  // Brown
+    {255, 215, 0},  // Yellow
+    {255, 255 ,255}  
+};
+
+// Frequency weighted mean of the palette colors of the opcodes in a block
+static inline Color aggregate_color(const uint32_t *counts) {
+    uint32_t total = 0, r = 0, g = 0, b = 0;
+    for (size_t k = 0; k < sizeof(colors)/sizeof(colors[0]); ++k) {
+        total += counts[k];
+        r += counts[k] * colors[k].r;
+        g += counts[k] * colors[k].g;
+        b += counts[k] * colors[k].b;
+    }
+    if (total == 0) return colors[0];
+    return (Color){r/total, g/total, b/total};
+}
+
+#endif // PALETTE_H_
@@ -0,0 +1,277 @@
+// profile.h - sampled per-opcode profile of the evaluators
+//
+// Build with -DPROFILE (./nob -profile ...) to turn it on. Without it every
+// macro below expands to nothing and the evaluators are unchanged.
+//
+// Only one in `rate` evaluations per thread is traced, the others cost a
+// single predictable branch per step. A traced evaluation records the opcode
+// mix, opcode bigrams and trigrams, how often each branching opcode was taken
+// and how far it jumped, and which tape cells the read and write heads
+// visited. Every thread folds its traces into its own Profile, so there are no
+// shared writes; profile_dump sums them once the workers are done.
+//
+// Include after nob.h. Define PROFILE_IMPLEMENTATION in exactly one file.
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROFILE_MAX_OPS 16
+#define PROFILE_MAX_TAPE 256
+#define PROFILE_RATE 64
+#define PROFILE_TOP 32
+
+typedef struct Profile {
+    uint64_t evaluations;   // traced evaluations
+    uint64_t steps;
+    uint64_t ops[PROFILE_MAX_OPS];
+    uint64_t bigrams[PROFILE_MAX_OPS][PROFILE_MAX_OPS];
+    uint64_t trigrams[PROFILE_MAX_OPS][PROFILE_MAX_OPS][PROFILE_MAX_OPS];
+    uint64_t taken[PROFILE_MAX_OPS];
+    uint64_t not_taken[PROFILE_MAX_OPS];
+    uint64_t jump_distance[PROFILE_MAX_TAPE + 1];
+    // distinct cells each head visited during one evaluation
+    uint64_t read_cells[PROFILE_MAX_TAPE + 1];
+    uint64_t write_cells[PROFILE_MAX_TAPE + 1];
+    struct Profile *next;
+} Profile;
+
+typedef struct {
+    Profile *profile;
+    size_t prev[2];         // last two opcodes, PROFILE_MAX_OPS when there is none
+    uint64_t read_seen[PROFILE_MAX_TAPE/64];
+    uint64_t write_seen[PROFILE_MAX_TAPE/64];
+} Profile_Run;
+
+// Trace one in rate evaluations per thread, 0 turns tracing off
+void profile_set_rate(size_t rate);
+// Returns NULL when this evaluation is not sampled
+Profile_Run *profile_begin(void);
+void profile_op(Profile_Run *run, size_t op, size_t read_head, size_t write_head);
+void profile_branch(Profile_Run *run, size_t op, bool taken, size_t distance);
+void profile_end(Profile_Run *run);
+// Writes the summed report, opcodes are spelled with alphabet. Call after the workers are done.
+bool profile_dump(const char *path, const char **alphabet, size_t alphabet_count);
+
+#ifdef PROFILE
+#define PROFILE_BEGIN(run) Profile_Run *run = profile_begin()
+#define PROFILE_OP(run, op, read_head, write_head) \
+    do { if (run) profile_op((run), (op), (read_head), (write_head)); } while (0)
+#define PROFILE_BRANCH(run, op, taken, distance) \
+    do { if (run) profile_branch((run), (op), (taken), (distance)); } while (0)
+#define PROFILE_END(run) do { if (run) profile_end(run); } while (0)
+#else
+#define PROFILE_BEGIN(run) ((void)0)
+#define PROFILE_OP(run, op, read_head, write_head) ((void)0)
+#define PROFILE_BRANCH(run, op, taken, distance) ((void)0)
+#define PROFILE_END(run) ((void)0)
+#endif // PROFILE
+
+#endif // PROFILE_H_
+
+#ifdef PROFILE_IMPLEMENTATION
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t profile__rate = PROFILE_RATE;
+static Profile *profile__all = NULL;
+static pthread_mutex_t profile__lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local Profile *profile__local = NULL;
+static _Thread_local size_t profile__countdown = 0;
+static _Thread_local Profile_Run profile__run;
+
+void profile_set_rate(size_t rate)
+{
+    profile__rate = rate;
+}
+
+Profile_Run *profile_begin(void)
+{
+    if (profile__rate == 0) return NULL;
+    if (profile__countdown > 0) {
+        profile__countdown--;
+        return NULL;
+    }
+    profile__countdown = profile__rate - 1;
+
+    if (profile__local == NULL) {
+        profile__local = calloc(1, sizeof(Profile));
+        NOB_ASSERT(profile__local != NULL && "Buy more RAM lol");
+        pthread_mutex_lock(&profile__lock);
+        profile__local->next = profile__all;
+        profile__all = profile__local;
+        pthread_mutex_unlock(&profile__lock);
+    }
+    Profile_Run *run = &profile__run;
+    memset(run, 0, sizeof(*run));
+    run->profile = profile__local;
+    run->prev[0] = run->prev[1] = PROFILE_MAX_OPS;
+    return run;
+}
+
+void profile_op(Profile_Run *run, size_t op, size_t read_head, size_t write_head)
+{
+    Profile *p = run->profile;
+    if (op >= PROFILE_MAX_OPS) return;
+    p->steps++;
+    p->ops[op]++;
+    if (run->prev[1] < PROFILE_MAX_OPS) {
+        p->bigrams[run->prev[1]][op]++;
+        if (run->prev[0] < PROFILE_MAX_OPS) p->trigrams[run->prev[0]][run->prev[1]][op]++;
+    }
+    run->prev[0] = run->prev[1];
+    run->prev[1] = op;
+    read_head %= PROFILE_MAX_TAPE;
+    write_head %= PROFILE_MAX_TAPE;
+    run->read_seen[read_head/64] |= 1ull << (read_head%64);
+    run->write_seen[write_head/64] |= 1ull << (write_head%64);
+}
+
+void profile_branch(Profile_Run *run, size_t op, bool taken, size_t distance)
+{
+    Profile *p = run->profile;
+    if (op >= PROFILE_MAX_OPS) return;
+    if (taken) {
+        p->taken[op]++;
+        p->jump_distance[distance < PROFILE_MAX_TAPE ? distance : PROFILE_MAX_TAPE]++;
+    } else {
+        p->not_taken[op]++;
+    }
+}
+
+void profile_end(Profile_Run *run)
+{
+    Profile *p = run->profile;
+    size_t read = 0, write = 0;
+    for (size_t i = 0; i < PROFILE_MAX_TAPE/64; ++i) {
+        read += __builtin_popcountll(run->read_seen[i]);
+        write += __builtin_popcountll(run->write_seen[i]);
+    }
+    p->evaluations++;
+    p->read_cells[read]++;
+    p->write_cells[write]++;
+}
+
+typedef struct {
+    size_t ops[3];
+    uint64_t count;
+} Profile__Gram;
+
+static int profile__compare_gram(const void *a, const void *b)
+{
+    const Profile__Gram *ap = a;
+    const Profile__Gram *bp = b;
+    if (ap->count != bp->count) return ap->count > bp->count ? -1 : 1;
+    return 0;
+}
+
+static void profile__print_grams(FILE *f, Profile__Gram *grams, size_t n, size_t arity, uint64_t total,
+                                 const char **alphabet)
+{
+    qsort(grams, n, sizeof(grams[0]), profile__compare_gram);
+    for (size_t i = 0; i < n && i < PROFILE_TOP && grams[i].count > 0; ++i) {
+        for (size_t k = 0; k < arity; ++k) fprintf(f, "%s", alphabet[grams[i].ops[k]]);
+        fprintf(f, "%*s %12zu %6.2f%%\n", (int)(4 - arity), "", (size_t)grams[i].count,
+                total ? 100.0*grams[i].count/total : 0.0);
+    }
+}
+
+static void profile__print_distribution(FILE *f, const char *name, const uint64_t *counts, size_t n)
+{
+    uint64_t total = 0, sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        total += counts[i];
+        sum += counts[i]*i;
+    }
+    fprintf(f, "\n%s (mean %.2f)\n", name, total ? (double)sum/total : 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        if (counts[i] == 0) continue;
+        fprintf(f, "%4zu%s %12zu %6.2f%%\n", i, i + 1 == n ? "+" : " ", (size_t)counts[i], 100.0*counts[i]/total);
+    }
+}
+
+bool profile_dump(const char *path, const char **alphabet, size_t alphabet_count)
+{
+    if (alphabet_count > PROFILE_MAX_OPS) alphabet_count = PROFILE_MAX_OPS;
+    Profile *sum = calloc(1, sizeof(Profile));
+    if (sum == NULL) return false;
+    pthread_mutex_lock(&profile__lock);
+    for (Profile *p = profile__all; p != NULL; p = p->next) {
+        uint64_t *dst = (uint64_t*)sum;
+        const uint64_t *src = (const uint64_t*)p;
+        for (size_t i = 0; i < offsetof(Profile, next)/sizeof(uint64_t); ++i) dst[i] += src[i];
+    }
+    pthread_mutex_unlock(&profile__lock);
+    if (sum->evaluations == 0) {
+        nob_log(NOB_WARNING, "No evaluations were profiled, was this built with -DPROFILE?");
+        free(sum);
+        return false;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s", path);
+        free(sum);
+        return false;
+    }
+    fprintf(f, "evaluations traced: %zu (1 in %zu per thread)\n", (size_t)sum->evaluations, profile__rate);
+    fprintf(f, "steps traced:       %zu (%.2f per evaluation)\n", (size_t)sum->steps, (double)sum->steps/sum->evaluations);
+
+    fprintf(f, "\nopcode mix\n");
+    for (size_t op = 0; op < alphabet_count; ++op) {
+        fprintf(f, "%-4s %12zu %6.2f%%\n", alphabet[op], (size_t)sum->ops[op], 100.0*sum->ops[op]/sum->steps);
+    }
+
+    fprintf(f, "\nbranches\n");
+    for (size_t op = 0; op < alphabet_count; ++op) {
+        uint64_t n = sum->taken[op] + sum->not_taken[op];
+        if (n == 0) continue;
+        fprintf(f, "%-4s taken %12zu not taken %12zu taken rate %6.2f%%\n", alphabet[op],
+                (size_t)sum->taken[op], (size_t)sum->not_taken[op], 100.0*sum->taken[op]/n);
+    }
+
+    size_t n = alphabet_count*alphabet_count*alphabet_count;
+    Profile__Gram *grams = malloc(sizeof(Profile__Gram)*n);
+    if (grams != NULL) {
+        size_t count = 0;
+        uint64_t total = 0;
+        for (size_t a = 0; a < alphabet_count; ++a) {
+            for (size_t b = 0; b < alphabet_count; ++b) {
+                grams[count++] = (Profile__Gram){{a, b}, sum->bigrams[a][b]};
+                total += sum->bigrams[a][b];
+            }
+        }
+        fprintf(f, "\ntop bigrams\n");
+        profile__print_grams(f, grams, count, 2, total, alphabet);
+
+        count = 0;
+        total = 0;
+        for (size_t a = 0; a < alphabet_count; ++a) {
+            for (size_t b = 0; b < alphabet_count; ++b) {
+                for (size_t c = 0; c < alphabet_count; ++c) {
+                    grams[count++] = (Profile__Gram){{a, b, c}, sum->trigrams[a][b][c]};
+                    total += sum->trigrams[a][b][c];
+                }
+            }
+        }
+        fprintf(f, "\ntop trigrams\n");
+        profile__print_grams(f, grams, count, 3, total, alphabet);
+        free(grams);
+    }
+
+    profile__print_distribution(f, "jump distance", sum->jump_distance, PROFILE_MAX_TAPE + 1);
+    profile__print_distribution(f, "cells visited by the read head per evaluation", sum->read_cells, PROFILE_MAX_TAPE + 1);
+    profile__print_distribution(f, "cells visited by the write head per evaluation", sum->write_cells, PROFILE_MAX_TAPE + 1);
+    fclose(f);
+    nob_log(NOB_INFO, "wrote opcode profile of %zu evaluations to %s", (size_t)sum->evaluations, path);
+    free(sum);
+    return true;
+}
+
+#endif // PROFILE_IMPLEMENTATION
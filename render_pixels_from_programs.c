@@ -6,6 +6,7 @@
 #include "nob.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
+#include "palette.h"
 
 #define NSV Nob_String_View
 #define NSB Nob_String_Builder
@@ -14,10 +15,6 @@
 COLOR
 */
 
-typedef struct {
-    uint8_t r, g, b;
-} Color;
-
 typedef struct {
     uint8_t r;
     uint8_t g;
@@ -25,68 +22,58 @@ typedef struct {
     uint8_t a;
 } RGBA32;
 
-Color colors[11] = {
-    {0, 0, 0},
-    {255, 0, 0},    // Red
-    {0, 0, 255},    // Blue
-    {0, 180, 0},    // Green
-    {255, 140, 0},  // Orange
-    {147, 0, 211},  // Purple
-    {0, 206, 209},  // Turquoise
-    {255, 105, 180},// Pink
-    {139, 69, 19},  // Brown
-    {255, 215, 0},  // Yellow
-    {255, 255 ,255}  
-};
-
 typedef struct {
     NSV *items;
     int count;
     int capacity;
 } Programs;
 
-Color instruction_to_color(char i) {
+size_t instruction_to_index(char i) {
     switch (i) {
         case 'o':
-            return colors[0];
+            return 0;
         case '<':
-            return colors[1]; 
+            return 1; 
         case '>':
-            return colors[2];
+            return 2;
         case '{':
-            return colors[3];
+            return 3;
         case '}':
-            return colors[4];
+            return 4;
         case 'l':
-            return colors[5];
+            return 5;
         case 'r':
-            return colors[6];
+            return 6;
         case 's':
-            return colors[7];
+            return 7;
         case 'p':
-            return colors[8];
+            return 8;
         case 'w':
-            return colors[9];
+            return 9;
         case 'm':
-            return colors[10];
+            return 10;
         default:
             nob_log(NOB_ERROR, "UNKNOWN INSTRUCTION");
             exit(1);
     }  
 }
 
-bool image_from_file(const char *file) {
+Color instruction_to_color(char i) {
+    return colors[instruction_to_index(i)];
+}
+
+// Swaps a trailing .txt for `suffix` (or appends it), caller frees
+char *path_with_suffix(const char *file, const char *suffix) {
     size_t len = strlen(file);
-    char *im_file;
-    if (len > 4 && strcmp(file + len - 4, ".txt") == 0) {
-        im_file = malloc(len + 1);
-        strcpy(im_file, file);
-        strcpy(&im_file[len-4], ".png");
-    } else {
-        im_file = malloc(len + 5);
-        strcpy(im_file, file);
-        strcpy(&im_file[len], ".png");
-    }
+    if (len > 4 && strcmp(file + len - 4, ".txt") == 0) len -= 4;
+    char *path = malloc(len + strlen(suffix) + 1);
+    memcpy(path, file, len);
+    strcpy(&path[len], suffix);
+    return path;
+}
+
+bool image_from_file(const char *file) {
+    char *im_file = path_with_suffix(file, ".png");
 
     struct stat buffer;
     if (stat(im_file, &buffer) == 0) {
@@ -149,6 +136,489 @@ bool image_from_file(const char *file) {
     return true;
 }
 
+/*
+TRAJECTORY STREAM
+*/
+
+// Reads a trajectory file one tape at a time so huge files never sit in memory
+typedef struct {
+    FILE *file;
+    char *line;
+    size_t line_cap;
+    size_t width;   // tape width, fixed by the first row
+    size_t rows;    // rows read so far
+} Trajectory;
+
+bool trajectory_open(Trajectory *t, const char *file) {
+    memset(t, 0, sizeof(*t));
+    t->file = fopen(file, "r");
+    if (t->file == NULL) {
+        nob_log(NOB_ERROR, "Could not open file %s", file);
+        return false;
+    }
+    return true;
+}
+
+// Fills `row` with palette indices, returns 0 at end of file and -1 on a malformed row
+int trajectory_next(Trajectory *t, uint8_t *row) {
+    ssize_t n;
+    while ((n = getline(&t->line, &t->line_cap, t->file)) >= 0) {
+        NSV program = nob_sv_trim((NSV){.data = t->line, .count = (size_t)n});
+        if (program.count == 0) continue;
+        if (t->width == 0) return -1;
+        if (program.count != t->width) {
+            nob_log(NOB_ERROR, "Inconsistent program sizes: %zu != %zu at line %zu", program.count, t->width, t->rows);
+            return -1;
+        }
+        for (size_t i = 0; i < program.count; ++i) {
+            row[i] = instruction_to_index(program.data[i]);
+        }
+        t->rows++;
+        return 1;
+    }
+    return 0;
+}
+
+// Reads ahead to the first non empty row to learn the tape width, then rewinds
+bool trajectory_probe_width(Trajectory *t) {
+    ssize_t n;
+    while ((n = getline(&t->line, &t->line_cap, t->file)) >= 0) {
+        NSV program = nob_sv_trim((NSV){.data = t->line, .count = (size_t)n});
+        if (program.count == 0) continue;
+        t->width = program.count;
+        rewind(t->file);
+        return true;
+    }
+    nob_log(NOB_ERROR, "Trajectory file is empty");
+    return false;
+}
+
+void trajectory_close(Trajectory *t) {
+    if (t->file) fclose(t->file);
+    free(t->line);
+    memset(t, 0, sizeof(*t));
+}
+
+/*
+VIDEO
+*/
+
+typedef enum {
+    VIDEO_Y4M,
+    VIDEO_PNG_FRAMES,
+} Video_Format;
+
+typedef struct {
+    size_t rows;    // tapes visible per frame, 0 means square frames
+    size_t step;    // tapes the window advances between frames
+    size_t scale;   // pixel upscale factor
+    size_t fps;
+} Video_Opts;
+
+typedef struct {
+    Video_Format format;
+    Video_Opts opts;
+    FILE *y4m;
+    const char *frames_dir;
+    size_t width;       // tape width
+    size_t frame_w;
+    size_t frame_h;
+    uint8_t *window;    // ring buffer of opts.rows tapes, the only trajectory data kept around
+    size_t head;        // oldest row in window
+    size_t filled;
+    uint8_t *rgb;       // one upscaled frame, reused
+    uint8_t *planes;    // Y, Cb, Cr planes for Y4M, reused
+    size_t frames;
+} Video;
+
+bool video_begin(Video *v, const char *out, size_t width) {
+    v->width = width;
+    if (v->opts.rows == 0) v->opts.rows = width;
+    if (v->opts.step == 0) v->opts.step = 1;
+    if (v->opts.scale == 0) v->opts.scale = 1;
+    if (v->opts.fps == 0) v->opts.fps = 30;
+    v->frame_w = width * v->opts.scale;
+    v->frame_h = v->opts.rows * v->opts.scale;
+
+    v->window = calloc(v->opts.rows * width, sizeof(uint8_t));
+    v->rgb = malloc(v->frame_w * v->frame_h * 3);
+    if (v->window == NULL || v->rgb == NULL) {
+        nob_log(NOB_ERROR, "Could not allocate frame buffer");
+        return false;
+    }
+
+    switch (v->format) {
+        case VIDEO_Y4M: {
+            v->planes = malloc(v->frame_w * v->frame_h * 3);
+            if (v->planes == NULL) {
+                nob_log(NOB_ERROR, "Could not allocate frame buffer");
+                return false;
+            }
+            v->y4m = fopen(out, "wb");
+            if (v->y4m == NULL) {
+                nob_log(NOB_ERROR, "Could not open file %s", out);
+                return false;
+            }
+            // the header waits for the first frame, which knows the frame height
+            break;
+        }
+        case VIDEO_PNG_FRAMES: {
+            if (!nob_mkdir_if_not_exists(out)) return false;
+            v->frames_dir = out;
+            break;
+        }
+    }
+    return true;
+}
+
+bool video_emit_frame(Video *v) {
+    size_t scale = v->opts.scale;
+    if (v->frames == 0 && v->filled < v->opts.rows) {
+        // a trajectory shorter than the window is one frame of just its tapes, not padded
+        nob_log(NOB_INFO, "trajectory has only %zu of %zu rows, frame is cut to fit", v->filled, v->opts.rows);
+        v->frame_h = v->filled * scale;
+    }
+    if (v->frames == 0 && v->format == VIDEO_Y4M) {
+        fprintf(v->y4m, "YUV4MPEG2 W%zu H%zu F%zu:1 Ip A1:1 C444\n", v->frame_w, v->frame_h, v->opts.fps);
+    }
+    for (size_t y = 0; y < v->frame_h; ++y) {
+        uint8_t *src = &v->window[((v->head + y/scale) % v->opts.rows) * v->width];
+        uint8_t *dst = &v->rgb[y * v->frame_w * 3];
+        for (size_t x = 0; x < v->frame_w; ++x) {
+            Color c = colors[src[x/scale]];
+            dst[x*3 + 0] = c.r;
+            dst[x*3 + 1] = c.g;
+            dst[x*3 + 2] = c.b;
+        }
+    }
+
+    switch (v->format) {
+        case VIDEO_Y4M: {
+            // BT.601 limited range, 4:4:4 so single pixel instructions keep their color
+            size_t n = v->frame_w * v->frame_h;
+            uint8_t *py = v->planes, *pcb = v->planes + n, *pcr = v->planes + 2*n;
+            for (size_t i = 0; i < n; ++i) {
+                int r = v->rgb[i*3 + 0], g = v->rgb[i*3 + 1], b = v->rgb[i*3 + 2];
+                py[i]  = (uint8_t)(( 66*r + 129*g +  25*b + 128)/256 + 16);
+                pcb[i] = (uint8_t)((-38*r -  74*g + 112*b + 128)/256 + 128);
+                pcr[i] = (uint8_t)((112*r -  94*g -  18*b + 128)/256 + 128);
+            }
+            fputs("FRAME\n", v->y4m);
+            if (fwrite(v->planes, 1, 3*n, v->y4m) != 3*n) {
+                nob_log(NOB_ERROR, "Could not write frame %zu", v->frames);
+                return false;
+            }
+            break;
+        }
+        case VIDEO_PNG_FRAMES: {
+            const char *frame_file = nob_temp_sprintf("%s/%06zu.png", v->frames_dir, v->frames);
+            bool ok = stbi_write_png(frame_file, v->frame_w, v->frame_h, 3, v->rgb, v->frame_w*3);
+            nob_temp_reset();
+            if (!ok) {
+                nob_log(NOB_ERROR, "Could not write frame %zu", v->frames);
+                return false;
+            }
+            break;
+        }
+    }
+    v->frames++;
+    return true;
+}
+
+// Slides the window one tape down, a frame is emitted every opts.step tapes once the window is full
+bool video_push_row(Video *v, const uint8_t *row, size_t rows_seen) {
+    if (v->filled < v->opts.rows) {
+        memcpy(&v->window[v->filled * v->width], row, v->width);
+        v->filled++;
+    } else {
+        memcpy(&v->window[v->head * v->width], row, v->width);
+        v->head = (v->head + 1) % v->opts.rows;
+    }
+    if (v->filled == v->opts.rows && (rows_seen - v->opts.rows) % v->opts.step == 0) {
+        return video_emit_frame(v);
+    }
+    return true;
+}
+
+// Flushes the tail of the trajectory that did not line up with opts.step
+bool video_end(Video *v, size_t rows_seen) {
+    bool ok = true;
+    if (rows_seen > 0 && (v->filled < v->opts.rows || (rows_seen - v->opts.rows) % v->opts.step != 0)) {
+        ok = video_emit_frame(v);
+    }
+    if (v->y4m) fclose(v->y4m);
+    free(v->window);
+    free(v->rgb);
+    free(v->planes);
+    return ok;
+}
+
+bool video_from_file(const char *file, Video_Opts opts, Video_Format format) {
+    Trajectory t = {0};
+    if (!trajectory_open(&t, file)) return false;
+    if (!trajectory_probe_width(&t)) {
+        trajectory_close(&t);
+        return false;
+    }
+
+    char *out = path_with_suffix(file, format == VIDEO_Y4M ? ".y4m" : "_frames");
+    Video v = {.format = format, .opts = opts};
+    uint8_t *row = malloc(t.width);
+    bool ok = video_begin(&v, out, t.width);
+
+    int r = 0;
+    while (ok && (r = trajectory_next(&t, row)) > 0) {
+        ok = video_push_row(&v, row, t.rows);
+    }
+    if (ok && r < 0) ok = false;
+    if (!video_end(&v, t.rows)) ok = false;
+
+    if (ok) {
+        nob_log(NOB_INFO, "wrote %zu frames (%zux%zu) from %zu programs to %s", v.frames, v.frame_w, v.frame_h, t.rows, out);
+    }
+    free(row);
+    free(out);
+    trajectory_close(&t);
+    return ok;
+}
+
+/*
+TILE PYRAMID
+*/
+
+#define PYRAMID_MAX_LEVELS 16
+#define PYRAMID_THUMB_ROWS 512
+
+// One downsampled image produced while streaming. Pyramid level L covers 2^L x 2^L
+// tape cells per pixel and is cut into tiles strip by strip; the overview only
+// aggregates rows so the tape stays readable in a thumbnail of a tall trajectory.
+typedef struct {
+    size_t x_shift;     // tape cells per pixel horizontally, as a shift
+    size_t y_block;     // tapes per pixel vertically
+    size_t width;       // pixels per row
+    uint32_t *counts;   // opcode frequencies of the pixel row being accumulated
+    size_t block_rows;  // tapes accumulated into counts so far
+    uint8_t *strip;     // RGB rows waiting to be written
+    size_t strip_rows;
+    size_t strip_cap;
+    size_t strip_index; // tile row of the current strip
+} Pyramid_Level;
+
+// Thumbnail of the whole trajectory. Tapes are summed into rows of opcode
+// counts, and once 2*PYRAMID_THUMB_ROWS rows are full every pair folds into
+// one and each row covers twice as many tapes, so no row count is needed up front.
+typedef struct {
+    size_t width;
+    size_t y_block;     // tapes per row
+    size_t block_rows;  // tapes in the row being accumulated
+    uint32_t *counts;   // opcode frequencies, rows + 1 rows of width pixels
+    size_t rows;        // completed rows
+} Pyramid_Overview;
+
+typedef struct {
+    const char *dir;
+    size_t tile;
+    size_t count;
+    Pyramid_Level levels[PYRAMID_MAX_LEVELS];
+    Pyramid_Overview overview;
+    size_t tiles_written;
+} Pyramid;
+
+bool pyramid_level_init(Pyramid_Level *l, size_t width, size_t x_shift, size_t y_block, size_t strip_cap) {
+    l->x_shift = x_shift;
+    l->y_block = y_block;
+    l->width = ((width - 1) >> x_shift) + 1;
+    l->strip_cap = strip_cap;
+    l->counts = calloc(l->width * NOB_ARRAY_LEN(colors), sizeof(uint32_t));
+    l->strip = malloc(l->width * strip_cap * 3);
+    if (l->counts == NULL || l->strip == NULL) {
+        nob_log(NOB_ERROR, "Could not allocate pyramid level");
+        return false;
+    }
+    return true;
+}
+
+bool pyramid_flush_strip(Pyramid *p, size_t level) {
+    Pyramid_Level *l = &p->levels[level];
+    if (l->strip_rows == 0) return true;
+    for (size_t x = 0; x < l->width; x += p->tile) {
+        size_t w = l->width - x < p->tile ? l->width - x : p->tile;
+        const char *tile_file = nob_temp_sprintf("%s/%zu/%zu_%zu.png", p->dir, level, l->strip_index, x / p->tile);
+        bool ok = stbi_write_png(tile_file, w, l->strip_rows, 3, &l->strip[x*3], l->width*3);
+        nob_temp_reset();
+        if (!ok) {
+            nob_log(NOB_ERROR, "Could not write tile %zu/%zu_%zu", level, l->strip_index, x / p->tile);
+            return false;
+        }
+        p->tiles_written++;
+    }
+    l->strip_rows = 0;
+    l->strip_index++;
+    return true;
+}
+
+void pyramid_level_emit_row(Pyramid_Level *l) {
+    size_t n = NOB_ARRAY_LEN(colors);
+    uint8_t *dst = &l->strip[l->strip_rows * l->width * 3];
+    for (size_t x = 0; x < l->width; ++x) {
+        Color c = aggregate_color(&l->counts[x*n]);
+        dst[x*3 + 0] = c.r;
+        dst[x*3 + 1] = c.g;
+        dst[x*3 + 2] = c.b;
+    }
+    memset(l->counts, 0, l->width * n * sizeof(uint32_t));
+    l->block_rows = 0;
+    l->strip_rows++;
+}
+
+void pyramid_level_push_row(Pyramid_Level *l, const uint8_t *row, size_t width) {
+    size_t n = NOB_ARRAY_LEN(colors);
+    for (size_t i = 0; i < width; ++i) {
+        l->counts[(i >> l->x_shift)*n + row[i]]++;
+    }
+    l->block_rows++;
+}
+
+// Adds row pairs into the first half, so rows stays below 2*PYRAMID_THUMB_ROWS
+void pyramid_overview_fold(Pyramid_Overview *o) {
+    size_t n = o->width * NOB_ARRAY_LEN(colors);
+    for (size_t i = 0; i < o->rows; ++i) {
+        uint32_t *dst = &o->counts[(i/2)*n], *src = &o->counts[i*n];
+        if (i == 0) continue;
+        if (i % 2 == 0) memcpy(dst, src, n*sizeof(uint32_t));
+        else for (size_t k = 0; k < n; ++k) dst[k] += src[k];
+    }
+    size_t rows = (o->rows + 1)/2;
+    // the partial row moves down with the completed ones
+    memmove(&o->counts[rows*n], &o->counts[o->rows*n], n*sizeof(uint32_t));
+    memset(&o->counts[(rows + 1)*n], 0, (o->rows - rows)*n*sizeof(uint32_t));
+    o->rows = rows;
+    o->y_block *= 2;
+}
+
+void pyramid_overview_push_row(Pyramid_Overview *o, const uint8_t *row) {
+    size_t n = NOB_ARRAY_LEN(colors);
+    uint32_t *counts = &o->counts[o->rows * o->width * n];
+    for (size_t i = 0; i < o->width; ++i) counts[i*n + row[i]]++;
+    if (++o->block_rows < o->y_block) return;
+    o->block_rows = 0;
+    if (++o->rows == 2*PYRAMID_THUMB_ROWS) pyramid_overview_fold(o);
+}
+
+bool pyramid_begin(Pyramid *p, const char *dir, size_t width, size_t rows_estimate) {
+    p->dir = dir;
+    if (!nob_mkdir_if_not_exists(dir)) return false;
+
+    // Stop once a whole level fits in a single tile
+    size_t rows = rows_estimate > 0 ? rows_estimate : 1;
+    for (p->count = 0; p->count < PYRAMID_MAX_LEVELS; ++p->count) {
+        size_t shift = p->count;
+        if (!pyramid_level_init(&p->levels[p->count], width, shift, (size_t)1 << shift, p->tile)) return false;
+        const char *level_dir = nob_temp_sprintf("%s/%zu", dir, p->count);
+        bool ok = nob_mkdir_if_not_exists(level_dir);
+        nob_temp_reset();
+        if (!ok) return false;
+        if (((rows - 1) >> shift) + 1 <= p->tile && ((width - 1) >> shift) + 1 <= p->tile) {
+            p->count++;
+            break;
+        }
+    }
+
+    Pyramid_Overview *o = &p->overview;
+    o->width = width;
+    o->y_block = 1;
+    o->counts = calloc((2*PYRAMID_THUMB_ROWS + 1) * width * NOB_ARRAY_LEN(colors), sizeof(uint32_t));
+    if (o->counts == NULL) {
+        nob_log(NOB_ERROR, "Could not allocate pyramid overview");
+        return false;
+    }
+    return true;
+}
+
+bool pyramid_push_row(Pyramid *p, const uint8_t *row, size_t width) {
+    for (size_t i = 0; i < p->count; ++i) {
+        Pyramid_Level *l = &p->levels[i];
+        pyramid_level_push_row(l, row, width);
+        if (l->block_rows == l->y_block) {
+            pyramid_level_emit_row(l);
+            if (l->strip_rows == l->strip_cap && !pyramid_flush_strip(p, i)) return false;
+        }
+    }
+    pyramid_overview_push_row(&p->overview, row);
+    return true;
+}
+
+bool pyramid_end(Pyramid *p) {
+    bool ok = true;
+    for (size_t i = 0; i < p->count; ++i) {
+        Pyramid_Level *l = &p->levels[i];
+        if (l->block_rows > 0) pyramid_level_emit_row(l);
+        if (ok) ok = pyramid_flush_strip(p, i);
+    }
+    Pyramid_Overview *o = &p->overview;
+    if (o->block_rows > 0) o->rows++;
+    o->block_rows = 0;
+    while (o->rows > PYRAMID_THUMB_ROWS) pyramid_overview_fold(o);
+    uint8_t *rgb = malloc(o->rows * o->width * 3 + 1);
+    if (ok && rgb == NULL) {
+        nob_log(NOB_ERROR, "Could not allocate pyramid overview");
+        ok = false;
+    }
+    if (ok && o->rows > 0) {
+        size_t n = NOB_ARRAY_LEN(colors);
+        for (size_t i = 0; i < o->rows * o->width; ++i) {
+            Color c = aggregate_color(&o->counts[i*n]);
+            rgb[i*3 + 0] = c.r;
+            rgb[i*3 + 1] = c.g;
+            rgb[i*3 + 2] = c.b;
+        }
+        const char *overview_file = nob_temp_sprintf("%s/overview.png", p->dir);
+        ok = stbi_write_png(overview_file, o->width, o->rows, 3, rgb, o->width*3);
+        if (!ok) nob_log(NOB_ERROR, "Could not write %s", overview_file);
+        nob_temp_reset();
+    }
+    free(rgb);
+    for (size_t i = 0; i < p->count; ++i) {
+        free(p->levels[i].counts);
+        free(p->levels[i].strip);
+    }
+    free(o->counts);
+    return ok;
+}
+
+bool pyramid_from_file(const char *file, size_t tile) {
+    Trajectory t = {0};
+    if (!trajectory_open(&t, file)) return false;
+    if (!trajectory_probe_width(&t)) {
+        trajectory_close(&t);
+        return false;
+    }
+
+    // Row count only decides how many levels to build, the file size gives it without a second pass
+    struct stat st;
+    size_t rows_estimate = stat(file, &st) == 0 ? (size_t)st.st_size / (t.width + 1) : 0;
+
+    char *dir = path_with_suffix(file, "_tiles");
+    Pyramid p = {.tile = tile > 0 ? tile : 256};
+    uint8_t *row = malloc(t.width);
+    bool ok = pyramid_begin(&p, dir, t.width, rows_estimate);
+
+    int r = 0;
+    while (ok && (r = trajectory_next(&t, row)) > 0) {
+        ok = pyramid_push_row(&p, row, t.width);
+    }
+    if (ok && r < 0) ok = false;
+    if (!pyramid_end(&p)) ok = false;
+
+    if (ok) {
+        nob_log(NOB_INFO, "wrote %zu tiles over %zu levels from %zu programs to %s", p.tiles_written, p.count, t.rows, dir);
+    }
+    free(row);
+    free(dir);
+    trajectory_close(&t);
+    return ok;
+}
+
 bool images_from_directory(const char *dir) {
     DIR *d = opendir(dir);
     if (!d) {
@@ -184,6 +654,17 @@ bool images_from_directory(const char *dir) {
     return true;
 }
 
+// Positive integer flag value, or 0 with an error for anything else
+size_t cmd_count(const char *flag, const char *value) {
+    char *end = NULL;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n <= 0) {
+        nob_log(NOB_ERROR, "%s needs a positive number, got %s", flag, value);
+        return 0;
+    }
+    return (size_t)n;
+}
+
 char *cmd_value(int *argc,char ***argv) {
     if ((*argc) <= 0) {
         nob_log(NOB_ERROR, "No argument is provided for directory of file");
@@ -195,6 +676,9 @@ char *cmd_value(int *argc,char ***argv) {
 int main(int argc, char **argv) {
     const char *program_name = nob_shift(argv, argc);
     (void)program_name;
+    // -rows/-step/-scale/-fps apply to every -v/-frames that follows them
+    Video_Opts video_opts = {0};
+    size_t tile_size = 256;
     while (argc > 0) {
          const char *flag = nob_shift(argv, argc);
          if (strcmp(flag, "-d") == 0) {
@@ -207,5 +691,38 @@ int main(int argc, char **argv) {
             nob_log(NOB_INFO, "processing file %s", file);
             if(!image_from_file(file)) return 1; 
          }
+         else if (strcmp(flag, "-v") == 0 || strcmp(flag, "-frames") == 0) {
+            const char *file = cmd_value(&argc, &argv);
+            if (file == NULL) return 1;
+            Video_Format format = strcmp(flag, "-v") == 0 ? VIDEO_Y4M : VIDEO_PNG_FRAMES;
+            nob_log(NOB_INFO, "rendering video for %s", file);
+            if(!video_from_file(file, video_opts, format)) return 1;
+         }
+         else if (strcmp(flag, "-tiles") == 0) {
+            const char *file = cmd_value(&argc, &argv);
+            if (file == NULL) return 1;
+            nob_log(NOB_INFO, "building tile pyramid for %s", file);
+            if(!pyramid_from_file(file, tile_size)) return 1;
+         }
+         else if (strcmp(flag, "-tile") == 0) {
+            const char *value = cmd_value(&argc, &argv);
+            if (value == NULL) return 1;
+            tile_size = cmd_count(flag, value);
+            if (tile_size == 0) return 1;
+         }
+         else if (strcmp(flag, "-rows") == 0 || strcmp(flag, "-step") == 0 || strcmp(flag, "-scale") == 0 || strcmp(flag, "-fps") == 0) {
+            const char *value = cmd_value(&argc, &argv);
+            if (value == NULL) return 1;
+            // -rows 0 asks for square frames again
+            size_t n = 0;
+            if (strcmp(flag, "-rows") != 0 || strcmp(value, "0") != 0) {
+                n = cmd_count(flag, value);
+                if (n == 0) return 1;
+            }
+            if (strcmp(flag, "-rows") == 0)  video_opts.rows = n;
+            if (strcmp(flag, "-step") == 0)  video_opts.step = n;
+            if (strcmp(flag, "-scale") == 0) video_opts.scale = n;
+            if (strcmp(flag, "-fps") == 0)   video_opts.fps = n;
+         }
     }
 }
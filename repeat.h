@@ -0,0 +1,94 @@
+// repeat.h - spots repeated machine states inside one evaluation
+//
+// An evaluator that keeps running after its state repeats just goes around
+// the same loop until it hits the step limit. It records its state at the few
+// points every loop has to pass, a taken backward jump for bf6 or an
+// instruction head turning around for bf7, and repeat_visit tells it when and
+// at which step a state was seen before.
+//
+// Instead of a bitmap that would have to be cleared for every evaluation,
+// slots carry the generation of the evaluation that wrote them, so
+// repeat_begin is O(1). The table is only wiped when the 32 bit generation
+// wraps around.
+//
+// The table comes from REPEAT_ALLOC(bytes), zeroed, and goes back through
+// REPEAT_FREE(p, bytes). Define both before the implementation to move it.
+//
+// Include after nob.h. Define REPEAT_IMPLEMENTATION in exactly one file.
+
+#ifndef REPEAT_H_
+#define REPEAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPEAT_SLOTS (1 << 16)  // power of two, above the step limit of the drivers
+#define REPEAT_NONE SIZE_MAX
+
+typedef struct {
+    uint64_t key;
+    uint32_t generation;
+    uint32_t step;
+} Repeat_Slot;
+
+typedef struct {
+    Repeat_Slot *slots;     // REPEAT_SLOTS, allocated by the first repeat_begin
+    uint32_t generation;
+    size_t used;            // slots of the current generation
+} Repeat;
+
+// Starts a new evaluation, forgets every state seen so far
+void repeat_begin(Repeat *r);
+// Records key at step and returns the step it was recorded at before, or
+// REPEAT_NONE. Once the table is full nothing new is recorded.
+size_t repeat_visit(Repeat *r, uint64_t key, size_t step);
+void repeat_free(Repeat *r);
+
+#endif // REPEAT_H_
+
+#ifdef REPEAT_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef REPEAT_ALLOC
+#define REPEAT_ALLOC(bytes) calloc(1, (bytes))
+#define REPEAT_FREE(p, bytes) free(p)
+#endif
+
+void repeat_begin(Repeat *r)
+{
+    if (r->slots == NULL) {
+        r->slots = REPEAT_ALLOC(REPEAT_SLOTS*sizeof(Repeat_Slot));
+        NOB_ASSERT(r->slots != NULL && "Buy more RAM lol");
+    }
+    if (++r->generation == 0) {
+        memset(r->slots, 0, REPEAT_SLOTS*sizeof(Repeat_Slot));
+        r->generation = 1;
+    }
+    r->used = 0;
+}
+
+size_t repeat_visit(Repeat *r, uint64_t key, size_t step)
+{
+    size_t i = (key*0x9E3779B97F4A7C15ull) >> 48;
+    for (;; i = (i + 1) & (REPEAT_SLOTS - 1)) {
+        Repeat_Slot *s = &r->slots[i];
+        if (s->generation != r->generation) {
+            // keep a quarter free so probes stay short
+            if (r->used >= REPEAT_SLOTS/4*3) return REPEAT_NONE;
+            *s = (Repeat_Slot){key, r->generation, step};
+            r->used++;
+            return REPEAT_NONE;
+        }
+        if (s->key == key) return s->step;
+    }
+}
+
+void repeat_free(Repeat *r)
+{
+    if (r->slots != NULL) REPEAT_FREE(r->slots, REPEAT_SLOTS*sizeof(Repeat_Slot));
+    memset(r, 0, sizeof(*r));
+}
+
+#endif // REPEAT_IMPLEMENTATION
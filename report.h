@@ -0,0 +1,203 @@
+// report.h - periodic progress reports from a background thread
+//
+// The reporter wakes up every interval, snapshots the histograms and record
+// counters with relaxed atomic loads and prints experiments/sec, the buckets
+// that changed since the last report and the current records. The same data is
+// appended as one JSON object per line to a stats file. Workers are never
+// paused and take no locks for it. Builds with COUNTERS also get the
+// instrumentation counters in every report.
+//
+// Include after nob.h and hist.h. Define REPORT_IMPLEMENTATION in exactly one file.
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define REPORT_MAX_HISTS 4
+#define REPORT_MAX_VALUES 8
+
+typedef struct {
+    const char *name;
+    _Atomic size_t *value;
+} Report_Value;
+
+typedef struct {
+    const char *stats_path;     // NULL disables the stats file
+    double interval;            // seconds between reports
+    size_t total;               // experiments planned, 0 if unknown
+    size_t done;                // of those already in hists[0] at start, e.g. from a checkpoint
+
+    // hists[0] counts one entry per finished experiment and drives the rate
+    const Hist *hists[REPORT_MAX_HISTS];
+    size_t hist_count;
+    Report_Value values[REPORT_MAX_VALUES];
+    size_t value_count;
+
+    // owned by the reporter
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stop;
+    FILE *stats;
+    double start_time;
+    double last_time;
+    uint64_t last_experiments;
+    uint64_t *last_counts;      // hist_count * HIST_BUCKETS
+} Reporter;
+
+void reporter_add_hist(Reporter *r, const Hist *h);
+void reporter_add_value(Reporter *r, const char *name, _Atomic size_t *value);
+bool reporter_start(Reporter *r);
+// Wakes the thread, prints a final report and joins it
+void reporter_stop(Reporter *r);
+void reporter_report(Reporter *r);
+
+#endif // REPORT_H_
+
+#ifdef REPORT_IMPLEMENTATION
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double report__now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+void reporter_add_hist(Reporter *r, const Hist *h)
+{
+    if (r->hist_count < REPORT_MAX_HISTS) r->hists[r->hist_count++] = h;
+}
+
+void reporter_add_value(Reporter *r, const char *name, _Atomic size_t *value)
+{
+    if (r->value_count < REPORT_MAX_VALUES) r->values[r->value_count++] = (Report_Value){name, value};
+}
+
+void reporter_report(Reporter *r)
+{
+    double now = report__now();
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t experiments = r->hist_count > 0 ? hist_total(r->hists[0]) : 0;
+    double dt = now - r->last_time;
+    double rate = dt > 0 ? (experiments - r->last_experiments)/dt : 0;
+    // experiments loaded before the start count towards the total but not the rate
+    double avg = now > r->start_time ? (experiments - r->done)/(now - r->start_time) : 0;
+
+    if (r->total > 0) {
+        nob_log(NOB_INFO, "experiments: %zu/%zu (%.1f%%), %.1f exp/s (avg %.1f exp/s)",
+                (size_t)experiments, r->total, 100.0*experiments/r->total, rate, avg);
+    } else {
+        nob_log(NOB_INFO, "experiments: %zu, %.1f exp/s (avg %.1f exp/s)", (size_t)experiments, rate, avg);
+    }
+    for (size_t v = 0; v < r->value_count; ++v) {
+        nob_log(NOB_INFO, "%s: %zu", r->values[v].name, atomic_load_explicit(r->values[v].value, memory_order_relaxed));
+    }
+    if (r->stats) {
+        fprintf(r->stats, "{\"time\":%.3f,\"experiments\":%zu,\"rate\":%.3f", now - r->start_time, (size_t)experiments, rate);
+        for (size_t v = 0; v < r->value_count; ++v) {
+            fprintf(r->stats, ",\"%s\":%zu", r->values[v].name, atomic_load_explicit(r->values[v].value, memory_order_relaxed));
+        }
+    }
+
+    for (size_t i = 0; i < r->hist_count; ++i) {
+        const Hist *h = r->hists[i];
+        uint64_t *last = &r->last_counts[i*HIST_BUCKETS];
+        hist_snapshot(h, counts);
+        nob_log(NOB_INFO, "%s histogram, buckets that changed:", h->name);
+        if (r->stats) fprintf(r->stats, ",\"%s\":[", h->name);
+        bool first = true;
+        for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+            if (counts[b] == 0) continue;
+            if (counts[b] != last[b]) {
+                printf("%zu: %zu (+%zu)\n", (size_t)hist_bucket_value(b), (size_t)counts[b], (size_t)(counts[b] - last[b]));
+            }
+            if (r->stats) {
+                fprintf(r->stats, "%s[%zu,%zu]", first ? "" : ",", (size_t)hist_bucket_value(b), (size_t)counts[b]);
+                first = false;
+            }
+        }
+        if (r->stats) fprintf(r->stats, "]");
+        memcpy(last, counts, sizeof(counts));
+    }
+#ifdef COUNTERS
+    counters_report(r->stats);
+#endif
+    if (r->stats) {
+        fprintf(r->stats, "}\n");
+        fflush(r->stats);
+    }
+    r->last_time = now;
+    r->last_experiments = experiments;
+}
+
+static void *report__thread(void *arg)
+{
+    Reporter *r = arg;
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        double t = deadline.tv_sec + deadline.tv_nsec*1e-9 + r->interval;
+        deadline.tv_sec = (time_t)t;
+        deadline.tv_nsec = (long)((t - (double)deadline.tv_sec)*1e9);
+        int rc = 0;
+        while (!r->stop && rc != ETIMEDOUT) rc = pthread_cond_timedwait(&r->wake, &r->lock, &deadline);
+        if (r->stop) break;
+        pthread_mutex_unlock(&r->lock);
+        reporter_report(r);
+        pthread_mutex_lock(&r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    reporter_report(r);
+    return NULL;
+}
+
+bool reporter_start(Reporter *r)
+{
+    if (r->interval <= 0) r->interval = 10;
+    r->last_counts = calloc(REPORT_MAX_HISTS*HIST_BUCKETS, sizeof(uint64_t));
+    if (r->last_counts == NULL) return false;
+    if (r->stats_path != NULL) {
+        r->stats = fopen(r->stats_path, "w");
+        if (r->stats == NULL) {
+            nob_log(NOB_ERROR, "Could not open stats file %s", r->stats_path);
+            return false;
+        }
+    }
+    r->start_time = r->last_time = report__now();
+    r->last_experiments = r->done;
+    r->stop = false;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    if (pthread_create(&r->thread, NULL, report__thread, r) != 0) {
+        nob_log(NOB_ERROR, "Could not start reporter thread");
+        return false;
+    }
+    return true;
+}
+
+void reporter_stop(Reporter *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->stop = true;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    if (r->stats) fclose(r->stats);
+    r->stats = NULL;
+    free(r->last_counts);
+    r->last_counts = NULL;
+}
+
+#endif // REPORT_IMPLEMENTATION
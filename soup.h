@@ -0,0 +1,402 @@
+// soup.h - primordial soup: a population of tapes that rewrite each other
+//
+// All tapes live in one contiguous pool, tape i at tapes + i*tape_size. Every
+// epoch shuffles the pool into disjoint pairs, so each tape takes part in
+// exactly one interaction. An interaction concatenates the two tapes, runs the
+// 2*tape_size cell pair through the driver's evaluator and splits the result
+// back into the two slots. Afterwards every cell of the pair is replaced by a
+// random opcode with probability mutation_rate.
+//
+// Pairs never overlap, so the workers claim them in chunks without locks.
+// Every pair draws from its own splitmix64 stream keyed by (seed, epoch, pair),
+// so a soup evolves the same way with any number of threads.
+//
+// With width and height set the soup is a torus of tapes instead, and a tape
+// only meets its four neighbors. Each epoch picks one of four perfect
+// matchings of the lattice: horizontal or vertical dominoes starting on even
+// or odd columns/rows. Like the shuffled pairs, they never overlap, so
+// the whole epoch runs in parallel without locks. The lattice is stored in
+// SOUP_BLOCK x SOUP_BLOCK blocks of tapes, pairs are enumerated block by block,
+// so a chunk of pairs touches a few neighboring blocks instead of rows far apart.
+//
+// Snapshots are a Soup_Snapshot_Header followed by the raw pool in slot order
+// and can be loaded to continue a run.
+//
+// Include after nob.h. Define SOUP_IMPLEMENTATION in exactly one file.
+
+#ifndef SOUP_H_
+#define SOUP_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SOUP_MAGIC 0x50534642u // "BFSP"
+#define SOUP_VERSION 2
+#define SOUP_CHUNK 64           // pairs claimed at once by a worker
+#define SOUP_BLOCK 8            // tapes per side of a lattice block
+
+// Runs the pair src of len cells, leaves the rewritten pair in dst and
+// returns the number of instructions executed
+typedef size_t (*Soup_Eval)(const uint8_t *src, uint8_t *dst, size_t len);
+
+typedef struct {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t tape_size;
+    uint64_t count;
+    uint64_t alphabet;
+    uint64_t seed;
+    uint64_t epoch;         // epochs already run
+    uint64_t width;         // 0 for a well-mixed soup
+    uint64_t height;
+} Soup_Snapshot_Header;
+
+struct Soup;
+
+typedef struct {
+    struct Soup *soup;
+    pthread_t thread;
+    uint8_t *pair;          // 2*tape_size cells each
+    uint8_t *result;
+    uint64_t interactions;
+    uint64_t steps;
+    uint64_t mutations;
+} Soup_Worker;
+
+typedef struct Soup {
+    size_t tape_size;
+    size_t count;           // tapes, even
+    size_t alphabet;        // every cell is < alphabet
+    double mutation_rate;   // per cell and epoch
+    uint64_t seed;
+    size_t threads;
+    Soup_Eval eval;
+    // lattice size, both multiples of SOUP_BLOCK, 0 for a well-mixed soup
+    size_t width;
+    size_t height;
+
+    uint8_t *tapes;         // count*tape_size
+    uint32_t *order;        // well-mixed: pair k of this epoch is (order[2k], order[2k + 1])
+    size_t matching;        // lattice: this epoch's matching, see soup__pair
+    uint64_t epoch;
+
+    // totals over every epoch run since soup_init
+    uint64_t interactions;
+    uint64_t steps;
+    uint64_t mutations;
+
+    // owned by the worker pool
+    Soup_Worker *workers;
+    pthread_barrier_t start, done;
+    _Atomic size_t next_pair;
+    bool stop;
+} Soup;
+
+// Fills the pool with random tapes unless s->tapes is already set (see
+// soup_snapshot_read) and starts threads - 1 workers, the caller is the last one.
+// A lattice sets count to width*height.
+bool soup_init(Soup *s);
+void soup_free(Soup *s);
+// Runs one epoch of count/2 interactions
+void soup_epoch(Soup *s);
+bool soup_snapshot_write(const Soup *s, const char *path);
+// Sets the pool, tape size, lattice, seed and epoch of s from a snapshot, call before soup_init
+bool soup_snapshot_read(Soup *s, const char *path);
+// Slot in s->tapes of the lattice tape at (x, y)
+size_t soup_grid_slot(const Soup *s, size_t x, size_t y);
+
+#endif // SOUP_H_
+
+#ifdef SOUP_IMPLEMENTATION
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t soup__rng_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t soup__rng(uint64_t seed, uint64_t epoch, uint64_t index)
+{
+    uint64_t state = seed ^ (epoch*0xD1B54A32D192ED03ull) ^ (index*0x8CB92BA72F3D8DD7ull);
+    soup__rng_next(&state);
+    return state;
+}
+
+// Uniform in (0, 1]
+static double soup__unit(uint64_t *rng)
+{
+    return ((soup__rng_next(rng) >> 11) + 1)*(1.0/9007199254740992.0);
+}
+
+// Mutates cells [0, len) with probability rate each, skipping ahead by
+// geometric gaps so the cost is per mutation rather than per cell
+static size_t soup__mutate(uint8_t *cells, size_t len, size_t alphabet, double rate, uint64_t *rng)
+{
+    if (rate <= 0) return 0;
+    size_t n = 0;
+    double scale = rate >= 1 ? 0 : 1.0/log1p(-rate);
+    for (size_t i = 0;; ++i, ++n) {
+        if (scale != 0) i += (size_t)(log(soup__unit(rng))*scale);
+        if (i >= len) break;
+        cells[i] = soup__rng_next(rng)%alphabet;
+    }
+    return n;
+}
+
+size_t soup_grid_slot(const Soup *s, size_t x, size_t y)
+{
+    size_t block = (y/SOUP_BLOCK)*(s->width/SOUP_BLOCK) + x/SOUP_BLOCK;
+    return block*SOUP_BLOCK*SOUP_BLOCK + (y%SOUP_BLOCK)*SOUP_BLOCK + x%SOUP_BLOCK;
+}
+
+// Slots of pair k. On the lattice every block owns SOUP_BLOCK*SOUP_BLOCK/2
+// pairs, those whose first tape lies in it. Matching bit 0 picks vertical
+// dominoes, bit 1 starts them on odd columns/rows so they cross block and
+// torus edges.
+static void soup__pair(const Soup *s, size_t k, size_t *a, size_t *b)
+{
+    if (s->width == 0) {
+        *a = s->order[2*k];
+        *b = s->order[2*k + 1];
+        return;
+    }
+    size_t per_block = SOUP_BLOCK*SOUP_BLOCK/2;
+    size_t block = k/per_block, j = k%per_block;
+    size_t x0 = block%(s->width/SOUP_BLOCK)*SOUP_BLOCK;
+    size_t y0 = block/(s->width/SOUP_BLOCK)*SOUP_BLOCK;
+    size_t offset = s->matching >> 1;
+    size_t x, y, nx, ny;
+    if (s->matching & 1) {
+        x = x0 + j%SOUP_BLOCK;
+        y = y0 + 2*(j/SOUP_BLOCK) + offset;
+        nx = x;
+        ny = (y + 1)%s->height;
+    } else {
+        x = x0 + 2*(j%(SOUP_BLOCK/2)) + offset;
+        y = y0 + j/(SOUP_BLOCK/2);
+        nx = (x + 1)%s->width;
+        ny = y;
+    }
+    *a = soup_grid_slot(s, x, y);
+    *b = soup_grid_slot(s, nx, ny);
+}
+
+static void soup__interact(Soup *s, Soup_Worker *w, size_t k)
+{
+    size_t t = s->tape_size;
+    size_t sa, sb;
+    soup__pair(s, k, &sa, &sb);
+    uint8_t *a = &s->tapes[sa*t];
+    uint8_t *b = &s->tapes[sb*t];
+    memcpy(w->pair, a, t);
+    memcpy(w->pair + t, b, t);
+    w->steps += s->eval(w->pair, w->result, 2*t);
+    uint64_t rng = soup__rng(s->seed, s->epoch, k);
+    w->mutations += soup__mutate(w->result, 2*t, s->alphabet, s->mutation_rate, &rng);
+    memcpy(a, w->result, t);
+    memcpy(b, w->result + t, t);
+    w->interactions++;
+}
+
+static void soup__run(Soup *s, Soup_Worker *w)
+{
+    size_t pairs = s->count/2;
+    for (;;) {
+        size_t first = atomic_fetch_add_explicit(&s->next_pair, SOUP_CHUNK, memory_order_relaxed);
+        if (first >= pairs) break;
+        size_t last = first + SOUP_CHUNK < pairs ? first + SOUP_CHUNK : pairs;
+        for (size_t k = first; k < last; ++k) soup__interact(s, w, k);
+    }
+}
+
+static void *soup__worker(void *arg)
+{
+    Soup_Worker *w = arg;
+    Soup *s = w->soup;
+    for (;;) {
+        pthread_barrier_wait(&s->start);
+        if (s->stop) break;
+        soup__run(s, w);
+        pthread_barrier_wait(&s->done);
+    }
+    return NULL;
+}
+
+bool soup_init(Soup *s)
+{
+    if (s->width > 0 || s->height > 0) {
+        if (s->width < SOUP_BLOCK || s->height < SOUP_BLOCK || s->width%SOUP_BLOCK != 0 || s->height%SOUP_BLOCK != 0) {
+            nob_log(NOB_ERROR, "Soup lattice sides must be multiples of %d, got %zux%zu", SOUP_BLOCK, s->width, s->height);
+            return false;
+        }
+        s->count = s->width*s->height;
+    }
+    if (s->count < 2 || s->count > UINT32_MAX || s->tape_size == 0 || s->alphabet == 0 || s->eval == NULL) {
+        nob_log(NOB_ERROR, "Soup needs at least 2 tapes, a tape size, an alphabet and an evaluator");
+        return false;
+    }
+    s->count &= ~(size_t)1;
+    if (s->threads == 0) s->threads = 1;
+    if (s->tapes == NULL) {
+        s->tapes = malloc(s->count*s->tape_size);
+        if (s->tapes == NULL) return false;
+        uint64_t rng = soup__rng(s->seed, UINT64_MAX, 0);
+        for (size_t i = 0; i < s->count*s->tape_size; ++i) s->tapes[i] = soup__rng_next(&rng)%s->alphabet;
+    }
+    if (s->width == 0) {
+        s->order = malloc(s->count*sizeof(uint32_t));
+        if (s->order == NULL) return false;
+    }
+    s->workers = calloc(s->threads, sizeof(Soup_Worker));
+    if (s->workers == NULL) return false;
+
+    s->stop = false;
+    pthread_barrier_init(&s->start, NULL, s->threads);
+    pthread_barrier_init(&s->done, NULL, s->threads);
+    for (size_t i = 0; i < s->threads; ++i) {
+        Soup_Worker *w = &s->workers[i];
+        w->soup = s;
+        w->pair = malloc(2*s->tape_size);
+        w->result = malloc(2*s->tape_size);
+        if (w->pair == NULL || w->result == NULL) return false;
+        // the caller's thread is the last worker
+        if (i + 1 < s->threads && pthread_create(&w->thread, NULL, soup__worker, w) != 0) {
+            nob_log(NOB_ERROR, "Could not start soup worker %zu", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void soup_free(Soup *s)
+{
+    if (s->workers != NULL) {
+        s->stop = true;
+        pthread_barrier_wait(&s->start);
+        for (size_t i = 0; i + 1 < s->threads; ++i) pthread_join(s->workers[i].thread, NULL);
+        for (size_t i = 0; i < s->threads; ++i) {
+            free(s->workers[i].pair);
+            free(s->workers[i].result);
+        }
+        pthread_barrier_destroy(&s->start);
+        pthread_barrier_destroy(&s->done);
+        free(s->workers);
+    }
+    free(s->tapes);
+    free(s->order);
+    s->workers = NULL;
+    s->tapes = NULL;
+    s->order = NULL;
+}
+
+void soup_epoch(Soup *s)
+{
+    // the pairing only depends on (seed, epoch) so a loaded snapshot continues the same run
+    uint64_t rng = soup__rng(s->seed, s->epoch, UINT64_MAX);
+    if (s->width > 0) {
+        s->matching = soup__rng_next(&rng)%4;
+    } else {
+        // inside-out Fisher-Yates
+        s->order[0] = 0;
+        for (size_t i = 1; i < s->count; ++i) {
+            size_t j = soup__rng_next(&rng)%(i + 1);
+            s->order[i] = s->order[j];
+            s->order[j] = i;
+        }
+    }
+    atomic_store_explicit(&s->next_pair, 0, memory_order_relaxed);
+
+    // the barriers order the shuffle before and the interactions after every worker
+    pthread_barrier_wait(&s->start);
+    Soup_Worker *self = &s->workers[s->threads - 1];
+    soup__run(s, self);
+    pthread_barrier_wait(&s->done);
+
+    for (size_t i = 0; i < s->threads; ++i) {
+        Soup_Worker *w = &s->workers[i];
+        s->interactions += w->interactions;
+        s->steps += w->steps;
+        s->mutations += w->mutations;
+        w->interactions = w->steps = w->mutations = 0;
+    }
+    s->epoch++;
+}
+
+bool soup_snapshot_write(const Soup *s, const char *path)
+{
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        nob_log(NOB_ERROR, "Could not open %s", tmp_path);
+        return false;
+    }
+    Soup_Snapshot_Header header = {
+        .magic = SOUP_MAGIC,
+        .version = SOUP_VERSION,
+        .tape_size = s->tape_size,
+        .count = s->count,
+        .alphabet = s->alphabet,
+        .seed = s->seed,
+        .epoch = s->epoch,
+        .width = s->width,
+        .height = s->height,
+    };
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(s->tapes, s->tape_size, s->count, f);
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        nob_log(NOB_ERROR, "Could not write soup snapshot %s", path);
+        return false;
+    }
+    return true;
+}
+
+bool soup_snapshot_read(Soup *s, const char *path)
+{
+    Nob_String_Builder data = {0};
+    if (!nob_read_entire_file(path, &data)) return false;
+    Soup_Snapshot_Header header;
+    bool ok = data.count >= sizeof(header);
+    if (ok) {
+        memcpy(&header, data.items, sizeof(header));
+        ok = header.magic == SOUP_MAGIC && header.version == SOUP_VERSION &&
+             header.count > 0 && header.tape_size > 0 &&
+             (header.width == 0 || header.width*header.height == header.count) &&
+             data.count - sizeof(header) == header.count*header.tape_size;
+    }
+    if (!ok) {
+        nob_log(NOB_ERROR, "%s is not a soup snapshot", path);
+        nob_sb_free(data);
+        return false;
+    }
+    if (s->alphabet != 0 && s->alphabet != header.alphabet) {
+        nob_log(NOB_ERROR, "%s was written with %zu opcodes, expected %zu", path, (size_t)header.alphabet, s->alphabet);
+        nob_sb_free(data);
+        return false;
+    }
+    s->tape_size = header.tape_size;
+    s->count = header.count;
+    s->alphabet = header.alphabet;
+    s->seed = header.seed;
+    s->epoch = header.epoch;
+    s->width = header.width;
+    s->height = header.height;
+    s->tapes = malloc(s->count*s->tape_size);
+    if (s->tapes != NULL) memcpy(s->tapes, data.items + sizeof(header), s->count*s->tape_size);
+    nob_sb_free(data);
+    return s->tapes != NULL;
+}
+
+#endif // SOUP_IMPLEMENTATION
@@ -0,0 +1,195 @@
+// swiss.h - open addressing set of 32 bit values, probed 16 slots at a time
+//
+// The layout of Abseil's SwissTable without deletes. Every slot has a control
+// byte, SWISS_EMPTY or the top 7 bits of the value's 32 bit hash. A lookup
+// compares the 16 control bytes of a group with the tag in one SSE2 compare,
+// only slots whose tag and stored hash both match are handed to the caller's
+// key compare, and the first group with an empty slot ends the probe. Groups
+// are aligned, probed one after another from the group the low hash bits pick.
+//
+// Capacity is a power of two and doubles once the table is 7/8 full, so a
+// lookup never runs out of slots. swiss_reset only clears the control bytes
+// and shrinks a table that grew for a long run back to where it started.
+//
+// Blocks come from SWISS_ALLOC(bytes), which has to return zeroed memory
+// aligned to 16 bytes, and go back through SWISS_FREE(p, bytes). Define both
+// before including the implementation to place them elsewhere.
+//
+// Include after nob.h. Define SWISS_IMPLEMENTATION in exactly one file.
+
+#ifndef SWISS_H_
+#define SWISS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SWISS_GROUP 16
+#define SWISS_EMPTY 0x80
+#define SWISS_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t value;
+    uint32_t hash;
+} Swiss_Slot;
+
+typedef struct {
+    uint8_t *ctrl;          // capacity control bytes, 16 byte aligned
+    Swiss_Slot *slots;
+    size_t capacity;        // power of two, at least SWISS_GROUP
+    size_t count;
+    size_t min_capacity;    // what swiss_init asked for, swiss_reset shrinks back to it
+    size_t groups;          // groups probed by the last swiss_insert
+    bool grew;              // the last swiss_insert doubled the capacity
+} Swiss;
+
+// True when value, which hashed to the same 32 bits, holds the key being looked up
+typedef bool (*Swiss_Eq)(const void *ctx, uint32_t value);
+
+bool swiss_init(Swiss *t, size_t capacity);
+void swiss_reset(Swiss *t);
+void swiss_free(Swiss *t);
+// Returns the value already stored for the key, or stores value and returns
+// SWISS_NONE. Only fails to store when growing runs out of memory.
+uint32_t swiss_insert(Swiss *t, uint32_t hash, uint32_t value, Swiss_Eq eq, const void *ctx);
+
+#endif // SWISS_H_
+
+#ifdef SWISS_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef SWISS_ALLOC
+#define SWISS_ALLOC(bytes) calloc(1, (bytes))
+#define SWISS_FREE(p, bytes) free(p)
+#endif
+
+#define swiss__tag(hash) ((uint8_t)((hash) >> 25))
+
+// Bit i set for every control byte of the group equal to byte
+static inline uint32_t swiss__match(const uint8_t *group, uint8_t byte)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < SWISS_GROUP; ++i) mask |= (uint32_t)(group[i] == byte) << i;
+    return mask;
+#endif
+}
+
+static void swiss__release(Swiss *t)
+{
+    if (t->ctrl != NULL) SWISS_FREE(t->ctrl, t->capacity);
+    if (t->slots != NULL) SWISS_FREE(t->slots, t->capacity*sizeof(Swiss_Slot));
+}
+
+static bool swiss__alloc(Swiss *t, size_t capacity)
+{
+    uint8_t *ctrl = SWISS_ALLOC(capacity);
+    Swiss_Slot *slots = SWISS_ALLOC(capacity*sizeof(Swiss_Slot));
+    if (ctrl == NULL || slots == NULL) {
+        if (ctrl != NULL) SWISS_FREE(ctrl, capacity);
+        if (slots != NULL) SWISS_FREE(slots, capacity*sizeof(Swiss_Slot));
+        return false;
+    }
+    memset(ctrl, SWISS_EMPTY, capacity);
+    swiss__release(t);
+    t->ctrl = ctrl;
+    t->slots = slots;
+    t->capacity = capacity;
+    t->count = 0;
+    return true;
+}
+
+bool swiss_init(Swiss *t, size_t capacity)
+{
+    memset(t, 0, sizeof(*t));
+    size_t c = SWISS_GROUP;
+    while (c < capacity) c *= 2;
+    t->min_capacity = c;
+    if (!swiss__alloc(t, c)) {
+        nob_log(NOB_ERROR, "swiss: could not allocate %zu slots", c);
+        return false;
+    }
+    return true;
+}
+
+void swiss_reset(Swiss *t)
+{
+    if (t->capacity > t->min_capacity && swiss__alloc(t, t->min_capacity)) return;
+    memset(t->ctrl, SWISS_EMPTY, t->capacity);
+    t->count = 0;
+}
+
+void swiss_free(Swiss *t)
+{
+    swiss__release(t);
+    memset(t, 0, sizeof(*t));
+}
+
+// Slot for a hash known not to be in the table
+static size_t swiss__free_slot(const Swiss *t, uint32_t hash)
+{
+    size_t mask = t->capacity - 1;
+    for (size_t g = hash & mask & ~(size_t)(SWISS_GROUP - 1);; g = (g + SWISS_GROUP) & mask) {
+        uint32_t empty = swiss__match(&t->ctrl[g], SWISS_EMPTY);
+        if (empty != 0) return g + (size_t)__builtin_ctz(empty);
+    }
+}
+
+static bool swiss__grow(Swiss *t)
+{
+    Swiss old = *t;
+    t->ctrl = NULL;
+    t->slots = NULL;
+    if (!swiss__alloc(t, old.capacity*2)) {
+        *t = old;
+        return false;
+    }
+    for (size_t i = 0; i < old.capacity; ++i) {
+        if (old.ctrl[i] == SWISS_EMPTY) continue;
+        size_t j = swiss__free_slot(t, old.slots[i].hash);
+        t->ctrl[j] = old.ctrl[i];
+        t->slots[j] = old.slots[i];
+    }
+    t->count = old.count;
+    swiss__release(&old);
+    return true;
+}
+
+uint32_t swiss_insert(Swiss *t, uint32_t hash, uint32_t value, Swiss_Eq eq, const void *ctx)
+{
+    uint8_t tag = swiss__tag(hash);
+    size_t mask = t->capacity - 1;
+    t->groups = 0;
+    t->grew = false;
+    for (size_t g = hash & mask & ~(size_t)(SWISS_GROUP - 1);; g = (g + SWISS_GROUP) & mask) {
+        t->groups++;
+        for (uint32_t m = swiss__match(&t->ctrl[g], tag); m != 0; m &= m - 1) {
+            const Swiss_Slot *s = &t->slots[g + (size_t)__builtin_ctz(m)];
+            if (s->hash == hash && eq(ctx, s->value)) return s->value;
+        }
+        if (swiss__match(&t->ctrl[g], SWISS_EMPTY) != 0) break;
+    }
+    // the key is new, make room before storing it
+    if (8*(t->count + 1) > 7*t->capacity) {
+        if (!swiss__grow(t)) {
+            nob_log(NOB_ERROR, "swiss: could not grow past %zu slots", t->capacity);
+            return SWISS_NONE;
+        }
+        t->grew = true;
+    }
+    size_t j = swiss__free_slot(t, hash);
+    t->ctrl[j] = tag;
+    t->slots[j] = (Swiss_Slot){value, hash};
+    t->count++;
+    return SWISS_NONE;
+}
+
+#endif // SWISS_IMPLEMENTATION